@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+// Static arena configuration
+#define ARENA_BUDGET          (48 * 1024) // Upper limit for arena size, checked at build time
+#define ARENA_ALIGNMENT       16          // Alignment of every allocation (required by esp-dsp)
+#define ARENA_MAX_ALLOCATIONS 32          // Number of live allocations tracked for the report
+
+/**
+ * @brief Position in the arena that allocations can be released back to.
+ */
+typedef size_t ArenaMark;
+
+/**
+ * @brief Allocates zeroed memory from the static arena.
+ *
+ * Arena works like a stack. Memory is never released individually, instead everything allocated
+ * after a mark is released at once with `releaseArena`. This makes it possible to scope allocations
+ * to a stage, e.g. an active visualization, while the size of the whole arena is known at build time.
+ *
+ * @param size Number of bytes to allocate. It is rounded up to `ARENA_ALIGNMENT`.
+ * @param tag Name of the allocation, used in the report.
+ *
+ * @return Pointer to memory aligned to `ARENA_ALIGNMENT`.
+ *
+ * @note There is no recovery from running out of memory, the function halts.
+ */
+void *arenaAllocate(size_t size, const char *tag);
+
+/**
+ * @brief Returns current position in the arena.
+ */
+ArenaMark getArenaMark();
+
+/**
+ * @brief Releases all allocations made after the specified mark.
+ *
+ * @param mark Position returned by `getArenaMark`.
+ */
+void releaseArena(ArenaMark mark);
+
+/**
+ * @brief Prints live allocations, current and peak usage of the arena.
+ */
+void printArenaReport();
+
+#endif
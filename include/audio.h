@@ -6,8 +6,46 @@
 // Audio sampling nad processing configuration
 #define AUDIO_I2S_PORT      I2S_NUM_0 // I2S port for audio input
 #define AUDIO_N_SAMPLES     1024      //
-#define AUDIO_SAMPLING_RATE 44100     //
-#define AUDIO_N_BANDS       32        // Number of frequency bands produced
+#define AUDIO_SAMPLING_RATE 44100     // Default sampling rate, at which tables are calibrated
+#define AUDIO_N_BANDS       32        // Default number of frequency bands produced, with which tables are calibrated
+#define AUDIO_MIN_BANDS     8         // Fewest bands selectable at runtime (power of two)
+#define AUDIO_MAX_BANDS     64        // Most bands selectable at runtime (power of two), arrays of bands are sized for it
+#define AUDIO_DMA_BUF_COUNT 16        // Default number of I2S DMA buffers
+#define AUDIO_DMA_BUF_LEN   256       // Default number of samples per I2S DMA buffer (per channel)
+
+#define AUDIO_LEFT_CHANNEL_FIRST true // Order of channels in I2S frames, flip if stereo halves come out swapped
+
+// Memory allocated from the static arena by `setupAudioProcessing`: FFT buffer (also used for raw
+// stereo capture), histories and bass histories of two channels and half of the window
+#define AUDIO_ARENA_SIZE (sizeof(float) * AUDIO_N_SAMPLES * (2 + 2 + 2) + sizeof(float) * AUDIO_N_SAMPLES / 2)
+
+// Capacity of the I2S driver event queue, drained after every read. Every completed DMA buffer posts an
+// event, so it should hold the events of the longest read plus the overflows of a stalled capture.
+#define AUDIO_I2S_EVENT_QUEUE_LEN 32
+
+// Synthetic samples are delivered at the sampling rate, as if they were captured. With `false` reads
+// return at once, which measures processing throughput rather than behavior in real time.
+#ifndef AUDIO_SYNTHETIC_PACED
+#define AUDIO_SYNTHETIC_PACED true
+#endif
+
+// Reads that waited at least this long for DMA are assumed to return freshly completed samples
+#define AUDIO_CAPTURE_BLOCKING_THRESHOLD_US 200
+
+// FFT size can be lowered at runtime down to this size (power of two), buffers are sized for `AUDIO_N_SAMPLES`
+#define AUDIO_FFT_MIN_SIZE           256
+#define AUDIO_N_FFT_SIZES            3 // Candidate sizes from `AUDIO_FFT_MIN_SIZE` to `AUDIO_N_SAMPLES`
+#define AUDIO_FFT_N_CALIBRATION_RUNS 8 // Runs averaged when measuring cost of each FFT size
+
+// Silence gate: while new samples stay below the noise floor, the FFT engine skips analysis and outputs zero bands.
+// Noise floor is the RMS of the signal that would produce the noise table, so the gate is off with neutral tables.
+#define AUDIO_SILENCE_CLOSE_FACTOR 1.0 // Gate closes below this multiple of the noise floor RMS...
+#define AUDIO_SILENCE_OPEN_FACTOR  1.5 // ...and opens above this one
+#define AUDIO_SILENCE_HOLD_FRAMES  32  // Consecutive frames below the noise floor before the gate closes
+
+// Multirate (bass) analysis configuration
+#define AUDIO_BASS_DECIMATION 4  // Decimation factor of the signal used for the lowest bands
+#define AUDIO_BASS_N_BANDS    12 // Number of lowest bands computed from the decimated signal, out of `AUDIO_N_BANDS`
 
 // Pins for PCM-1808 (CJMCU-1808)
 #define AUDIO_LINE_IN_MASTER_CLOCK_PIN 0  // Labeled SCK
@@ -30,10 +68,64 @@
  * @brief Enum-like definition for selecting audio sources.
  */
 typedef int AudioSource;
-#define AUDIO_SOURCE_NONE           -1
-#define AUDIO_SOURCE_MIC            0
-#define AUDIO_SOURCE_LINE_IN        1
-#define AUDIO_SOURCE_TYPE_MAX_VALUE 1
+#define AUDIO_SOURCE_NONE               -1
+#define AUDIO_SOURCE_MIC                0
+#define AUDIO_SOURCE_LINE_IN            1
+#define AUDIO_SOURCE_SYNTHETIC          2 // Deterministic test signal (see `synthetic.h`), no hardware needed
+#define AUDIO_SOURCE_TYPE_MAX_VALUE     2
+#define AUDIO_SOURCE_HARDWARE_MAX_VALUE 1 // Sources up to this one capture from I2S
+
+/**
+ * @brief I2S capture configuration.
+ *
+ * Together DMA buffers hold `dmaBufCount * dmaBufLen` samples, which is the longest time processing
+ * can fall behind before samples are lost, and also the worst case latency added by the queue.
+ * `readChunk` is the number of new samples the FFT engine waits for before processing the next frame.
+ * Frames overlap when `readChunk` is smaller than the FFT size, which increases frame rate without
+ * reducing frequency resolution. The filterbank engine always waits for a single DMA buffer.
+ */
+typedef struct {
+    int dmaBufCount; // Number of DMA buffers (2 to 128), `AUDIO_DMA_BUF_COUNT` by default
+    int dmaBufLen;   // Samples per DMA buffer (8 to 1024), `AUDIO_DMA_BUF_LEN` by default
+    int readChunk;   // New samples per FFT frame (multiple of `AUDIO_BASS_DECIMATION`, at most the FFT size), `AUDIO_N_SAMPLES` by default
+} AudioCaptureConfig;
+
+/**
+ * @brief Processing costs measured by `setupAudioProcessing`, which can be cached across boots of the same build.
+ */
+typedef struct {
+    unsigned long fftCosts[AUDIO_N_FFT_SIZES]; // Time per frame of each candidate FFT size, smallest first, 0 if not measured
+} AudioCalibration;
+
+/**
+ * @brief Enum-like definition for selecting band analysis engine.
+ *
+ * The FFT engine processes blocks of `AUDIO_N_SAMPLES` samples and has the best frequency resolution.
+ * The filterbank engine runs one band-pass biquad filter per band over every DMA buffer as soon as it
+ * is available, which trades frequency precision for much lower and more uniform latency.
+ */
+typedef int AudioEngine;
+#define AUDIO_ENGINE_FFT        0
+#define AUDIO_ENGINE_FILTERBANK 1
+#define AUDIO_ENGINE_MAX_VALUE  1
+
+/**
+ * @brief Enum-like definition for selecting how the stereo input is analyzed by the FFT engine.
+ *
+ * In stereo modes each channel is analyzed separately, both in a single complex FFT, and folded into
+ * half of the bands (pairs of adjacent bands are summed). The first channel fills the left half
+ * of the bands from high to low frequencies, the second one the right half from low to high, so that
+ * bass of both channels meets in the middle. The filterbank engine always analyzes mono.
+ */
+typedef int AudioChannelMode;
+#define AUDIO_CHANNELS_MONO      0 // Left and right are summed, bands go from low to high frequencies
+#define AUDIO_CHANNELS_STEREO    1 // Left channel on the left half, right channel on the right half
+#define AUDIO_CHANNELS_MID_SIDE  2 // Mid (L + R) on the left half, side (L - R) on the right half
+#define AUDIO_CHANNELS_MAX_VALUE 2
+
+// Filterbank configuration
+#define AUDIO_FILTERBANK_MIN_ENVELOPE_TIME 0.01 // Minimal time constant of band RMS envelope in seconds
+#define AUDIO_FILTERBANK_ENVELOPE_PERIODS  2.0  // Band RMS envelope time constant in periods of band center frequency
 
 /**
  * @brief Initializes specified audio source.
@@ -42,10 +134,37 @@ typedef int AudioSource;
  * Only one audio source can be initialized at a time; to initialize a different source, you must
  * first call `teardownAudioSource` on any already initialized source.
  *
+ * The synthetic source produces the signal selected with `setSyntheticSignal` from its beginning,
+ * at the current sampling rate, through the same capture path as the I2S sources.
+ *
  * @param audioSource Audio source to set up.
  */
 void setupAudioSource(AudioSource audioSource);
 
+/**
+ * @brief Sets the capture configuration used by `setupAudioSource` and `readAudioDataToBuffer`.
+ *
+ * Values out of range are clamped. DMA configuration takes effect the next time an audio source
+ * is set up, read chunk takes effect immediately.
+ *
+ * @param config Capture configuration to use.
+ */
+void setAudioCaptureConfig(AudioCaptureConfig config);
+
+/**
+ * @brief Returns the capture configuration in use, after clamping.
+ */
+AudioCaptureConfig getAudioCaptureConfig();
+
+/**
+ * @brief Returns estimated time (`micros()`) at which DMA completed the newest sample of the last read.
+ *
+ * Whenever `readAudioDataToBuffer` has to wait for DMA, the newest sample was completed just before
+ * the read returned. Otherwise samples were waiting in the DMA queue, and their completion time is
+ * extrapolated from the last read that waited, using the number of samples consumed since then.
+ */
+unsigned long getAudioCaptureTimestamp();
+
 /**
  * @brief Tears down audio source, releasing any resources.
  *
@@ -58,8 +177,14 @@ void teardownAudioSource();
 /**
  * @brief Reads audio data from the currently initialized audio source into an internal buffer.
  *
- * This function captures a batch of audio samples from the active audio source, writes it to internal
- * buffer and processes captured data by subtracting average to remove DC offset.
+ * With the FFT engine, this function captures a batch of `readChunk` samples from the active
+ * audio source and appends it to the last `AUDIO_N_SAMPLES` samples in the internal buffer.
+ * Average of the buffer is updated from the samples that enter and leave it, and is subtracted
+ * later, when samples are windowed into the FFT input, to remove DC offset.
+ *
+ * With the filterbank engine, this function waits for a single DMA buffer and then takes all other
+ * buffers that are already complete, without waiting. DC offset is not removed, since it is
+ * rejected by the band-pass filters.
  *
  * @note Ensure that the correct audio source is initialized before calling this function.
  */
@@ -68,9 +193,128 @@ void readAudioDataToBuffer();
 /**
  * @brief Configures the audio processing environment, including frequency thresholds and FFT initialization.
  *
- * @note This function must be called before any audio data processing can occur.
+ * Audio buffers are allocated from the static arena and live for the rest of the program.
+ * With calibration, processing time of every candidate FFT size is measured on the actual hardware
+ * (in mono) and cached for `getAudioFftCost`. Calibration takes a few tens of milliseconds.
+ *
+ * @param calibrate `true` to measure processing time of candidate FFT sizes.
+ *
+ * @note This function must be called before any audio data is read or processed, and only once.
+ */
+void setupAudioProcessing(bool calibrate);
+
+/**
+ * @brief Sets the sampling rate of the audio source and regenerates band edges, bin ranges and filters.
+ *
+ * At lower rates the FFT of the same size has finer bins (better bass resolution) and DMA moves
+ * less data. Capture read chunk is scaled to keep the frame rate. Audio history is cleared.
+ * Noise and calibration tables are measured at `AUDIO_SAMPLING_RATE`, at other rates `setupAudioTables`
+ * derives them from the measured ones.
+ * The rate takes effect for capture when the audio source is set up again.
+ *
+ * @param rate One of 22050, 32000, 44100 or 48000 Hz, other values are rounded to the nearest one.
+ *
+ * @note Audio processing has to be set up with `setupAudioProcessing` first.
+ */
+void setAudioSamplingRate(int rate);
+
+/**
+ * @brief Returns the sampling rate of the audio source in Hz.
+ */
+int getAudioSamplingRate();
+
+/**
+ * @brief Sets the number of most recent samples analyzed by the FFT engine.
+ *
+ * Smaller sizes trade frequency resolution for processing time. Bands are compensated for the
+ * size, but noise and calibration tables are measured with `AUDIO_N_SAMPLES`.
+ * Capture read chunk is lowered to the size if needed.
+ *
+ * @param fftSize Power of two from `AUDIO_FFT_MIN_SIZE` to `AUDIO_N_SAMPLES`, other values are rounded down.
+ */
+void setAudioFftSize(int fftSize);
+
+/**
+ * @brief Returns the number of samples analyzed by the FFT engine.
  */
-void setupAudioProcessing();
+int getAudioFftSize();
+
+/**
+ * @brief Sets the number of bands produced by `processAudioData` and regenerates band edges, bin ranges and filters.
+ *
+ * Edges of every count lie on the same scale, so each band spans exactly two bands of the next larger
+ * count, and the lowest `AUDIO_BASS_N_BANDS * count / AUDIO_N_BANDS` bands cover the same frequencies
+ * with the bass path. Work done per band (grouping, filterbank filters, corrections and scaling)
+ * shrinks with the count, FFTs don't. Noise and calibration tables are measured with `AUDIO_N_BANDS`,
+ * for other counts `setupAudioTables` derives them from the measured ones. Filterbank state is reset.
+ *
+ * @param count Power of two from `AUDIO_MIN_BANDS` to `AUDIO_MAX_BANDS`, other values are rounded down.
+ *
+ * @note Audio processing has to be set up with `setupAudioProcessing` first.
+ */
+void setAudioBandCount(int count);
+
+/**
+ * @brief Returns the number of bands produced by `processAudioData`.
+ */
+int getAudioBandCount();
+
+/**
+ * @brief Selects how the stereo input is analyzed by the FFT engine. Audio history is cleared.
+ *
+ * @param mode Channel mode to use.
+ *
+ * @note Audio processing has to be set up with `setupAudioProcessing` first.
+ */
+void setAudioChannelMode(AudioChannelMode mode);
+
+/**
+ * @brief Returns the channel mode used by the FFT engine.
+ */
+AudioChannelMode getAudioChannelMode();
+
+/**
+ * @brief Returns the processing time of a frame with the FFT engine, measured by `setupAudioProcessing`.
+ *
+ * @param fftSize One of the candidate FFT sizes.
+ *
+ * @return Time in microseconds, or 0 if the size was not measured.
+ */
+unsigned long getAudioFftCost(int fftSize);
+
+/**
+ * @brief Copies the costs measured by `setupAudioProcessing`.
+ *
+ * @param calibration Pointer where the costs will be stored.
+ */
+void getAudioCalibration(AudioCalibration *calibration);
+
+/**
+ * @brief Replaces the measured costs, e.g. with ones cached from an earlier boot, so that calibration can be skipped.
+ *
+ * @param calibration Costs to use.
+ */
+void setAudioCalibration(const AudioCalibration *calibration);
+
+/**
+ * @brief Selects the band analysis engine used by `readAudioDataToBuffer` and `processAudioData`.
+ *
+ * Internal state of the filterbank is reset. Audio tables depend on the engine, so they should be
+ * configured again with `setupAudioTables` after changing the engine.
+ *
+ * @param audioEngine Audio engine to use.
+ */
+void setAudioEngine(AudioEngine audioEngine);
+
+/**
+ * @brief Returns the currently selected band analysis engine.
+ */
+AudioEngine getAudioEngine();
+
+/**
+ * @brief Returns number of new samples (per channel) captured by the last call to `readAudioDataToBuffer`.
+ */
+int getAudioBufferLength();
 
 /**
  * @brief Configures noise table for the specified audio source.
@@ -96,31 +340,68 @@ void setupAudioTables(AudioSource audioSource);
 /**
  * @brief Resets band scale for the specified audio source.
  *
+ * The synthetic source starts from the scale of the line in, its signals are at line level.
+ *
  * @param audioSource The audio source for which to reset the band scale.
  */
 void resetAudioBandScale(AudioSource audioSource);
 
+/**
+ * @brief Sets the band scale, e.g. to one adapted before with the same source and configuration.
+ *
+ * @param scale Band scale, values that are not positive are ignored.
+ */
+void setAudioBandScale(float scale);
+
+/**
+ * @brief Returns the band scale, as adapted by `scaleAudioData`.
+ */
+float getAudioBandScale();
+
 /**
  * @brief Processes the audio data to produce calibrated frequency band power levels.
  *
- * @param bands Pointer to an array where the result will be stored.
+ * With the filterbank engine, captured samples are filtered by band-pass biquads and bands are set
+ * to RMS envelopes of the filter outputs, scaled to roughly match magnitudes produced by the FFT engine.
+ *
+ * With the FFT engine, the lowest bands (`AUDIO_BASS_N_BANDS` of `AUDIO_N_BANDS`) are computed from a second FFT over a signal decimated by
+ * `AUDIO_BASS_DECIMATION`, which covers proportionally longer history and gives proportionally
+ * finer frequency resolution. The remaining bands are computed from the full rate FFT.
+ * In stereo modes (see `AudioChannelMode`), channels are analyzed together and folded into halves of the bands.
  *
- * @note The function operates on the internal `audioBuffer` and `fftBuffer` variables.
+ * While the silence gate is closed (see `isAudioSilent`), bands are zeroed and nothing else is done.
+ * Skipped frames and the time they saved are reported with `addStatsSilenceFrame`.
+ *
+ * @param bands Pointer to an array of `AUDIO_MAX_BANDS` values, the first `getAudioBandCount` of them are set.
+ *
+ * @note The function operates on the internal `audioBuffer`, `bassBuffer` and `fftBuffer` buffers.
  *       It assumes that `fftBuffer` is initialized and `audioBuffer` is filled with the latest audio data.
  * @note The `currentNoiseTable` and `currentCalibrationTable` are used to correct the power levels.
  */
 void processAudioData(float *bands);
 
+/**
+ * @brief Returns `true` while the silence gate is closed.
+ *
+ * The gate is updated by `readAudioDataToBuffer` from the RMS of new samples, with hysteresis between
+ * `AUDIO_SILENCE_CLOSE_FACTOR` and `AUDIO_SILENCE_OPEN_FACTOR` times the noise floor, and closes only after
+ * `AUDIO_SILENCE_HOLD_FRAMES` quiet frames, so pauses within a song don't close it. While it is closed,
+ * `processAudioData` outputs zero bands without running the FFT. Only the FFT engine is gated.
+ */
+bool isAudioSilent();
+
 /**
  * @brief Scale bands to range from 0.0 to 1.0 after updating the internal scale.
  *
- * @param bands Pointer to an array that will be scaled.
+ * @param bands Pointer to an array that will be scaled, `getAudioBandCount` values.
  */
 void scaleAudioData(float *bands);
 
 /**
  * @brief Provides access to the internal audio buffer for debugging purposes.
  *
+ * Samples include DC offset.
+ *
  * @param buffer A pointer to a pointer that will be set to the address of the internal `audioBuffer`.
  */
 void getInternalAudioBuffer(int32_t **buffer);
@@ -0,0 +1,30 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <freertos/FreeRTOS.h>
+
+// The serial port carries text (`PRINTF`) from every task and binary packets of the mirror and the
+// flight recorder, which their scripts pick out from the text by magic bytes and checksums. Each writer
+// holds the console lock for a whole line or packet, so that nothing is written into the middle of them.
+
+/**
+ * @brief Creates the console lock. Until it is created, locking always succeeds, which is enough for
+ * tools that write from a single task.
+ */
+void setupConsole();
+
+/**
+ * @brief Takes the console lock. The lock is recursive, so a holder can keep using `PRINTF`.
+ *
+ * @param wait Ticks to wait for the lock, 0 to give up at once, e.g. in the render stage.
+ *
+ * @return `true` if the lock was taken and has to be released with `unlockConsole`.
+ */
+bool lockConsole(TickType_t wait);
+
+/**
+ * @brief Releases the console lock taken by `lockConsole`.
+ */
+void unlockConsole();
+
+#endif
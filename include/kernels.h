@@ -0,0 +1,114 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+
+// Small library of vector kernels used by audio processing. On the ESP32 kernels use optimized
+// esp-dsp functions where available. Everywhere else (and for cases esp-dsp does not cover) they
+// fall back to portable branch-free loops that compilers can auto-vectorize.
+//
+// Strides are in elements. Unless stated otherwise, input and output may be the same buffer.
+
+/**
+ * @brief Converts integer samples to floats: `out[i * strideOut] = in[i]`.
+ *
+ * @note `in` and `out` must not overlap.
+ */
+void kernelToFloat(const int32_t *in, float *out, int strideOut, int n);
+
+/**
+ * @brief Converts interleaved stereo samples to mono: `out[i] = (in[2 * i] >> shift) + (in[2 * i + 1] >> shift)`.
+ *
+ * @return Sum of the output samples, so that the mean can be tracked without another pass.
+ *
+ * @note `in` and `out` must not overlap.
+ */
+int64_t kernelDownmix(const int32_t *in, int32_t *out, int shift, int n);
+
+/**
+ * @brief Splits interleaved stereo samples into two channels, `l = in[2 * i] >> shift` and `r = in[2 * i + 1] >> shift`:
+ *        `a[i] = l`, `b[i] = r`, or with `midSide` `a[i] = l + r`, `b[i] = l - r`.
+ *
+ * @param sums Receives sums of `a` and `b`, so that their means can be tracked without another pass.
+ *
+ * @note `in` must not overlap the outputs.
+ */
+void kernelSplitStereo(const int32_t *in, int32_t *a, int32_t *b, int shift, bool midSide, int64_t *sums, int n);
+
+/**
+ * @brief Returns the sum of integer samples.
+ */
+int64_t kernelSum(const int32_t *x, int n);
+
+/**
+ * @brief Returns the sum of squares of integer samples with an offset removed: `sum((x[i] - offset)^2)`.
+ */
+float kernelSumSquares(const int32_t *x, float offset, int n);
+
+/**
+ * @brief Converts integer samples to windowed complex values:
+ *        `out[2 * i] = (in[i] - offset) * w[i * strideW]`, `out[2 * i + 1] = 0`.
+ *
+ * Conversion, DC removal and windowing in a single pass that writes FFT input directly.
+ * Negative window stride is allowed, e.g. for the second half of a symmetric window.
+ *
+ * @note `in` and `out` must not overlap.
+ */
+void kernelWindowToComplex(const int32_t *in, float offset, const float *w, int strideW, float *out, int n);
+
+/**
+ * @brief Converts two channels of integer samples to windowed complex values, one in each part:
+ *        `out[2 * i] = (re[i] - offsetRe) * w[i * strideW]`, `out[2 * i + 1] = (im[i] - offsetIm) * w[i * strideW]`.
+ *
+ * Input of an FFT that transforms two real signals at once, see `kernelSeparateMagnitudes`.
+ *
+ * @note Inputs and `out` must not overlap.
+ */
+void kernelWindowPairToComplex(const int32_t *re, const int32_t *im, float offsetRe, float offsetIm, const float *w, int strideW, float *out, int n);
+
+/**
+ * @brief Element-wise multiplication: `out[i * strideOut] = a[i * strideA] * b[i * strideB]`.
+ *
+ * Negative strides are allowed, e.g. to apply a symmetric window stored as a half.
+ */
+void kernelMultiply(const float *a, int strideA, const float *b, int strideB, float *out, int strideOut, int n);
+
+/**
+ * @brief Element-wise subtraction: `out[i] = a[i] - b[i]`.
+ */
+void kernelSubtract(const float *a, const float *b, float *out, int n);
+
+/**
+ * @brief Multiplication by a constant: `out[i] = in[i] * c`.
+ *
+ * To divide by a value, multiply by its reciprocal.
+ */
+void kernelScale(const float *in, float *out, float c, int n);
+
+/**
+ * @brief Clamps values in place to range from `low` to `high`.
+ */
+void kernelClamp(float *x, float low, float high, int n);
+
+/**
+ * @brief Returns the largest value, or `init` if it is larger than all values.
+ */
+float kernelMax(const float *x, float init, int n);
+
+/**
+ * @brief Computes magnitudes of interleaved complex values: `out[i] = |in[2 * i] + j * in[2 * i + 1]|`.
+ *
+ * Magnitudes can be written over the complex input (`out == in`).
+ */
+void kernelMagnitude(const float *in, float *out, int n);
+
+/**
+ * @brief Separates spectra of two real signals `a` and `b` transformed together as `a + j * b`, in place.
+ *
+ * `x` holds the `n` point complex spectrum in natural order. Since spectra of real signals are
+ * conjugate symmetric, `A[k] = (X[k] + conj(X[n - k])) / 2` and `B[k] = (X[k] - conj(X[n - k])) / 2j`.
+ * Magnitudes `|A[k]|` and `|B[k]|` are written to `x[2 * k]` and `x[2 * k + 1]` for `k < n / 2`.
+ */
+void kernelSeparateMagnitudes(float *x, int n);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// Latency accounting configuration
+#define LATENCY_N_FRAMES 256 // Number of most recent frames used for percentiles
+
+/**
+ * @brief Enum-like definition of frame stages, in the order they happen.
+ */
+typedef int LatencyStage;
+#define LATENCY_STAGE_CAPTURE  0 // Samples were read from DMA
+#define LATENCY_STAGE_ANALYSIS 1 // Bands were computed and scaled
+#define LATENCY_STAGE_RENDER   2 // Visualization was updated
+#define LATENCY_STAGE_SHOW     3 // LEDs were updated
+#define LATENCY_N_STAGES       4
+
+/**
+ * @brief Starts latency accounting for a new frame.
+ *
+ * Latency accounting is not thread safe, all functions should be called from the same task.
+ *
+ * All stages of the frame are measured relative to `dmaCompleteTime`.
+ *
+ * @param dmaCompleteTime Time (`micros()`) at which DMA completed the newest sample of the frame.
+ */
+void beginLatencyFrame(unsigned long dmaCompleteTime);
+
+/**
+ * @brief Records the time at which the specified stage of the current frame completed.
+ *
+ * @param stage Stage that has just completed.
+ */
+void markLatencyStage(LatencyStage stage);
+
+/**
+ * @brief Records the time at which the specified stage of the current frame completed.
+ *
+ * Used for stages that ran in another task, before the frame was handed over.
+ *
+ * @param stage Stage that has completed.
+ * @param time Time (`micros()`) at which the stage completed.
+ */
+void markLatencyStageAt(LatencyStage stage, unsigned long time);
+
+/**
+ * @brief Finishes latency accounting for the current frame and stores it in the history.
+ */
+void endLatencyFrame();
+
+/**
+ * @brief Prints 50th, 95th and 99th percentile and maximum latency of each stage over recent frames.
+ */
+void printLatencyReport();
+
+#endif
@@ -2,7 +2,15 @@
 #define MACROS_H
 
 #ifdef DEBUG
-#define PRINTF(...) Serial.printf(__VA_ARGS__)
+#include "console.h"
+
+// Lines are written under the console lock, so that they don't split binary packets (see `console.h`)
+#define PRINTF(...)                 \
+    do {                            \
+        lockConsole(portMAX_DELAY); \
+        Serial.printf(__VA_ARGS__); \
+        unlockConsole();            \
+    } while (0)
 #else
 #define PRINTF(...)
 #endif
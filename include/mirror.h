@@ -0,0 +1,58 @@
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <cstdint>
+
+// Serial mirror configuration. Frames share the serial port with text and recorder dumps under the
+// console lock (see `console.h`). At 115200 baud the port carries about 11.5 KB/s, a few hundred bytes per
+// frame at 43 fps, so busy frames are skipped and a keyframe (about 2 KB with every LED lit) takes
+// about 180 ms to drain, skipping the frames behind it.
+// Streaming every frame needs 921600 baud (delta frames up to `MIRROR_MAX_BYTES_PER_FRAME` at the default
+// frame rate), set in `Serial.begin` and passed to `scripts/mirror.py` with `--rate`.
+#define MIRROR_TX_BUFFER_SIZE      4096 // Serial transmit buffer, frames are only queued if they fit, must hold a full keyframe
+#define MIRROR_MAX_BYTES_PER_FRAME 1024 // Larger delta frames are skipped, keyframes always fit and are retried until sent
+#define MIRROR_KEYFRAME_INTERVAL   64   // Frames between keyframes, so that the host can resync
+
+/**
+ * @brief Enables or disables streaming of frames to the serial port.
+ *
+ * Enabling the mirror schedules a keyframe.
+ *
+ * @param enabled `true` to start streaming, `false` to stop.
+ */
+void setMirrorEnabled(bool enabled);
+
+/**
+ * @brief Returns `true` if the mirror is enabled.
+ */
+bool isMirrorEnabled();
+
+/**
+ * @brief Encodes a visualization frame and queues it for sending over the serial port.
+ *
+ * Color and brightness planes are delta encoded against the last frame that was sent and zero runs
+ * are run-length encoded. Palette is only sent when it changes. The frame is skipped, without
+ * blocking, if it doesn't fit in the serial transmit buffer or, unless it is a keyframe, in
+ * `MIRROR_MAX_BYTES_PER_FRAME`, or if another task holds the console lock. Keyframes encode every LED
+ * that isn't zero, so they are sized for whole planes.
+ * `scripts/mirror.py` decodes and renders the stream.
+ *
+ * Packet format:
+ *   0xA5 0x5A | flags (1) | payload length (2, little endian) | payload | xor of payload bytes (1)
+ * Flags: bit 0 - keyframe (references are reset to zero), bit 1 - palette present,
+ *        bit 2 - brightness plane present (otherwise all LEDs have full brightness).
+ * Payload: [palette: 16 RGB entries] color plane [brightness plane]
+ * Plane: repeated (unchanged count (1), changed count (1), changed values) until all LEDs are covered.
+ *
+ * @param color Palette index of each LED, in the layout of visualization buffers.
+ * @param brightness Brightness of each LED, or `NULL` for full brightness.
+ * @param palette 16 palette entries, 3 bytes (RGB) each.
+ */
+void sendMirrorFrame(const uint8_t *color, const uint8_t *brightness, const uint8_t *palette);
+
+/**
+ * @brief Prints sent and skipped frames, average bytes per frame and encoding time since the last report.
+ */
+void printMirrorReport();
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <cstdint>
+
+// Particle configuration
+#define PARTICLE_FIXED_SHIFT 8 // Positions and velocities are fixed point with this many fractional bits
+#define PARTICLE_SIZE        6 // Bytes per particle across all arrays of the pool
+
+/**
+ * @brief Fixed-capacity pool of particles, stored as a structure of arrays.
+ *
+ * Live particles are packed at the start of the arrays. Spawning appends after the last live particle
+ * and killing moves the last live particle into the freed place, so both are O(1) and updates walk
+ * contiguous memory. Particles move along a column, from row 0 upwards.
+ */
+typedef struct {
+    uint16_t *y;   // Row, fixed point
+    int16_t *vy;   // Rows per frame, fixed point
+    uint8_t *x;    // Column
+    uint8_t *life; // Remaining life, also the color index the particle is drawn with
+    int count;     // Number of live particles
+    int capacity;
+} ParticlePool;
+
+/**
+ * @brief Allocates arrays of the pool from the static arena.
+ *
+ * @param pool Pool to set up, it starts empty.
+ * @param capacity Maximum number of live particles.
+ * @param tag Name of the allocations, used in the arena report.
+ */
+void setupParticlePool(ParticlePool *pool, int capacity, const char *tag);
+
+/**
+ * @brief Kills all particles.
+ */
+void clearParticles(ParticlePool *pool);
+
+/**
+ * @brief Adds a particle to the pool.
+ *
+ * @param pool Pool set up with `setupParticlePool`.
+ * @param x Column.
+ * @param y Row, fixed point.
+ * @param vy Rows per frame, fixed point.
+ * @param life Initial life, from 1 to 255.
+ *
+ * @return `false` if the pool is full and the particle was dropped, `true` otherwise.
+ */
+bool spawnParticle(ParticlePool *pool, uint8_t x, uint16_t y, int16_t vy, uint8_t life);
+
+/**
+ * @brief Removes the particle at the specified index, the last particle takes its place.
+ */
+void killParticle(ParticlePool *pool, int index);
+
+/**
+ * @brief Advances all particles by one frame.
+ *
+ * Velocity is lowered by `gravity` and life by `decay`. Particles that run out of life or leave
+ * rows from 0 to `nRows - 1` are killed.
+ *
+ * @param pool Pool set up with `setupParticlePool`.
+ * @param gravity Change of velocity per frame, fixed point.
+ * @param decay Change of life per frame.
+ * @param nRows Number of rows.
+ */
+void stepParticles(ParticlePool *pool, int16_t gravity, uint8_t decay, int nRows);
+
+/**
+ * @brief Draws live particles into a column-major buffer of color indexes.
+ *
+ * Each particle sets its pixel to its life, unless the pixel is already brighter.
+ *
+ * @param pool Pool set up with `setupParticlePool`.
+ * @param color Buffer of `nCols * nRows` color indexes.
+ * @param nRows Number of rows.
+ */
+void drawParticles(const ParticlePool *pool, uint8_t *color, int nRows);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "audio.h"
+#include "tempo.h"
+
+/**
+ * @brief Band vector handed over from the analysis stage to the render stage.
+ */
+typedef struct {
+    float bands[AUDIO_MAX_BANDS];
+    int nBands;                 // Number of valid values in `bands`
+    unsigned long captureTime;  // Estimated DMA completion time of the newest sample (`micros()`)
+    unsigned long readTime;     // Time at which samples were read from DMA (`micros()`)
+    unsigned long analysisTime; // Time at which bands were ready (`micros()`)
+    unsigned long period;       // Duration of the new samples in microseconds, the time until the next frame
+    bool silent;                // Silence gate was closed, bands are zero
+    float bandScale;            // Band scale after this frame (see `getAudioBandScale`)
+    TempoEstimate tempo;        // Tempo and beat phase after this frame
+    uint32_t sequence;          // Incremented for every published frame
+} BandFrame;
+
+/**
+ * @brief Enum-like definition of pipeline stages, each running in its own task.
+ */
+typedef int PipelineStage;
+#define PIPELINE_STAGE_ANALYSIS 0 // Capture conditioning, FFT and banding
+#define PIPELINE_STAGE_RENDER   1 // Visualization update and show
+#define PIPELINE_N_STAGES       2
+
+/**
+ * @brief Publishes a new band frame. Never blocks.
+ *
+ * The sequence number of the frame is set by this function. If the previous frame was not acquired
+ * yet, it is replaced and counted as dropped.
+ *
+ * @param frame Frame to publish, copied into the exchange.
+ *
+ * @note Only one task can publish frames.
+ */
+void publishBandFrame(BandFrame *frame);
+
+/**
+ * @brief Acquires the most recently published band frame, if it was not acquired before. Never blocks.
+ *
+ * @param frame Pointer where the frame will be copied.
+ *
+ * @return `true` if a new frame was copied, `false` if there is no new frame since the last call.
+ *
+ * @note Only one task can acquire frames.
+ */
+bool acquireBandFrame(BandFrame *frame);
+
+/**
+ * @brief Adds time a stage spent working (not waiting for input) to its utilization.
+ *
+ * @param stage Stage that was working.
+ * @param busyTime Time in microseconds.
+ */
+void addPipelineBusyTime(PipelineStage stage, unsigned long busyTime);
+
+/**
+ * @brief Prints utilization of each stage, published and dropped frames since the last report.
+ */
+void printPipelineReport();
+
+#endif
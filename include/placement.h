@@ -0,0 +1,24 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// Code that runs for every frame executes from flash through a 32 KB cache per core, shared with
+// constant data. A miss costs a flash read of the cache line, so frames that follow anything else
+// (a transition, the serial console, FreeRTOS housekeeping) run slower and less predictably.
+// With `PLACE_HOT_IN_IRAM` defined, the curated hot functions are placed in internal instruction
+// RAM and their constant tables in data RAM. It is off by default: IRAM is scarce (shared with
+// Wi-Fi, interrupt handlers and flash drivers), so code only moves there once `tools/placement.cpp`
+// shows that its stage gains from it. The post-build memory report prints IRAM usage.
+//
+// Library code (esp-dsp FFT, FastLED palette lookup and show) stays in flash, the Arduino build uses
+// prebuilt ESP-IDF libraries and has no linker fragments to move it.
+
+#if defined(PLACE_HOT_IN_IRAM) && defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define HOT_CODE IRAM_ATTR // Function runs from internal RAM
+#define HOT_DATA DRAM_ATTR // Constant table is read from internal RAM
+#else
+#define HOT_CODE
+#define HOT_DATA
+#endif
+
+#endif
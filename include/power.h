@@ -0,0 +1,75 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include "pipeline.h"
+
+// Power management configuration
+#define POWER_MAX_MHZ      240  // Frequency of heavy frames, render and FFT costs are calibrated at it
+#define POWER_MIN_MHZ      80   // Lowest frequency that keeps APB clock (I2S, RMT, UART) at 80 MHz
+#define POWER_TARGET_LOAD  0.6  // Frequency is lowered while the load at the lower one would stay below this
+#define POWER_BOOST_LOAD   0.85 // Frequency goes back to the maximum as soon as the load exceeds this
+#define POWER_HOLD_FRAMES  64   // Frames with headroom in a row before the frequency is lowered by a step
+#define POWER_BOOST_FRAMES 32   // Frames kept at the maximum frequency after `boostPower`
+
+/**
+ * @brief Sets up power management at the maximum frequency.
+ *
+ * With power management in ESP-IDF (`CONFIG_PM_ENABLE`), the governor sets the maximum frequency of
+ * dynamic frequency scaling, pipeline stages hold a lock on it only while they work and the CPU
+ * drops to `POWER_MIN_MHZ` (or light sleep, if tickless idle is enabled and no driver prevents it)
+ * while they wait. Otherwise, e.g. with the prebuilt Arduino core, the governor switches CPU clock directly.
+ */
+void setupPower();
+
+/**
+ * @brief Enables or disables frequency scaling. When disabled, the CPU stays at `POWER_MAX_MHZ`.
+ */
+void setPowerScalingEnabled(bool enabled);
+
+/**
+ * @brief Marks the start of work of a pipeline stage, after it stopped waiting for input.
+ *
+ * Holds the CPU at the frequency selected by the governor until `endPowerWork`. Safe to call from any task.
+ *
+ * @param stage Stage that starts working.
+ */
+void beginPowerWork(PipelineStage stage);
+
+/**
+ * @brief Marks the end of work of a pipeline stage, before it waits for input.
+ *
+ * @param stage Stage that stops working.
+ */
+void endPowerWork(PipelineStage stage);
+
+/**
+ * @brief Selects the frequency for the next frames from the load of the last frame.
+ *
+ * Load is the busy time of the busiest stage over the frame period, measured at the current frequency.
+ * The frequency is lowered by a step after `POWER_HOLD_FRAMES` frames in a row that would stay below
+ * `POWER_TARGET_LOAD` at the lower frequency. It goes back to `POWER_MAX_MHZ` right after a frame above
+ * `POWER_BOOST_LOAD` or a frame that missed its deadline.
+ *
+ * @param period Frame period in microseconds.
+ * @param busyTime Busy time of the busiest stage in the frame, in microseconds.
+ * @param missed `true` if the frame was shown after its deadline.
+ *
+ * @note Should be called from a single task, once per frame.
+ */
+void updatePowerGovernor(unsigned long period, unsigned long busyTime, bool missed);
+
+/**
+ * @brief Raises the frequency to `POWER_MAX_MHZ` ahead of known heavy frames, e.g. transitions.
+ *
+ * Frequency is kept for `POWER_BOOST_FRAMES` frames.
+ *
+ * @note Should be called from the task that calls `updatePowerGovernor`.
+ */
+void boostPower();
+
+/**
+ * @brief Prints average CPU frequency, current frequency and deadline misses since the last report.
+ */
+void printPowerReport();
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+
+#include "pipeline.h"
+#include "scheduler.h"
+
+// Flight recorder configuration
+#define RECORDER_N_FRAMES            256 // Most recent frames kept, about 6s at the default hop, 1.5s at the smallest one
+#define RECORDER_N_EVENTS            64  // Most recent events kept
+#define RECORDER_POST_TRIGGER_FRAMES 64  // Frames recorded after a trigger, so that the dump shows the aftermath
+
+/**
+ * @brief Enum-like definition of events kept by the recorder, with the meaning of their value.
+ */
+typedef int RecorderEvent;
+#define RECORDER_EVENT_COMMAND          0 // Command handled by the analysis or executor task, value is the command type
+#define RECORDER_EVENT_AUDIO_SOURCE     1 // Audio source was set up, value is the source
+#define RECORDER_EVENT_VISUALIZATION    2 // Transition to another visualization started, value is the type
+#define RECORDER_EVENT_CAPTURE_OVERFLOW 3 // I2S driver overwrote DMA buffers that were not read, value is the count
+#define RECORDER_EVENT_SETTINGS_WRITE   4 // Settings were written to NVS, stalling both cores, value is the duration in microseconds
+#define RECORDER_EVENT_TRIGGER          5 // Frame time went over the trigger threshold, value is the frame time in microseconds
+#define RECORDER_EVENT_MAX_VALUE        5
+
+/**
+ * @brief Records a frame handled by the render stage: timings of both stages, bands and band scale.
+ *
+ * Bands are quantized to 8 bits. Writing is lock-free, a frame costs a few microseconds.
+ * If the frame took longer than the trigger threshold (see `setRecorderTrigger`), the recorder
+ * keeps `RECORDER_POST_TRIGGER_FRAMES` more frames and then stops until it is dumped.
+ *
+ * @param frame Band frame that was handled.
+ * @param action Action taken for the frame.
+ * @param rendered `false` if the frame was skipped because the visualization decayed on silence.
+ * @param missed `true` if the frame was shown after its deadline.
+ * @param renderStart Time (`micros()`) at which the render stage started the frame.
+ * @param renderEnd Time (`micros()`) at which the render stage finished the frame.
+ *
+ * @note Only one task can record frames.
+ */
+void recordFrame(const BandFrame *frame, FrameAction action, bool rendered, bool missed, unsigned long renderStart, unsigned long renderEnd);
+
+/**
+ * @brief Records an event. Lock-free and safe to call from any task.
+ *
+ * @param event Type of the event.
+ * @param value Value of the event, see `RecorderEvent`.
+ */
+void recordEvent(RecorderEvent event, int32_t value);
+
+/**
+ * @brief Sets the frame time, from reading samples to showing the frame, that triggers a dump.
+ *
+ * The trigger fires once, it has to be set again for the next dump.
+ *
+ * @param threshold Frame time in microseconds, 0 to disable the trigger.
+ */
+void setRecorderTrigger(unsigned long threshold);
+
+/**
+ * @brief Returns `true` if the trigger fired and the recorder stopped, waiting for `dumpRecorder`.
+ */
+bool isRecorderTriggered();
+
+/**
+ * @brief Writes recorded frames and events to the serial port in binary and resumes recording.
+ *
+ * Recording stops for the dump, which takes about 2s at 115200 baud, so it should be called from a
+ * low priority task. The console lock is held for the whole dump (see `console.h`), so the mirror skips
+ * frames and `PRINTF` of other tasks waits until it ends. The frame and events being written when the
+ * dump starts are left out.
+ * `scripts/recorder.py` decodes the dump into a timeline.
+ *
+ * Packet format:
+ *   0x5A 0xA5 | type (1) | payload length (2, little endian) | payload | xor of payload bytes (1)
+ * Types: 0 - header, 1 - frame, 2 - event, 3 - end. Payloads are little endian.
+ * Header: version (1), max bands (1), frames (2), events (2, incomplete ones are left out), trigger
+ *         threshold (4), dump time (4), recording time per frame in nanoseconds (4).
+ * Frame: sequence (4), capture, read, analysis, render start and render end times (4 each),
+ *        band scale (float, 4), band count (1), action (1), flags (1), blur radius (1), bands (max bands).
+ *        Flags: bit 0 - silent, bit 1 - rendered, bit 2 - missed deadline.
+ * Event: time (4), type (1), value (4, signed).
+ * End: no payload.
+ */
+void dumpRecorder();
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "pipeline.h"
+
+// Task priorities. Capture must keep up with DMA, or samples are lost, while render can give up frames.
+// Analysis and the controller share core 0, so the controller only runs while analysis waits for DMA.
+#define SCHEDULER_ANALYSIS_PRIORITY (tskIDLE_PRIORITY + 3) // Capture and analysis
+#define SCHEDULER_RENDER_PRIORITY   (tskIDLE_PRIORITY + 2) // Visualization update, show and mirror
+#define SCHEDULER_CONTROL_PRIORITY  (tskIDLE_PRIORITY + 1) // Buttons, serial console and statistics
+
+// Deadline configuration
+#define SCHEDULER_MARGIN_US      500 // Added to the predicted cost of a frame, for what calibration doesn't see
+#define SCHEDULER_MAX_DROPS      1   // Frames dropped in a row at most, so that the display never freezes
+#define SCHEDULER_DEFAULT_POLICY SCHEDULER_POLICY_SKIP_BLUR
+
+/**
+ * @brief Enum-like definition of what the render stage does with frames that would miss their deadline.
+ */
+typedef int SchedulerPolicy;
+#define SCHEDULER_POLICY_RENDER_ALL 0 // Every frame is rendered in full, late frames are only counted
+#define SCHEDULER_POLICY_SKIP_BLUR  1 // Frames that would be late are rendered without blur
+#define SCHEDULER_POLICY_DROP       2 // As above, and frames that would be late even without blur are not rendered
+#define SCHEDULER_POLICY_MAX_VALUE  2
+
+/**
+ * @brief Enum-like definition of how a frame is rendered.
+ */
+typedef int FrameAction;
+#define FRAME_ACTION_RENDER    0 // Update and show with the current settings
+#define FRAME_ACTION_SKIP_BLUR 1 // Update and show with blur disabled for this frame only
+#define FRAME_ACTION_DROP      2 // Neither update nor show, the LEDs keep the frame of the last bands
+
+/**
+ * @brief Sets the policy for frames that would miss their deadline.
+ *
+ * @param policy Policy from `SCHEDULER_POLICY_RENDER_ALL` to `SCHEDULER_POLICY_MAX_VALUE`, other values are ignored.
+ */
+void setSchedulerPolicy(SchedulerPolicy policy);
+
+/**
+ * @brief Returns the policy for frames that would miss their deadline.
+ */
+SchedulerPolicy getSchedulerPolicy();
+
+/**
+ * @brief Decides how to render a frame, so that it is shown before its deadline.
+ *
+ * The deadline of a frame is the time at which the next one is ready, `analysisTime + period`.
+ * A frame would miss it if the time left is shorter than its predicted cost plus `SCHEDULER_MARGIN_US`.
+ * Costs are measured by `calibrateVisualizations` at `POWER_MAX_MHZ`. At a lower frequency they are
+ * underestimated, but the power governor goes back to the maximum right after a missed deadline.
+ *
+ * @param frame Frame about to be rendered.
+ * @param now Current time (`micros()`).
+ * @param cost Predicted time to render and show the frame with the current settings, 0 if unknown.
+ * @param reducedCost Predicted time to render and show the frame without blur, 0 if unknown.
+ *
+ * @return Action for the frame, `FRAME_ACTION_RENDER` if it fits or its cost is unknown.
+ *
+ * @note Should be called from a single task, once per frame.
+ */
+FrameAction planFrame(const BandFrame *frame, unsigned long now, unsigned long cost, unsigned long reducedCost);
+
+/**
+ * @brief Accounts the outcome of a frame in the statistics.
+ *
+ * @param frame Frame that was planned by `planFrame`.
+ * @param action Action taken for the frame.
+ * @param endTime Time at which the frame was shown, or dropped (`micros()`).
+ *
+ * @return `true` if the frame was shown after its deadline or dropped, `false` otherwise.
+ */
+bool completeFrame(const BandFrame *frame, FrameAction action, unsigned long endTime);
+
+#endif
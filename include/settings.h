@@ -0,0 +1,121 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "audio.h"
+#include "visualization.h"
+
+// Settings are kept in NVS. Every write goes to flash, which stalls both cores for a few milliseconds
+// and wears the sectors, so changes are coalesced and written by the controller task.
+#define SETTINGS_NAMESPACE                "settings"
+#define SETTINGS_CALIBRATION_NAMESPACE    "calibration" // Measured costs, dropped when the build changes
+#define SETTINGS_VERSION                  1             // Stored settings of another version are ignored
+#define SETTINGS_WRITE_DELAY_MS           3000          // Changes are written once none came for this long, e.g. after cycling through palettes
+#define SETTINGS_BAND_SCALE_INTERVAL_MS   60000         // Band scale is written at most this often...
+#define SETTINGS_BAND_SCALE_CHANGE_FACTOR 1.25          // ...and only when it changed by more than this factor since the last write
+
+/**
+ * @brief Settings restored after a power cycle.
+ *
+ * Band scale is adapted to the level of the room or the line, and depends on the band count. It is
+ * kept for every hardware source, with the band count it was adapted at.
+ */
+typedef struct {
+    AudioSource audioSource; // Last hardware source, the synthetic source is not restored
+    VisualizationType visualizationType;
+    VisualizationPalette visualizationPalette;
+    float bandScales[AUDIO_SOURCE_HARDWARE_MAX_VALUE + 1];    // Adapted band scale of each source, 0 if not adapted yet
+    int bandScaleCounts[AUDIO_SOURCE_HARDWARE_MAX_VALUE + 1]; // Band count each scale was adapted at
+} Settings;
+
+/**
+ * @brief Loads stored settings and drops cached calibration of another build.
+ *
+ * Settings that were never stored, are out of range or were stored by another `SETTINGS_VERSION`
+ * are taken from the defaults.
+ *
+ * @param defaults Settings of a unit that was never configured.
+ *
+ * @note Must be called once, before the tasks start.
+ */
+void setupSettings(const Settings *defaults);
+
+/**
+ * @brief Returns the current settings, including changes that were not written yet. Safe to call from any task.
+ *
+ * @param settings Pointer where the settings will be stored.
+ */
+void getSettings(Settings *settings);
+
+/**
+ * @brief Records the audio source in use. Sources other than hardware ones are ignored.
+ *
+ * @param audioSource Audio source that was set up.
+ */
+void setSettingsAudioSource(AudioSource audioSource);
+
+/**
+ * @brief Records the visualization and palette in use.
+ *
+ * @param visualization Visualization that was set up.
+ * @param palette Palette of the visualization.
+ */
+void setSettingsVisualization(VisualizationType visualization, VisualizationPalette palette);
+
+/**
+ * @brief Records the band scale adapted for a source. Cheap enough to call on every frame.
+ *
+ * @param audioSource Audio source the scale was adapted for, other than hardware sources are ignored.
+ * @param nBands Band count the scale was adapted at.
+ * @param scale Band scale (see `getAudioBandScale`).
+ */
+void setSettingsBandScale(AudioSource audioSource, int nBands, float scale);
+
+/**
+ * @brief Writes recorded changes to NVS when they are due.
+ *
+ * Source, visualization and palette are written `SETTINGS_WRITE_DELAY_MS` after the last change.
+ * Band scale is written when it changed by more than `SETTINGS_BAND_SCALE_CHANGE_FACTOR`, at most
+ * every `SETTINGS_BAND_SCALE_INTERVAL_MS`. All settings go to a single entry, so a write is a single NVS update.
+ *
+ * @note Should be called periodically from a single task, which may be stalled by the write.
+ */
+void flushSettings();
+
+/**
+ * @brief Erases stored settings and cached calibration, defaults and calibration are used from the next boot.
+ */
+void clearSettings();
+
+/**
+ * @brief Loads audio costs cached by `saveAudioCalibration` with the same build.
+ *
+ * @param calibration Pointer where the costs will be stored.
+ *
+ * @return `true` if costs were cached, `false` if they have to be measured.
+ */
+bool loadAudioCalibration(AudioCalibration *calibration);
+
+/**
+ * @brief Caches audio costs for the following boots of the same build.
+ *
+ * @param calibration Costs measured by `setupAudioProcessing`.
+ */
+void saveAudioCalibration(const AudioCalibration *calibration);
+
+/**
+ * @brief Loads visualization costs cached by `saveVisualizationCalibration` with the same build.
+ *
+ * @param calibration Pointer where the costs will be stored.
+ *
+ * @return `true` if costs were cached, `false` if they have to be measured.
+ */
+bool loadVisualizationCalibration(VisualizationCalibration *calibration);
+
+/**
+ * @brief Caches visualization costs for the following boots of the same build.
+ *
+ * @param calibration Costs measured by `calibrateVisualizations`.
+ */
+void saveVisualizationCalibration(const VisualizationCalibration *calibration);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+// Band smoothing configuration
+#define SMOOTHING_LUT_SIZE 64 // Quantization steps of the delta (-1 to 1) between input and smoothed band
+
+/**
+ * @brief Part of an attack/release profile that applies to a range of deltas.
+ *
+ * For `delta = input - smoothed`, the next value is `max(smoothed * retain + delta * follow - release, 0)`.
+ * E.g. `follow` of 1/3 moves a third of the way towards the input, `retain` of 0.9 decays exponentially
+ * and `release` decays linearly.
+ */
+typedef struct {
+    float above; // Segment applies to deltas above this value, ignored for the last segment
+    float retain;
+    float follow;
+    float release;
+} SmoothingSegment;
+
+/**
+ * @brief Coefficients of a segment, stored in the lookup table for each quantized delta.
+ */
+typedef struct {
+    float retain;
+    float follow;
+    float release;
+} SmoothingCoefficients;
+
+/**
+ * @brief Attack/release profile of band smoothing.
+ *
+ * Segments are ordered by descending `above`, the first segment whose threshold is below the delta applies.
+ * Segments are expanded into a lookup table keyed on the quantized delta, so that smoothing doesn't
+ * branch on the delta.
+ */
+typedef struct {
+    const SmoothingSegment *segments;
+    int nSegments;
+    SmoothingCoefficients lut[SMOOTHING_LUT_SIZE]; // Filled by `setupSmoothingProfile`
+} SmoothingProfile;
+
+/**
+ * @brief Expands segments of the profile into its lookup table.
+ *
+ * Each entry takes the segment of the delta at the center of its quantization step.
+ *
+ * @param profile Profile with segments set.
+ */
+void setupSmoothingProfile(SmoothingProfile *profile);
+
+/**
+ * @brief Moves smoothed bands towards input bands according to the profile.
+ *
+ * @param profile Profile set up with `setupSmoothingProfile`.
+ * @param bands Input bands, from 0 to 1.
+ * @param smoothed Smoothed bands, updated in place.
+ * @param n Number of bands.
+ */
+void smoothBands(const SmoothingProfile *profile, const float *bands, float *smoothed, int n);
+
+#endif
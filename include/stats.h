@@ -0,0 +1,103 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "pipeline.h"
+#include "scheduler.h"
+
+// Runtime statistics configuration
+#define STATS_MAX_TASKS        4  // Tasks whose stack and CPU time are reported
+#define STATS_MAX_QUEUES       4  // Queues whose depth is reported
+#define STATS_MAX_SYSTEM_TASKS 24 // Capacity for FreeRTOS run-time stats of all tasks in the system
+#define STATS_IDLE_GAP_US      50 // Without run-time stats: longer gaps between idle hook calls mean the core ran something else
+
+/**
+ * @brief Adds a task to the report: CPU share (with FreeRTOS run-time stats) and free stack.
+ *
+ * @param task Handle of the task.
+ *
+ * @note Tasks and queues should be registered before statistics are sampled.
+ */
+void registerStatsTask(TaskHandle_t task);
+
+/**
+ * @brief Adds a queue to the report: current and highest depth seen by `sampleStats`.
+ *
+ * @param queue Handle of the queue.
+ * @param name Short name used in the report.
+ */
+void registerStatsQueue(QueueHandle_t queue, const char *name);
+
+/**
+ * @brief Accounts time spent in `i2s_read`. Safe to call from any task.
+ *
+ * @param waitTime Time in microseconds.
+ * @param blocked `true` if the read waited for DMA, `false` if samples were already available.
+ */
+void addStatsCaptureWait(unsigned long waitTime, bool blocked);
+
+/**
+ * @brief Accounts DMA buffers that the I2S driver overwrote before they were read. Safe to call from any task.
+ *
+ * @param count Number of overflow events reported by the driver.
+ */
+void addStatsCaptureOverflow(unsigned count);
+
+/**
+ * @brief Accounts a frame planned by the render stage. Safe to call from any task.
+ *
+ * @param action Action taken for the frame.
+ * @param late `true` if the frame was shown after its deadline.
+ */
+void addStatsRenderFrame(FrameAction action, bool late);
+
+/**
+ * @brief Accounts a frame skipped by a stage because of silence. Safe to call from any task.
+ *
+ * @param stage Stage that skipped the frame.
+ * @param savedTime Estimated processing time saved, in microseconds.
+ */
+void addStatsSilenceFrame(PipelineStage stage, unsigned long savedTime);
+
+/**
+ * @brief Sets how often `sampleStats` prints the report.
+ *
+ * Without FreeRTOS run-time stats, a period above 0 also starts CPU accounting, which disables idle
+ * power saving until the period is set back to 0 (see `printStatsReport`).
+ *
+ * @param period Period in milliseconds, 0 to only print on request.
+ */
+void setStatsPeriod(unsigned long period);
+
+/**
+ * @brief Samples queue depths and prints the report when the period elapsed.
+ *
+ * Cheap enough to call every few milliseconds from a low priority task.
+ */
+void sampleStats();
+
+/**
+ * @brief Prints statistics since the last report in a compact form and starts a new period.
+ *
+ * Example: `stats 5.00s cpu 41.2% 63.5% | i2s wait 77.0% 210/215 blocked 0 overflow | deadline 2/300 late 5 no blur 0 dropped | silence 0/0 saved 0.0% | stack free analysisTask 5324 ...`
+ * CPU load of each core is 100% minus the share of its idle task, overflow is the number of DMA buffers
+ * lost because capture fell behind, deadline counts rendered frames shown late out of all planned frames
+ * and frames degraded by the scheduler policy, silence is the number of analysis/render frames skipped
+ * and the time they saved as a share of one core, free stack is the lowest amount of stack in bytes
+ * that was left unused since the task started, queue depth is current/highest.
+ *
+ * Without FreeRTOS run-time stats (the prebuilt Arduino core), the idle share of each core is measured
+ * by an idle hook that accumulates time between its consecutive calls, and task CPU shares are not
+ * reported. The hooks are registered only while a stats period is set (see `setStatsPeriod`), reports
+ * requested without one have no CPU load, and neither has the first report of a period.
+ *
+ * @warning While the hooks are registered, CPU accounting disables idle power saving: idle cores spin
+ * instead of waiting for interrupts or entering light sleep, so power and frequency reports don't reflect
+ * normal operation. Setting the period back to 0 restores power saving.
+ */
+void printStatsReport();
+
+#endif
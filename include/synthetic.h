@@ -0,0 +1,59 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <cstdint>
+
+// Synthetic signal configuration
+#define SYNTHETIC_SWEEP_MIN_HZ      20    // Start of the sweep, it rises by semitones up to 0.9 of the Nyquist frequency
+#define SYNTHETIC_SWEEP_STEP_MS     50    // Time spent on each semitone, the frequency glides between them
+#define SYNTHETIC_SWEEP_MAX_STEPS   120   // Semitones in the sweep table, 10 octaves
+#define SYNTHETIC_NOISE_LENGTH      4096  // Samples in the pink noise table, played in a loop (power of two)
+#define SYNTHETIC_NOISE_SEED        12345 // Seed of the noise generator
+#define SYNTHETIC_IMPULSE_PERIOD_MS 500   // Time between impulses, 120 per minute
+#define SYNTHETIC_SHIFT             14    // 16-bit table samples are shifted into the 32-bit I2S slot, -6 dBFS at full scale
+
+/**
+ * @brief Enum-like definition of signals produced by the synthetic audio source.
+ */
+typedef int SyntheticSignal;
+#define SYNTHETIC_SIGNAL_SWEEP      0 // Sine rising from `SYNTHETIC_SWEEP_MIN_HZ`, restarts at the top
+#define SYNTHETIC_SIGNAL_PINK_NOISE 1 // Noise with equal power per octave
+#define SYNTHETIC_SIGNAL_IMPULSES   2 // Single full scale samples every `SYNTHETIC_IMPULSE_PERIOD_MS`
+#define SYNTHETIC_SIGNAL_SILENCE    3 // Digital zero
+#define SYNTHETIC_SIGNAL_MAX_VALUE  3
+
+/**
+ * @brief Precomputes the tables of all signals for a sampling rate and restarts the signal.
+ *
+ * Signals are generated from a quarter sine table and integer arithmetic only, so that the same
+ * samples are produced on the device and on any host, independently of its floating point library.
+ *
+ * @param rate Sampling rate in Hz.
+ */
+void setupSyntheticSignal(int rate);
+
+/**
+ * @brief Selects the signal produced by `generateSyntheticSamples` and restarts it from the beginning.
+ *
+ * @param signal Signal to produce, other values are ignored.
+ */
+void setSyntheticSignal(SyntheticSignal signal);
+
+/**
+ * @brief Returns the signal produced by `generateSyntheticSamples`.
+ */
+SyntheticSignal getSyntheticSignal();
+
+/**
+ * @brief Produces the next samples of the selected signal, as the I2S driver would read them.
+ *
+ * Both channels carry the same signal, in the most significant bits of interleaved 32-bit slots.
+ *
+ * @param dest Destination for `n` stereo frames (`2 * n` values).
+ * @param n Number of frames.
+ *
+ * @note `setupSyntheticSignal` has to be called first.
+ */
+void generateSyntheticSamples(int32_t *dest, int n);
+
+#endif
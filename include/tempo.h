@@ -0,0 +1,56 @@
+#ifndef TEMPO_H
+#define TEMPO_H
+
+#include <cstdint>
+
+// Tempo tracking configuration
+#define TEMPO_TICK_US        10000 // Onset strength is resampled to ticks of this length, independent of the frame rate
+#define TEMPO_HISTORY        128   // Onset ticks kept in the ring buffer (power of two, above the longest beat period)
+#define TEMPO_MIN_BPM        60    // Slowest tempo considered
+#define TEMPO_MAX_BPM        180   // Fastest tempo considered
+#define TEMPO_PRIOR_BPM      120.0 // Center of the log-normal tempo prior, which resolves octave errors...
+#define TEMPO_PRIOR_OCTAVES  0.7   // ...and its standard deviation in octaves
+#define TEMPO_WINDOW_S       6.0   // Time constant of autocorrelation scores in seconds
+#define TEMPO_MEAN_S         1.0   // Time constant of the onset mean removed before autocorrelation
+#define TEMPO_COMPRESSION    100.0 // Bands are compressed with log(1 + x * this) before onset detection
+#define TEMPO_SWITCH_RATIO   1.05  // Another beat period must score this much more than the current one to replace it
+#define TEMPO_OCTAVE_RATIO   0.75  // Half of the best beat period replaces it if it scores at least this share, without the prior
+#define TEMPO_PHASE_GAIN     0.05  // Phase correction per tick by an onset of unit RMS, per beat of phase error
+#define TEMPO_MIN_CONFIDENCE 0.15  // Below this, tempo should be treated as unknown
+
+/**
+ * @brief Tempo and beat phase after the last frame.
+ */
+typedef struct {
+    float bpm;        // Estimated tempo in beats per minute
+    float phase;      // Position within the current beat, from 0 (on the beat) to 1
+    uint32_t beats;   // Beats counted since `setupTempo`, `beats + phase` is a continuous beat clock
+    float confidence; // Normalized autocorrelation at the beat period, from 0 to 1
+    bool beat;        // A beat started during the last frame
+} TempoEstimate;
+
+/**
+ * @brief Resets the tracker and precomputes the tempo prior.
+ */
+void setupTempo();
+
+/**
+ * @brief Updates the tempo and beat phase with the bands of a new frame.
+ *
+ * Onset strength is the spectral flux of compressed bands (sum of their rises). It is spread over the
+ * duration of the frame and accumulated into ticks of `TEMPO_TICK_US`, so that lags don't depend on
+ * the frame rate. For every tick the autocorrelation of onset strength at each beat period from
+ * `TEMPO_MAX_BPM` to `TEMPO_MIN_BPM` is updated incrementally (exponentially decayed sums, one
+ * multiplication per period), instead of being recomputed over the whole history.
+ * The best period, weighted by the tempo prior, drives a phase oscillator that onsets pull towards the beat.
+ *
+ * @param bands Bands of the frame, scaled from 0 to 1.
+ * @param nBands Number of bands, onsets are not detected in the frame in which it changes.
+ * @param period Duration of the frame in microseconds.
+ * @param estimate Pointer where the estimate after the frame will be stored.
+ *
+ * @note Cost grows with the number of ticks in the frame, about a hundred multiplications per tick.
+ */
+void updateTempo(const float *bands, int nBands, unsigned long period, TempoEstimate *estimate);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include "audio.h"
+#include "visualization.h"
+
+// Auto-tuning configuration. The target is the frame rate of a full FFT hop at the default sampling rate
+// (about 43 fps), which decay, smoothing and band scale adaptation are tuned for, as they work per frame.
+#define TUNING_TARGET_FPS      ((float)AUDIO_SAMPLING_RATE / AUDIO_N_SAMPLES) // Frame rate the configuration has to sustain
+#define TUNING_BUDGET_FRACTION 0.8 // Share of the frame period analysis or rendering may take, the rest is headroom
+
+/**
+ * @brief Analysis and render settings chosen for a visualization.
+ */
+typedef struct {
+    int fftSize;    // Samples analyzed by the FFT engine
+    int hop;        // New samples per frame (capture read chunk)
+    int blurRadius; // Radius of the Gaussian blur used by effects
+    int nBands;     // Bands computed by the analysis, as the visualization asks
+} TuningChoice;
+
+/**
+ * @brief Picks the highest resolution configuration that still meets `TUNING_TARGET_FPS`.
+ *
+ * Uses costs measured by `setupAudioProcessing` and `calibrateVisualizations`, so it is cheap enough
+ * to run on every change of visualization. Analysis and rendering run on different cores, so each is
+ * checked against the frame period separately: the largest FFT size and blur radius that fit are chosen.
+ * Sizes and radii that were not measured are assumed to fit. FFT costs are measured with `AUDIO_N_BANDS`
+ * bands, fewer bands only make the analysis cheaper. The choice is printed.
+ *
+ * @param visualization The type of visualization that will be rendered.
+ *
+ * @return Chosen configuration, to be applied by the tasks owning audio and visualization.
+ */
+TuningChoice selectTuning(VisualizationType visualization);
+
+#endif
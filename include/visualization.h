@@ -1,6 +1,10 @@
 #ifndef VISUALIZATION_H
 #define VISUALIZATION_H
 
+#include <cstdint>
+
+#include "tempo.h"
+
 // LED matrix configuration
 #define LED_MATRIX_DATA_PIN_A     26 // 1st 8 columns
 #define LED_MATRIX_DATA_PIN_B     25 // 2nd 8 columns
@@ -11,18 +15,43 @@
 #define LED_MATRIX_N              (LED_MATRIX_N_BANDS * LED_MATRIX_N_PER_BAND)
 #define LED_MATRIX_N_PER_DATA_PIN (LED_MATRIX_N / 4)
 
+// Memory allocated from the static arena by `setupLedStrip`: LED array (3 bytes per LED), two slots
+// for working memory of visualizations (incoming and outgoing during a transition) and the particle pool
+// of particle effects. Working memory of every visualization is checked against the slot size at build time.
+#define VISUALIZATION_MAX_STATE_SIZE (3 * LED_MATRIX_N + 256)
+#define VISUALIZATION_MAX_PARTICLES  2048 // Capacity of the particle pool, spawns are dropped when it is full
+#define VISUALIZATION_ARENA_SIZE     (3 * LED_MATRIX_N + 2 * VISUALIZATION_MAX_STATE_SIZE + 6 * VISUALIZATION_MAX_PARTICLES)
+
+#define VISUALIZATION_TRANSITION_FRAMES    16 // Length of crossfade between visualizations or palettes
+#define VISUALIZATION_MAX_BLUR_RADIUS      2  // Radius of the Gaussian blur used by effects, lowered if rendering is too slow
+#define VISUALIZATION_N_CALIBRATION_FRAMES 16 // Frames averaged when measuring render cost
+#define VISUALIZATION_DECAY_FRAMES         64 // Frames rendered on silence before the display is considered settled
+
 /**
  * @brief Enum-like definition for selecting visualization type.
+ *
+ * Values are indexes into the registry of visualizations in `visualization.cpp`.
  */
 typedef int VisualizationType;
 #define VISUALIZATION_TYPE_NONE      -1
 #define VISUALIZATION_TYPE_BARS      0
 #define VISUALIZATION_TYPE_SPECTRUM  1
 #define VISUALIZATION_TYPE_FIRE      2
-#define VISUALIZATION_TYPE_MAX_VALUE 2
+#define VISUALIZATION_TYPE_SPARKS    3
+#define VISUALIZATION_TYPE_MAX_VALUE 3
+
+/**
+ * @brief Render costs measured by `calibrateVisualizations`, which can be cached across boots of the same build.
+ */
+typedef struct {
+    unsigned long renderCosts[VISUALIZATION_TYPE_MAX_VALUE + 1][VISUALIZATION_MAX_BLUR_RADIUS + 1]; // Update and palette lookup, 0 if not measured
+    unsigned long showCost;                                                                          // Sending a frame to the LEDs
+} VisualizationCalibration;
 
 /**
  * @brief Enum-like definition for selecting visualization color palette.
+ *
+ * Values are indexes into the palettes of the active visualization.
  */
 typedef int VisualizationPalette;
 #define VISUALIZATION_PALETTE_NONE -1
@@ -43,19 +72,59 @@ typedef int VisualizationPalette;
 #define VISUALIZATION_PALETTE_FIRE_GREEN     2
 #define VISUALIZATION_PALETTE_FIRE_MAX_VALUE 2
 
+#define VISUALIZATION_PALETTE_SPARKS_EMBER     0
+#define VISUALIZATION_PALETTE_SPARKS_ICE       1
+#define VISUALIZATION_PALETTE_SPARKS_PINK      2
+#define VISUALIZATION_PALETTE_SPARKS_MAX_VALUE 2
+
 /**
  * @brief Initializes the LED strip and prepares it for use.
  *
- * This function configures the LED strip by associating the `leds` array with the FastLED library.
+ * This function allocates the `leds` array, visualization state slots and the particle pool from the static
+ * arena, and associates the `leds` array with the FastLED library. Nothing is allocated afterwards.
  *
  * @note This function must be called before any other LED control functions.
  */
 void setupLedStrip();
 
+/**
+ * @brief Returns number of visualizations in the registry.
+ */
+int getVisualizationCount();
+
+/**
+ * @brief Returns number of palettes available for the specified visualization.
+ *
+ * @param visualization The type of visualization.
+ *
+ * @return Number of palettes, or 0 for unknown visualization.
+ */
+int getVisualizationPaletteCount(VisualizationType visualization);
+
+/**
+ * @brief Returns name of the specified visualization.
+ *
+ * @param visualization The type of visualization.
+ */
+const char *getVisualizationName(VisualizationType visualization);
+
+/**
+ * @brief Returns the number of bands the specified visualization wants from the analysis.
+ *
+ * All effects ask for a band per column. An effect could ask for fewer, which are cheaper to compute,
+ * at the cost of its horizontal resolution.
+ *
+ * @param visualization The type of visualization.
+ *
+ * @return Number of bands, or `LED_MATRIX_N_BANDS` for unknown visualization.
+ */
+int getVisualizationBandCount(VisualizationType visualization);
+
 /**
  * @brief Initializes the specified LED visualization.
  *
  * This function sets up the LED visualization. It ensures that only one visualization is active.
+ * Working memory of the visualization is taken from one of the slots allocated by `setupLedStrip`.
  *
  * @param visualization The type of visualization to be set up.
  *
@@ -63,11 +132,30 @@ void setupLedStrip();
  */
 void setupVisualization(VisualizationType visualization);
 
+/**
+ * @brief Switches the active LED visualization to the specified one with a crossfade.
+ *
+ * The outgoing visualization keeps being updated and is blended with the incoming one for
+ * `VISUALIZATION_TRANSITION_FRAMES` frames, so there is no black frame or hard cut.
+ * The incoming visualization starts with its first palette.
+ *
+ * @param visualization The type of visualization to switch to.
+ *
+ * @note Visualization should be set up using `setupVisualization` before calling this function.
+ */
+void transitionVisualization(VisualizationType visualization);
+
+/**
+ * @brief Returns `true` while a crossfade between visualizations or palettes is in progress.
+ */
+bool isVisualizationTransitionActive();
+
 /**
  * @brief Sets the color palette for the active LED visualization.
  *
  * This function assigns the specified `palette` to the currently active visualization.
  * It ensures that a visualization has already been set up before applying the palette.
+ * The old palette is crossfaded into the new one over `VISUALIZATION_TRANSITION_FRAMES` frames.
  *
  * @param palette The color palette to be applied to the active visualization.
  *
@@ -78,9 +166,9 @@ void setVisualizationPalette(VisualizationPalette palette);
 /**
  * @brief Deactivates the current LED visualization and resets internal state.
  *
- * This function deactivates the current visualization and clears all the buffers. It should be
- * called when the visualization is no longer needed or before initializing a different visualization,
- * as only one visualization can be active at a time.
+ * This function deactivates the current visualization, cancels any transition and turns all LEDs off.
+ * It should be called when the visualization is no longer needed. To switch to a different
+ * visualization without a black frame, use `transitionVisualization` instead.
  *
  * @note This function can only be called if a visualization is currently active.
  */
@@ -89,11 +177,103 @@ void teardownVisualization();
 /**
  * @brief Updates the active LED visualization based on the current visualization type.
  *
+ * Bands are resampled to `LED_MATRIX_N_BANDS` columns through a mapping precomputed whenever
+ * their number changes. With fewer bands than columns, neighboring columns repeat a band,
+ * with more bands, each column takes the loudest of its bands. Fewer bands than columns are
+ * smoothed before they are resampled, so smoothing never runs on more than `LED_MATRIX_N_BANDS` values.
+ *
  * @param bands Array of floating-point values to update the visualization with.
+ * @param nBands Number of bands, from 1 to 255.
  *
  * @note Ensure that a visualization is properly set up before calling this function.
  */
-void updateVisualization(float *bars);
+void updateVisualization(float *bands, int nBands);
+
+/**
+ * @brief Updates the active LED visualization with silent input, letting it decay.
+ *
+ * Equivalent to `updateVisualization` with zero bands. Once it ran for `VISUALIZATION_DECAY_FRAMES`
+ * frames in a row, the visualization is considered settled (see `isVisualizationDecayed`).
+ */
+void decayVisualization();
+
+/**
+ * @brief Returns `true` if the display no longer changes on silent input.
+ *
+ * That is when `decayVisualization` ran for `VISUALIZATION_DECAY_FRAMES` frames since the last call to
+ * `updateVisualization` or since the visualization was set up, and no transition is in progress.
+ * Further decay frames can then be skipped along with showing them.
+ */
+bool isVisualizationDecayed();
+
+/**
+ * @brief Sets the tempo and beat phase that visualizations follow from the next update.
+ *
+ * Until the confidence of the estimate reaches `TEMPO_MIN_CONFIDENCE`, visualizations run at the frame rate.
+ *
+ * @param tempo Estimate of the frame that will be rendered next.
+ */
+void setVisualizationTempo(const TempoEstimate *tempo);
+
+/**
+ * @brief Sets the radius of the Gaussian blur used by effects, 0 disables blurring.
+ *
+ * @param radius Radius from 0 to `VISUALIZATION_MAX_BLUR_RADIUS`, other values are clamped.
+ */
+void setVisualizationBlurRadius(int radius);
+
+/**
+ * @brief Returns the radius of the Gaussian blur used by effects.
+ */
+int getVisualizationBlurRadius();
+
+/**
+ * @brief Measures render time of every visualization at every blur radius on the actual hardware.
+ *
+ * Each visualization is run on synthetic bands for `VISUALIZATION_N_CALIBRATION_FRAMES` frames, and
+ * sending a frame to the LEDs is timed separately. Results are cached for `getVisualizationCost`.
+ * LEDs are turned off afterwards.
+ *
+ * @note LED strip must be set up and no visualization may be active.
+ */
+void calibrateVisualizations();
+
+/**
+ * @brief Returns the time to render and show a frame, measured by `calibrateVisualizations`.
+ *
+ * @param visualization The type of visualization.
+ * @param radius Blur radius.
+ *
+ * @return Time in microseconds, or 0 if not measured.
+ */
+unsigned long getVisualizationCost(VisualizationType visualization, int radius);
+
+/**
+ * @brief Copies the costs measured by `calibrateVisualizations`.
+ *
+ * @param calibration Pointer where the costs will be stored.
+ */
+void getVisualizationCalibration(VisualizationCalibration *calibration);
+
+/**
+ * @brief Replaces the measured costs, e.g. with ones cached from an earlier boot, so that calibration can be skipped.
+ *
+ * @param calibration Costs to use.
+ */
+void setVisualizationCalibration(const VisualizationCalibration *calibration);
+
+/**
+ * @brief Provides the last frame of the active visualization, before palette lookup and blending.
+ *
+ * Pointers stay valid until the next call to `updateVisualization` or `teardownVisualization`.
+ *
+ * @param color Pointer to receive the palette index of each LED.
+ * @param brightness Pointer to receive the brightness of each LED, `NULL` for full brightness.
+ * @param palette Pointer to receive the 16 palette entries, 3 bytes (RGB) each.
+ *
+ * @return `true` if a frame is available, `false` otherwise.
+ */
+bool getVisualizationFrame(const uint8_t **color, const uint8_t **brightness, const uint8_t **palette);
 
 /**
  * @brief Displays the current LED data on the matrix using FastLED.show().
@@ -0,0 +1,52 @@
+"""
+PlatformIO post-build script that prints the static RAM budget of the firmware.
+
+Lists the largest statically allocated objects (.data and .bss) and their total,
+so that changes to buffer sizes can be checked right after the build. Also prints
+the size of code in internal instruction RAM, which grows with `PLACE_HOT_IN_IRAM`.
+Used from `platformio.ini` with `extra_scripts = post:scripts/memory_report.py`.
+"""
+
+import subprocess
+
+Import("env")  # noqa: F821 (provided by PlatformIO)
+
+N_LARGEST = 15
+STATIC_SYMBOL_TYPES = "bBdD"
+IRAM_SECTIONS = (".iram0.vectors", ".iram0.text")
+
+
+def memory_report(source, target, env):
+    nm = env.subst("$CC").replace("gcc", "nm")
+    elf = str(target[0])
+    output = subprocess.run(
+        [nm, "--size-sort", "--print-size", "--demangle", elf],
+        capture_output=True,
+        text=True,
+        check=True,
+    ).stdout
+
+    symbols = []
+    for line in output.splitlines():
+        parts = line.split(maxsplit=3)
+        if len(parts) == 4 and parts[2] in STATIC_SYMBOL_TYPES:
+            symbols.append((int(parts[1], 16), parts[3]))
+    symbols.sort(reverse=True)
+
+    total = sum(size for size, _ in symbols)
+    print(f"Static RAM budget: {total} bytes in {len(symbols)} objects, largest:")
+    for size, name in symbols[:N_LARGEST]:
+        print(f"  {size:8d}  {name}")
+
+    size = env.subst("$CC").replace("gcc", "size")
+    output = subprocess.run([size, "-A", elf], capture_output=True, text=True, check=True).stdout
+    sections = {}
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[0] in IRAM_SECTIONS:
+            sections[parts[0]] = int(parts[1])
+    details = ", ".join(f"{name} {value}" for name, value in sections.items())
+    print(f"IRAM code: {sum(sections.values())} bytes ({details})")
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", memory_report)  # noqa: F821
@@ -0,0 +1,192 @@
+import argparse
+import time
+from argparse import RawTextHelpFormatter
+from textwrap import dedent
+
+import pygame
+import serial
+
+MAGIC = b"\xa5\x5a"
+HEADER_SIZE = 5
+
+FLAG_KEYFRAME = 0x01
+FLAG_PALETTE = 0x02
+FLAG_BRIGHTNESS = 0x04
+
+N_BANDS = 32
+N_PER_BAND = 32
+N_LEDS = N_BANDS * N_PER_BAND
+PALETTE_SIZE = 48
+
+
+def decode_plane(payload: bytes, offset: int, reference: bytearray) -> int:
+    """Applies runs of unchanged and changed values to the reference, returns the new offset."""
+    i = 0
+    while i < N_LEDS:
+        unchanged, changed = payload[offset], payload[offset + 1]
+        offset += 2
+        i += unchanged
+        reference[i : i + changed] = payload[offset : offset + changed]
+        offset += changed
+        i += changed
+    if i != N_LEDS:
+        raise ValueError("Plane overruns the frame")
+    return offset
+
+
+def color_from_palette(palette: bytes, index: int, brightness: int) -> tuple[int, int, int]:
+    """Linear blend between two neighbouring entries, same as FastLED `ColorFromPalette`."""
+    hi, lo = index >> 4, index & 0x0F
+    a = palette[3 * hi : 3 * hi + 3]
+    b = palette[3 * ((hi + 1) % 16) : 3 * ((hi + 1) % 16) + 3]
+    return tuple((ca * (16 - lo) + cb * lo) * brightness // (16 * 255) for ca, cb in zip(a, b))
+
+
+class Decoder:
+    def __init__(self):
+        self.color = bytearray(N_LEDS)
+        self.brightness = bytearray(N_LEDS)
+        self.palette = bytes(PALETTE_SIZE)
+        self.synced = False
+        self.frames = 0
+        self.bytes = 0
+        self.errors = 0
+
+    def feed(self, buffer: bytes) -> tuple[bytes, bool]:
+        """Decodes all complete packets, prints text in between, returns the rest and whether a frame was decoded."""
+        updated = False
+        while True:
+            start = buffer.find(MAGIC)
+            text = buffer if start < 0 else buffer[:start]
+            if text.strip(b"\0\r\n"):
+                print(text.decode(errors="replace"), end="")
+            if start < 0:
+                return b"", updated
+            buffer = buffer[start:]
+
+            if len(buffer) < HEADER_SIZE:
+                return buffer, updated
+            flags = buffer[2]
+            length = buffer[3] | buffer[4] << 8
+            if len(buffer) < HEADER_SIZE + length + 1:
+                return buffer, updated
+
+            payload = buffer[HEADER_SIZE : HEADER_SIZE + length]
+            checksum = 0
+            for value in payload:
+                checksum ^= value
+            if checksum != buffer[HEADER_SIZE + length]:
+                # Not a packet, or corrupted. Skip the magic and look for the next one.
+                self.errors += 1
+                buffer = buffer[len(MAGIC) :]
+                continue
+            buffer = buffer[HEADER_SIZE + length + 1 :]
+
+            if flags & FLAG_KEYFRAME:
+                self.color = bytearray(N_LEDS)
+                self.brightness = bytearray(N_LEDS)
+                self.palette = bytes(PALETTE_SIZE)
+                self.synced = True
+            if not self.synced:
+                continue  # Deltas are meaningless until the first keyframe
+
+            try:
+                offset = 0
+                if flags & FLAG_PALETTE:
+                    self.palette = bytes(payload[:PALETTE_SIZE])
+                    offset = PALETTE_SIZE
+                offset = decode_plane(payload, offset, self.color)
+                if flags & FLAG_BRIGHTNESS:
+                    decode_plane(payload, offset, self.brightness)
+                else:
+                    self.brightness = bytearray(b"\xff" * N_LEDS)
+            except (IndexError, ValueError):
+                self.errors += 1
+                self.synced = False
+                continue
+
+            self.frames += 1
+            self.bytes += HEADER_SIZE + length + 1
+            updated = True
+
+    def draw(self, surface: pygame.Surface, size: int):
+        for i in range(N_BANDS):
+            for j in range(N_PER_BAND):
+                k = i * N_PER_BAND + j
+                color = color_from_palette(self.palette, self.color[k], self.brightness[k])
+                rect = (i * size, (N_PER_BAND - 1 - j) * size, size - 1, size - 1)
+                surface.fill(color, rect)
+
+
+if __name__ == "__main__":
+    description = dedent(
+        """\
+        Live preview of the LED matrix, streamed by the firmware with the `mirror on` serial command.
+        At 115200 baud frames are skipped when they don't fit, every frame needs 921600 baud.
+
+        Example usage:
+        > python mirror.py --port /dev/ttyUSB0 --rate 115200
+        """
+    )
+
+    parser = argparse.ArgumentParser(description=description, formatter_class=RawTextHelpFormatter)
+    parser.add_argument(
+        "-p",
+        "--port",
+        dest="port",
+        type=str,
+        required=True,
+        help="Serial port.",
+    )
+    parser.add_argument(
+        "-r",
+        "--rate",
+        dest="rate",
+        type=int,
+        default=115200,
+        help="Boudrate.",
+    )
+    parser.add_argument(
+        "--led-size",
+        dest="led_size",
+        type=int,
+        default=20,
+        help="Size of one LED in pixels.",
+    )
+    args = parser.parse_args()
+
+    ser = serial.Serial(args.port, args.rate, timeout=0)
+    ser.write(b"mirror on\n")
+
+    pygame.init()
+    screen = pygame.display.set_mode((N_BANDS * args.led_size, N_PER_BAND * args.led_size))
+    decoder = Decoder()
+    buffer = b""
+    report_time = time.monotonic()
+
+    running = True
+    while running:
+        for event in pygame.event.get():
+            if event.type == pygame.QUIT:
+                running = False
+
+        buffer, updated = decoder.feed(buffer + ser.read_all())
+        if updated:
+            decoder.draw(screen, args.led_size)
+            pygame.display.flip()
+
+        now = time.monotonic()
+        if now - report_time >= 1.0:
+            bytes_per_frame = decoder.bytes / decoder.frames if decoder.frames else 0.0
+            pygame.display.set_caption(
+                f"Mirror: {decoder.frames / (now - report_time):.1f} fps, "
+                f"{bytes_per_frame:.1f} bytes per frame, {decoder.errors} errors"
+            )
+            decoder.frames = decoder.bytes = 0
+            report_time = now
+
+        time.sleep(0.005)
+
+    ser.write(b"mirror off\n")
+    ser.close()
+    pygame.quit()
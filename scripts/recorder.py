@@ -0,0 +1,346 @@
+import argparse
+import statistics
+import struct
+import time
+from argparse import RawTextHelpFormatter
+from textwrap import dedent
+
+import serial
+
+MAGIC = b"\x5a\xa5"
+HEADER_SIZE = 5
+
+PACKET_HEADER = 0
+PACKET_FRAME = 1
+PACKET_EVENT = 2
+PACKET_END = 3
+
+FLAG_SILENT = 0x01
+FLAG_RENDERED = 0x02
+FLAG_MISSED = 0x04
+
+VERSION = 1
+SPIKE_FACTOR = 2.0  # Frames that took this many times the median frame time are marked
+
+# Same order as `CommandType` in `main.cpp`
+COMMANDS = [
+    "set_audio_source",
+    "set_audio_signal",
+    "set_audio_engine",
+    "set_audio_capture_config",
+    "set_audio_sampling_rate",
+    "set_audio_channel_mode",
+    "set_audio_band_count",
+    "set_audio_tuning",
+    "print_latency_report",
+    "print_pipeline_report",
+    "print_stats_report",
+    "set_stats_period",
+    "set_mirror_enabled",
+    "print_mirror_report",
+    "print_power_report",
+    "set_power_scaling",
+    "set_scheduler_policy",
+    "clear_settings",
+    "dump_recorder",
+    "set_recorder_trigger",
+    "set_visualization_type",
+    "set_visualization_palette",
+]
+SOURCES = ["mic", "line", "synthetic"]
+VISUALIZATIONS = ["bars", "spectrum", "fire", "sparks"]
+ACTIONS = ["render", "no blur", "drop"]
+
+
+def describe_event(kind: int, value: int) -> str:
+    if kind == 0:
+        return f"command {COMMANDS[value] if 0 <= value < len(COMMANDS) else value}"
+    if kind == 1:
+        return f"audio source {SOURCES[value] if 0 <= value < len(SOURCES) else value}"
+    if kind == 2:
+        return f"visualization {VISUALIZATIONS[value] if 0 <= value < len(VISUALIZATIONS) else value}"
+    if kind == 3:
+        return f"capture overflow x{value}"
+    if kind == 4:
+        return f"settings write {value}us"
+    if kind == 5:
+        return f"trigger at frame time {value}us"
+    return f"event {kind} ({value})"
+
+
+class Dump:
+    def __init__(self):
+        self.header = None
+        self.frames = []
+        self.events = []
+        self.complete = False
+
+    def relative(self, timestamp: int) -> int:
+        """Time in microseconds relative to the dump, negative. Device timestamps wrap at 32 bits."""
+        return -((self.header["dump_time"] - timestamp) & 0xFFFFFFFF)
+
+    def add(self, kind: int, payload: bytes):
+        if kind == PACKET_HEADER:
+            version, max_bands, n_frames, n_events, threshold, dump_time, ns_per_frame = struct.unpack("<BBHHIII", payload)
+            if version != VERSION:
+                raise ValueError(f"Dump version {version} is not supported, expected {VERSION}")
+            self.header = {
+                "max_bands": max_bands,
+                "frames": n_frames,
+                "events": n_events,
+                "threshold": threshold,
+                "dump_time": dump_time,
+                "ns_per_frame": ns_per_frame,
+            }
+            self.frames, self.events, self.complete = [], [], False
+        elif self.header is None:
+            return  # Packets of a dump whose header was missed
+        elif kind == PACKET_FRAME:
+            sequence, capture, read, analysis, start, end, scale, n_bands, action, flags, blur = struct.unpack("<6IfBBBB", payload[:32])
+            self.frames.append(
+                {
+                    "sequence": sequence,
+                    "capture": self.relative(capture),
+                    "read": self.relative(read),
+                    "analysis": self.relative(analysis),
+                    "start": self.relative(start),
+                    "end": self.relative(end),
+                    "scale": scale,
+                    "action": action,
+                    "silent": bool(flags & FLAG_SILENT),
+                    "rendered": bool(flags & FLAG_RENDERED),
+                    "missed": bool(flags & FLAG_MISSED),
+                    "blur": blur,
+                    "bands": [value / 255 for value in payload[32 : 32 + n_bands]],
+                }
+            )
+        elif kind == PACKET_EVENT:
+            timestamp, event, value = struct.unpack("<IBi", payload)
+            self.events.append({"time": self.relative(timestamp), "kind": event, "value": value})
+        elif kind == PACKET_END:
+            self.complete = True
+
+
+def feed(buffer: bytes, dump: Dump) -> bytes:
+    """Decodes all complete packets, prints text in between, returns the rest."""
+    while True:
+        start = buffer.find(MAGIC)
+        text = buffer if start < 0 else buffer[:start]
+        if text.strip(b"\0\r\n"):
+            print(text.decode(errors="replace"), end="")
+        if start < 0:
+            return b""
+        buffer = buffer[start:]
+
+        if len(buffer) < HEADER_SIZE:
+            return buffer
+        kind = buffer[2]
+        length = buffer[3] | buffer[4] << 8
+        if len(buffer) < HEADER_SIZE + length + 1:
+            return buffer
+
+        payload = buffer[HEADER_SIZE : HEADER_SIZE + length]
+        checksum = 0
+        for value in payload:
+            checksum ^= value
+        if checksum != buffer[HEADER_SIZE + length]:
+            # Not a packet, or corrupted. Skip the magic and look for the next one.
+            buffer = buffer[len(MAGIC) :]
+            continue
+        buffer = buffer[HEADER_SIZE + length + 1 :]
+        try:
+            dump.add(kind, payload)
+        except struct.error:
+            print(f"Malformed packet of type {kind} skipped")
+
+
+def print_timeline(dump: Dump):
+    header = dump.header
+    frames = dump.frames
+    print(
+        f"Dump: {len(frames)} frames, {len(dump.events)} events, "
+        f"{header['ns_per_frame'] / 1000:.2f}us per frame recorded"
+        + (f", trigger at {header['threshold']}us" if header["threshold"] else "")
+        + ("" if dump.complete else ", incomplete")
+    )
+    if not frames:
+        return
+
+    frame_times = [frame["end"] - frame["read"] for frame in frames]
+    median = statistics.median(frame_times)
+    print(f"Frame time median {median:.0f}us, max {max(frame_times)}us, spikes over {SPIKE_FACTOR * median:.0f}us are marked with *")
+    print(
+        f"{'time ms':>10} {'seq':>6} {'interval':>8} {'analysis':>8} {'wait':>6} {'render':>6} {'total':>6} "
+        f"{'action':>7} {'blur':>4} {'scale':>9} {'peak':>5}"
+    )
+
+    events = sorted(dump.events, key=lambda event: event["time"])
+    event_index = 0
+    previous = None
+    for frame, frame_time in zip(frames, frame_times):
+        while event_index < len(events) and events[event_index]["time"] <= frame["read"]:
+            event = events[event_index]
+            print(f"{event['time'] / 1000:>10.1f} {'':>6} -- {describe_event(event['kind'], event['value'])}")
+            event_index += 1
+
+        interval = frame["read"] - previous["read"] if previous else 0
+        gap = previous and frame["sequence"] - previous["sequence"] > 1
+        notes = []
+        if gap:
+            notes.append(f"{frame['sequence'] - previous['sequence'] - 1} not rendered")
+        if frame["silent"]:
+            notes.append("silent" if frame["rendered"] else "silent, idle")
+        if frame["missed"]:
+            notes.append("missed")
+        peak = max(frame["bands"], default=0.0)
+        print(
+            f"{frame['read'] / 1000:>10.1f} {frame['sequence']:>6} {interval:>8} "
+            f"{frame['analysis'] - frame['read']:>8} {frame['start'] - frame['analysis']:>6} "
+            f"{frame['end'] - frame['start']:>6} {frame_time:>6}{'*' if frame_time > SPIKE_FACTOR * median else ' '}"
+            f"{ACTIONS[frame['action']] if frame['action'] < len(ACTIONS) else frame['action']:>7} "
+            f"{frame['blur']:>4} {frame['scale']:>9.3g} {peak:>5.2f} {', '.join(notes)}"
+        )
+        previous = frame
+
+    for event in events[event_index:]:
+        print(f"{event['time'] / 1000:>10.1f} {'':>6} -- {describe_event(event['kind'], event['value'])}")
+
+
+def save_csv(dump: Dump, path: str):
+    with open(path, "w") as file:
+        file.write("sequence,capture_us,read_us,analysis_us,render_start_us,render_end_us,action,silent,rendered,missed,blur,scale,bands\n")
+        for frame in dump.frames:
+            bands = " ".join(f"{value:.3f}" for value in frame["bands"])
+            file.write(
+                f"{frame['sequence']},{frame['capture']},{frame['read']},{frame['analysis']},{frame['start']},{frame['end']},"
+                f"{frame['action']},{int(frame['silent'])},{int(frame['rendered'])},{int(frame['missed'])},"
+                f"{frame['blur']},{frame['scale']},{bands}\n"
+            )
+
+
+def plot(dump: Dump):
+    import matplotlib.pyplot as plt
+
+    frames = dump.frames
+    times = [frame["read"] / 1000 for frame in frames]
+    analysis = [frame["analysis"] - frame["read"] for frame in frames]
+    wait = [frame["start"] - frame["analysis"] for frame in frames]
+    render = [frame["end"] - frame["start"] for frame in frames]
+    n_bands = max((len(frame["bands"]) for frame in frames), default=0)
+    bands = [[frame["bands"][i] if i < len(frame["bands"]) else 0.0 for frame in frames] for i in range(n_bands)]
+
+    figure, (timings, spectrum) = plt.subplots(2, 1, sharex=True)
+    timings.stackplot(times, analysis, wait, render, labels=["analysis", "wait", "render"])
+    for event in dump.events:
+        timings.axvline(event["time"] / 1000, color="black", linewidth=0.5)
+        timings.annotate(describe_event(event["kind"], event["value"]), (event["time"] / 1000, 0), rotation=90, fontsize=6)
+    timings.set_ylabel("us")
+    timings.legend(loc="upper left")
+    if times:
+        spectrum.imshow(bands, aspect="auto", origin="lower", extent=(times[0], times[-1], 0, n_bands))
+    spectrum.set_xlabel("ms before dump")
+    spectrum.set_ylabel("band")
+    plt.show()
+
+
+if __name__ == "__main__":
+    description = dedent(
+        """\
+        Decodes a flight recorder dump into a timeline of frames and events.
+
+        Frames show when samples were read, stage times in microseconds (analysis, wait for the render
+        stage, render), the action of the scheduler, blur radius, band scale and the peak band.
+        Events are listed between the frames.
+
+        Example usage:
+        > python recorder.py --port /dev/ttyUSB0 --rate 115200
+        > python recorder.py --port /dev/ttyUSB0 --trigger 30000 --save spike.bin
+        > python recorder.py --file spike.bin --csv spike.csv --plot
+        """
+    )
+
+    parser = argparse.ArgumentParser(description=description, formatter_class=RawTextHelpFormatter)
+    parser.add_argument(
+        "-p",
+        "--port",
+        dest="port",
+        type=str,
+        help="Serial port. The dump is requested, or awaited if a trigger is set.",
+    )
+    parser.add_argument(
+        "-r",
+        "--rate",
+        dest="rate",
+        type=int,
+        default=115200,
+        help="Boudrate.",
+    )
+    parser.add_argument(
+        "-t",
+        "--trigger",
+        dest="trigger",
+        type=int,
+        default=0,
+        help="Frame time in microseconds that triggers the dump, instead of requesting it right away.",
+    )
+    parser.add_argument(
+        "-f",
+        "--file",
+        dest="file",
+        type=str,
+        help="Raw serial capture to decode instead of reading the port.",
+    )
+    parser.add_argument(
+        "--save",
+        dest="save",
+        type=str,
+        help="Path where raw serial data is saved, to decode it again later.",
+    )
+    parser.add_argument(
+        "--csv",
+        dest="csv",
+        type=str,
+        help="Path where decoded frames are saved as CSV.",
+    )
+    parser.add_argument(
+        "--plot",
+        dest="plot",
+        action="store_true",
+        help="Plot stage times with events and bands over time.",
+    )
+    args = parser.parse_args()
+
+    if (args.port is None) == (args.file is None):
+        parser.error("Either --port or --file is required")
+
+    dump = Dump()
+    raw = b""
+    if args.file:
+        with open(args.file, "rb") as file:
+            raw = file.read()
+        feed(raw, dump)
+    else:
+        ser = serial.Serial(args.port, args.rate, timeout=0)
+        ser.write(f"recorder trigger {args.trigger}\n".encode() if args.trigger else b"recorder\n")
+        buffer = b""
+        try:
+            while not dump.complete:
+                data = ser.read_all()
+                raw += data
+                buffer = feed(buffer + data, dump)
+                time.sleep(0.005)
+        except KeyboardInterrupt:
+            pass
+        ser.close()
+
+    if args.save:
+        with open(args.save, "wb") as file:
+            file.write(raw)
+    if dump.header is None:
+        print("No dump found")
+    else:
+        print_timeline(dump)
+        if args.csv:
+            save_csv(dump, args.csv)
+        if args.plot:
+            plot(dump)
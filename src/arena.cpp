@@ -0,0 +1,71 @@
+#include "arena.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#define DEBUG
+
+#include "audio.h"
+#include "macros.h"
+#include "visualization.h"
+
+// Arena is sized for memory that is used at the same time: buffers that live for the whole program
+// and the largest set of buffers needed by a single visualization.
+#define ARENA_SIZE (AUDIO_ARENA_SIZE + VISUALIZATION_ARENA_SIZE)
+
+static_assert(ARENA_SIZE <= ARENA_BUDGET, "Static arena exceeds memory budget");
+
+typedef struct {
+    const char *tag;
+    size_t offset;
+    size_t size;
+} ArenaAllocation;
+
+__attribute__((aligned(ARENA_ALIGNMENT))) static uint8_t arena[ARENA_SIZE];
+static size_t arenaTop = 0;
+static size_t arenaPeak = 0;
+
+static ArenaAllocation allocations[ARENA_MAX_ALLOCATIONS];
+static int nAllocations = 0;
+
+void *arenaAllocate(size_t size, const char *tag) {
+    size = (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    if (arenaTop + size > ARENA_SIZE) {
+        PRINTF("Arena out of memory allocating %u bytes for %s. Halt!\n", (unsigned)size, tag);
+        while (true) continue;
+    }
+
+    void *ptr = arena + arenaTop;
+    memset(ptr, 0, size);
+
+    if (nAllocations < ARENA_MAX_ALLOCATIONS) {
+        allocations[nAllocations++] = {tag, arenaTop, size};
+    }
+
+    arenaTop += size;
+    arenaPeak = arenaTop > arenaPeak ? arenaTop : arenaPeak;
+    return ptr;
+}
+
+ArenaMark getArenaMark() {
+    return arenaTop;
+}
+
+void releaseArena(ArenaMark mark) {
+    if (mark > arenaTop) {
+        PRINTF("Arena mark above the top. Halt!\n");
+        while (true) continue;
+    }
+    arenaTop = mark;
+
+    while (nAllocations > 0 && allocations[nAllocations - 1].offset >= mark) {
+        nAllocations--;
+    }
+}
+
+void printArenaReport() {
+    PRINTF("Arena: %u used, %u peak, %u size, %u budget (bytes)\n", (unsigned)arenaTop, (unsigned)arenaPeak, (unsigned)ARENA_SIZE, (unsigned)ARENA_BUDGET);
+    for (int i = 0; i < nAllocations; i++) {
+        PRINTF("  %6u  %6u  %s\n", (unsigned)allocations[i].offset, (unsigned)allocations[i].size, allocations[i].tag);
+    }
+}
@@ -1,6 +1,7 @@
 #include "audio.h"
 
 #include <Arduino.h>
+#include <cfloat>
 #include <cstddef>
 #include <driver/i2s.h>
 #include <esp_dsp.h>
@@ -9,12 +10,23 @@
 
 #define DEBUG
 
+#include "arena.h"
+#include "kernels.h"
 #include "macros.h"
+#include "placement.h"
+#include "recorder.h"
+#include "stats.h"
+#include "synthetic.h"
 
 // clang-format off
 
 // This calibration was done with nothing plugged in, which is when the noise is at its loudest.
 // There is some potential to adjust the board design to reduce noise.
+// Tables were measured before the bass path, when the lowest `AUDIO_BASS_N_BANDS` bands came from
+// the full rate FFT. Those bands now collect `AUDIO_BASS_DECIMATION` times more bins, so their
+// entries are scaled by the change in bin density when the tables are set up. After recalibrating
+// with `tools/calibration.cpp`, set `TABLES_BASS_DECIMATION` to `AUDIO_BASS_DECIMATION`.
+#define TABLES_BASS_DECIMATION 1 // Decimation of the signal the lowest bands were measured from
 __attribute__((aligned(16))) static float noiseTableLineIn[AUDIO_N_BANDS] = {
     466857.09, 346476.28, 168687.16, 110188.34, 102911.09,  51135.57,  52786.84,  33903.78,
      64754.73,  45940.25,  50925.71,  49469.94,  51538.77,  51929.79,  41975.98,  47666.91,
@@ -60,55 +72,348 @@ __attribute__((aligned(16))) static float calibrationTableNone[AUDIO_N_BANDS] =
 // clang-format on
 
 static AudioSource currentAudioSource = AUDIO_SOURCE_NONE;
+static AudioEngine currentAudioEngine = AUDIO_ENGINE_FFT;
+static AudioChannelMode channelMode = AUDIO_CHANNELS_MONO;
+static AudioCaptureConfig captureConfig = {AUDIO_DMA_BUF_COUNT, AUDIO_DMA_BUF_LEN, AUDIO_N_SAMPLES};
+
+// Noise and calibration tables above are measured at `AUDIO_SAMPLING_RATE`. At other rates, and
+// while their bass bands are measured at another bin density, tables for the current source are
+// derived from them by frequency (see `deriveNoiseTable`).
+static const int samplingRates[] = {22050, 32000, 44100, 48000};
+static int samplingRate = AUDIO_SAMPLING_RATE;
+__attribute__((aligned(16))) static float derivedNoiseTable[AUDIO_MAX_BANDS];
+__attribute__((aligned(16))) static float derivedCalibrationTable[AUDIO_MAX_BANDS];
+
+// Tables are also measured with `AUDIO_N_BANDS` bands and derived the same way for other counts.
+// The bass path covers the same frequencies at every count, so the share of bass bands stays the same.
+static_assert((AUDIO_MIN_BANDS * AUDIO_BASS_N_BANDS) % AUDIO_N_BANDS == 0, "AUDIO_BASS_N_BANDS doesn't scale to AUDIO_MIN_BANDS");
+static int bandCount = AUDIO_N_BANDS;
+static int bassBandCount = AUDIO_BASS_N_BANDS; // Lowest bands computed from the decimated signal
+
+// FFT engine analyzes the last `fftSize` samples of the history. Costs of candidate sizes are
+// measured by `setupAudioProcessing`, indexed by log2(size / `AUDIO_FFT_MIN_SIZE`).
+static_assert(AUDIO_FFT_MIN_SIZE << (AUDIO_N_FFT_SIZES - 1) == AUDIO_N_SAMPLES, "AUDIO_N_FFT_SIZES doesn't match AUDIO_N_SAMPLES");
+static int fftSize = AUDIO_N_SAMPLES;
+static unsigned long fftCosts[AUDIO_N_FFT_SIZES] = {0};
+
+static QueueHandle_t i2sEvents = NULL; // Events of the I2S driver, overflows are counted in the stats
+
+// Capture clock used to estimate when DMA completed the samples
+static unsigned long syntheticStartTime = 0;   // Time at which the synthetic source started producing samples
+static unsigned long syntheticSamples = 0;     // Samples produced by the synthetic source since it was set up
+static unsigned long captureSamples = 0;       // Samples read since the audio source was set up
+static unsigned long captureAnchorSamples = 0; // Value of `captureSamples` after the last read that waited for DMA
+static unsigned long captureAnchorTime = 0;    // Time at which the last read that waited for DMA returned
+static unsigned long captureTimestamp = 0;     // Estimated DMA completion time of the newest sample
 static float *currentNoiseTable = noiseTableNone;
 static float *currentCalibrationTable = calibrationTableNone;
 
-__attribute__((aligned(16))) static int32_t audioBuffer[AUDIO_N_SAMPLES * 2] = {0};
-__attribute__((aligned(16))) static float window[AUDIO_N_SAMPLES];
-__attribute__((aligned(16))) static float fftBuffer[AUDIO_N_SAMPLES * 2];
-__attribute__((aligned(16))) static float frequencyThresholds[AUDIO_N_BANDS] = {0};
+// Large buffers are allocated from the static arena. Raw stereo samples are only needed until they are
+// converted to mono, so they are read into `fftBuffer`, which is free at that time (`captureBuffer`).
+// Blackman-Harris window is symmetric, so only its first half is stored.
+// In stereo modes the history holds the first channel (left or mid) and a second history holds
+// the other one (right or side). Both are analyzed by the same complex FFT.
+static int32_t *audioBuffer = NULL;       // Mono history of the last `AUDIO_N_SAMPLES` samples, DC offset included
+static int32_t *secondAudioBuffer = NULL; // History of the second channel in stereo modes
+static int32_t *captureBuffer = NULL;     // Raw interleaved stereo samples, aliases `fftBuffer`
+static float *fftBuffer = NULL;           // Complex FFT input and output, `AUDIO_N_SAMPLES * 2` values
+static float *window = NULL;              // First half of the window for `fftSize` samples
+__attribute__((aligned(16))) static float frequencyThresholds[AUDIO_MAX_BANDS] = {0};
+
+// The bass path keeps the last `AUDIO_N_SAMPLES` decimated samples, which span `AUDIO_BASS_DECIMATION`
+// times longer history than the original signal. FFT of the same size over this history has
+// proportionally narrower bins.
+#define BASS_FILTER_N_TAPS (2 * AUDIO_BASS_DECIMATION - 1)
+#define BASS_SAMPLING_RATE ((float)samplingRate / AUDIO_BASS_DECIMATION)
+
+static float *bassBuffer = NULL;
+static float *secondBassBuffer = NULL; // Bass history of the second channel in stereo modes
+static float bassFilter[BASS_FILTER_N_TAPS];
+static float bassFilterTail[AUDIO_BASS_DECIMATION - 1] = {0};       // Last input samples of the previous frame
+static float secondBassFilterTail[AUDIO_BASS_DECIMATION - 1] = {0}; // Same for the second channel
+static int firstMainBin = 1;                                           // First full rate bin not covered by the bass path
+
+// Filterbank output is RMS of the band signal. For a sine wave of amplitude A, RMS is A / sqrt(2) and
+// its FFT magnitude is roughly A * N / 2 (window used here is close to rectangular).
+#define FILTERBANK_GAIN (AUDIO_N_SAMPLES / M_SQRT2)
+
+static int audioBufferLength = 0;                                                // New samples in `audioBuffer` (per channel)
+static int64_t historySum = 0;                                                   // Sum of `audioBuffer`, updated with every chunk
+static float historyMean = 0.0;                                                  // DC offset removed by the FFT engine
+static int64_t secondHistorySum = 0;                                             // Sum of `secondAudioBuffer`
+static float secondHistoryMean = 0.0;                                            // DC offset of the second channel
+__attribute__((aligned(16))) static float secondBands[AUDIO_MAX_BANDS];            // Bands of the second channel
+__attribute__((aligned(16))) static float filterbankCoefficients[AUDIO_MAX_BANDS][5]; // b0, b1, b2, a1, a2
+__attribute__((aligned(16))) static float filterbankDelays[AUDIO_MAX_BANDS][2] = {0};
+static float filterbankEnvelopeTimes[AUDIO_MAX_BANDS];
+static float filterbankEnvelopes[AUDIO_MAX_BANDS] = {0}; // Mean square of the band signal
 
 static float bandScale = 0.0;
 
-void setupAudioProcessing() {
-    // Frequency thresholds are based on a modified Bark scale.
-    // To better suit audio visualization needs, higher frequencies
-    // are compressed into fewer bands, as they are ususlly not the
-    // key components of audio signal.
-    float step = (6.0 + 1.7) * asinh(AUDIO_SAMPLING_RATE / 2.0 / 600.0) / AUDIO_N_BANDS;
-    for (int i = 0; i < AUDIO_N_BANDS; i++) {
-        frequencyThresholds[i] = 600.0 / 3.3 * sinh(step * (i + 1) / 6.0);
+// Silence gate, see `isAudioSilent`
+static float noiseFloorMeanSquare = 0.0; // Mean square of the signal at the noise floor, 0 disables the gate
+static bool silenceGated = false;
+static int silenceFrames = 0;            // Consecutive frames below the noise floor, up to `AUDIO_SILENCE_HOLD_FRAMES`
+static float processCost = 0.0;          // Average processing time of an analyzed frame, saved by every gated frame
+
+/**
+ * @brief Computes upper edges of the bands for the sampling rate and band count.
+ *
+ * Frequency thresholds are based on a modified Bark scale.
+ * To better suit audio visualization needs, higher frequencies
+ * are compressed into fewer bands, as they are ususlly not the
+ * key components of audio signal.
+ */
+static void computeFrequencyThresholds(float rate, int count, float *thresholds) {
+    float step = (6.0 + 1.7) * asinh(rate / 2.0 / 600.0) / count;
+    for (int i = 0; i < count; i++) {
+        thresholds[i] = 600.0 / 3.3 * sinh(step * (i + 1) / 6.0);
     }
+}
 
-    esp_err_t err = dsps_fft2r_init_fc32(NULL, AUDIO_N_SAMPLES);
-    if (err != ESP_OK) {
-        PRINTF("Not possible to initialize FFT2R. Error: 0x(%x). Halt!\n", err);
-        while (true) continue;
+static void setupFftSize();
+
+/**
+ * @brief Generates band edges, bin ranges and filterbank filters for the current `samplingRate` and `bandCount`.
+ */
+static void setupBands() {
+    computeFrequencyThresholds(samplingRate, bandCount, frequencyThresholds);
+
+    // Filterbank bands have the same edges as FFT bands. Each band-pass filter is centered
+    // at geometric mean of the edges, with quality factor matching the bandwidth.
+    for (int i = 0; i < bandCount; i++) {
+        float low = i == 0 ? frequencyThresholds[0] / 2.0 : frequencyThresholds[i - 1];
+        float high = frequencyThresholds[i];
+        float center = sqrtf(low * high);
+        float quality = center / (high - low);
+
+        float normalizedCenter = center / samplingRate;
+        normalizedCenter = normalizedCenter > 0.49 ? 0.49 : normalizedCenter;
+        esp_err_t err = dsps_biquad_gen_bpf0db_f32(filterbankCoefficients[i], normalizedCenter, quality);
+        if (err != ESP_OK) {
+            PRINTF("Biquad generation error: 0x(%x). Halt!\n", err);
+            while (true) continue;
+        }
+
+        // Low bands need longer envelope to smooth out the ripple of the band signal itself
+        float envelopeTime = AUDIO_FILTERBANK_ENVELOPE_PERIODS / center;
+        filterbankEnvelopeTimes[i] = envelopeTime < AUDIO_FILTERBANK_MIN_ENVELOPE_TIME ? AUDIO_FILTERBANK_MIN_ENVELOPE_TIME : envelopeTime;
     }
 
+    setupFftSize();
+}
+
+/**
+ * @brief Generates the window and bin ranges for the current `fftSize`.
+ *
+ * @note Uses `fftBuffer` as scratch memory, so it can't be called while a frame is processed.
+ */
+static void setupFftSize() {
     // Windowing helps reduce frequency leakage between bands but can cause some parts of
     // short signals to be lost, especially if they start near the edge of the audio sample.
     // This means the same short signal might result in different responses. To reduce this problem,
     // the shape of the window is made closer to a 'square' by taking the square root of the values
     // several times. This keeps more of the signal intact while still reducing leakage.
-    dsps_wind_blackman_harris_f32(window, AUDIO_N_SAMPLES);
-    for (int i = 0; i < AUDIO_N_SAMPLES; i++) {
-        window[i] = sqrtf(window[i]);
+    // Full window is generated in the FFT buffer, which is not used yet.
+    dsps_wind_blackman_harris_f32(fftBuffer, fftSize);
+    for (int i = 0; i < fftSize / 2; i++) {
+        window[i] = sqrtf(fftBuffer[i]);
         window[i] = sqrtf(window[i]);
         window[i] = sqrtf(window[i]);
     }
+
+    firstMainBin = int(frequencyThresholds[bassBandCount - 1] * fftSize / samplingRate) + 1;
+}
+
+/**
+ * @brief Measures processing time of every candidate FFT size on silence.
+ *
+ * Capture and conversion of samples is not included, as it doesn't depend on the size.
+ */
+static void calibrateFftSizes() {
+    __attribute__((aligned(16))) float bands[AUDIO_MAX_BANDS];
+
+    // Smaller sizes clamp the read chunk, which has to be restored for capture
+    int previousFftSize = fftSize;
+    AudioCaptureConfig previousConfig = captureConfig;
+
+    for (int k = 0; k < AUDIO_N_FFT_SIZES; k++) {
+        setAudioFftSize(AUDIO_FFT_MIN_SIZE << k);
+        audioBufferLength = fftSize; // Worst case of decimation work, when frames don't overlap
+
+        unsigned long timeStart = micros();
+        for (int run = 0; run < AUDIO_FFT_N_CALIBRATION_RUNS; run++) {
+            processAudioData(bands);
+        }
+        fftCosts[k] = (micros() - timeStart) / AUDIO_FFT_N_CALIBRATION_RUNS;
+        PRINTF("FFT size %d: %luus per frame\n", fftSize, fftCosts[k]);
+    }
+
+    audioBufferLength = 0;
+    setAudioFftSize(previousFftSize);
+    captureConfig.readChunk = previousConfig.readChunk;
+
+    if (memcmp(&captureConfig, &previousConfig, sizeof(AudioCaptureConfig)) != 0 || fftSize != previousFftSize) {
+        PRINTF("Capture config changed by FFT size calibration. Halt!\n");
+        while (true) continue;
+    }
+}
+
+void setupAudioProcessing(bool calibrate) {
+    fftBuffer = (float *)arenaAllocate(sizeof(float) * AUDIO_N_SAMPLES * 2, "audio fft");
+    captureBuffer = (int32_t *)fftBuffer;
+    audioBuffer = (int32_t *)arenaAllocate(sizeof(int32_t) * AUDIO_N_SAMPLES, "audio history");
+    secondAudioBuffer = (int32_t *)arenaAllocate(sizeof(int32_t) * AUDIO_N_SAMPLES, "audio second history");
+    bassBuffer = (float *)arenaAllocate(sizeof(float) * AUDIO_N_SAMPLES, "audio bass history");
+    secondBassBuffer = (float *)arenaAllocate(sizeof(float) * AUDIO_N_SAMPLES, "audio second bass history");
+    window = (float *)arenaAllocate(sizeof(float) * AUDIO_N_SAMPLES / 2, "audio window");
+
+    esp_err_t err = dsps_fft2r_init_fc32(NULL, AUDIO_N_SAMPLES);
+    if (err != ESP_OK) {
+        PRINTF("Not possible to initialize FFT2R. Error: 0x(%x). Halt!\n", err);
+        while (true) continue;
+    }
+
+    // Anti-aliasing filter for decimation is equivalent to a second order CIC filter (two cascaded
+    // moving averages of decimation length). It has zeros exactly at the frequencies that would alias
+    // to DC, which is where the bass bands are, and costs only a few multiplications per output sample.
+    for (int i = 0; i < BASS_FILTER_N_TAPS; i++) {
+        int weight = i < AUDIO_BASS_DECIMATION ? i + 1 : BASS_FILTER_N_TAPS - i;
+        bassFilter[i] = (float)weight / (AUDIO_BASS_DECIMATION * AUDIO_BASS_DECIMATION);
+    }
+
+    setupBands();
+    if (calibrate) {
+        calibrateFftSizes();
+    }
+}
+
+/**
+ * @brief Clears histories of both channels and the state derived from them.
+ */
+static void clearHistory() {
+    memset(audioBuffer, 0, sizeof(int32_t) * AUDIO_N_SAMPLES);
+    memset(secondAudioBuffer, 0, sizeof(int32_t) * AUDIO_N_SAMPLES);
+    historySum = 0;
+    historyMean = 0.0;
+    secondHistorySum = 0;
+    secondHistoryMean = 0.0;
+    memset(bassBuffer, 0, sizeof(float) * AUDIO_N_SAMPLES);
+    memset(secondBassBuffer, 0, sizeof(float) * AUDIO_N_SAMPLES);
+    memset(bassFilterTail, 0, sizeof(bassFilterTail));
+    memset(secondBassFilterTail, 0, sizeof(secondBassFilterTail));
+    memset(filterbankDelays, 0, sizeof(filterbankDelays));
+    memset(filterbankEnvelopes, 0, sizeof(filterbankEnvelopes));
+}
+
+void setAudioSamplingRate(int rate) {
+    if (audioBuffer == NULL) {
+        PRINTF("Audio processing is not set up. Halt!\n");
+        while (true) continue;
+    }
+
+    int nearest = samplingRates[0];
+    for (int i = 1; i < (int)(sizeof(samplingRates) / sizeof(samplingRates[0])); i++) {
+        if (abs(samplingRates[i] - rate) < abs(nearest - rate)) nearest = samplingRates[i];
+    }
+
+    // Read chunk is scaled, so that frame rate stays the same
+    int readChunk = (int)((int64_t)captureConfig.readChunk * nearest / samplingRate);
+    readChunk -= readChunk % AUDIO_BASS_DECIMATION;
+    readChunk = readChunk < AUDIO_BASS_DECIMATION ? AUDIO_BASS_DECIMATION : readChunk;
+    captureConfig.readChunk = readChunk > fftSize ? fftSize : readChunk;
+
+    samplingRate = nearest;
+    setupBands();
+
+    // History at the old rate would show up as a frequency shift
+    clearHistory();
+}
+
+int getAudioSamplingRate() {
+    return samplingRate;
+}
+
+void setAudioFftSize(int size) {
+    int rounded = AUDIO_FFT_MIN_SIZE;
+    while (rounded * 2 <= size && rounded < AUDIO_N_SAMPLES) {
+        rounded *= 2;
+    }
+    fftSize = rounded;
+    setupFftSize();
+
+    captureConfig.readChunk = captureConfig.readChunk > fftSize ? fftSize : captureConfig.readChunk;
+}
+
+int getAudioFftSize() {
+    return fftSize;
+}
+
+void setAudioBandCount(int count) {
+    if (audioBuffer == NULL) {
+        PRINTF("Audio processing is not set up. Halt!\n");
+        while (true) continue;
+    }
+
+    int rounded = AUDIO_MIN_BANDS;
+    while (rounded * 2 <= count && rounded < AUDIO_MAX_BANDS) {
+        rounded *= 2;
+    }
+    bandCount = rounded;
+    bassBandCount = AUDIO_BASS_N_BANDS * bandCount / AUDIO_N_BANDS;
+    setupBands();
+
+    // Envelopes belong to the old bands, FFT histories don't depend on them
+    memset(filterbankDelays, 0, sizeof(filterbankDelays));
+    memset(filterbankEnvelopes, 0, sizeof(filterbankEnvelopes));
+}
+
+int getAudioBandCount() {
+    return bandCount;
+}
+
+void setAudioChannelMode(AudioChannelMode mode) {
+    if (audioBuffer == NULL) {
+        PRINTF("Audio processing is not set up. Halt!\n");
+        while (true) continue;
+    }
+
+    // Channels of the history change their meaning
+    channelMode = mode;
+    clearHistory();
+    silenceGated = false;
+    silenceFrames = 0;
+}
+
+AudioChannelMode getAudioChannelMode() {
+    return channelMode;
+}
+
+unsigned long getAudioFftCost(int size) {
+    for (int k = 0; k < AUDIO_N_FFT_SIZES; k++) {
+        if (AUDIO_FFT_MIN_SIZE << k == size) return fftCosts[k];
+    }
+    return 0;
+}
+
+void getAudioCalibration(AudioCalibration *calibration) {
+    memcpy(calibration->fftCosts, fftCosts, sizeof(fftCosts));
+}
+
+void setAudioCalibration(const AudioCalibration *calibration) {
+    memcpy(fftCosts, calibration->fftCosts, sizeof(fftCosts));
 }
 
 static void setupMic() {
     const i2s_driver_config_t i2sConfig = {
         .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-        .sample_rate = AUDIO_SAMPLING_RATE,
+        .sample_rate = (uint32_t)samplingRate,
         .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
         .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
         .communication_format = I2S_COMM_FORMAT_STAND_I2S,
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 4,
-        .dma_buf_len = AUDIO_N_SAMPLES,
+        .dma_buf_count = captureConfig.dmaBufCount,
+        .dma_buf_len = captureConfig.dmaBufLen,
         .use_apll = false,
         .tx_desc_auto_clear = false,
         .fixed_mclk = 0,
@@ -123,7 +428,7 @@ static void setupMic() {
         .data_in_num = AUDIO_MIC_DATA_PIN,
     };
 
-    esp_err_t err = i2s_driver_install(AUDIO_I2S_PORT, &i2sConfig, 0, NULL);
+    esp_err_t err = i2s_driver_install(AUDIO_I2S_PORT, &i2sConfig, AUDIO_I2S_EVENT_QUEUE_LEN, &i2sEvents);
     if (err != ESP_OK) {
         PRINTF("Error installing I2S driver: 0x(%x). Halt!\n", err);
         while (true) continue;
@@ -139,16 +444,16 @@ static void setupMic() {
 static void setupLineIn() {
     const i2s_driver_config_t i2sConfig = {
         .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-        .sample_rate = AUDIO_SAMPLING_RATE,
+        .sample_rate = (uint32_t)samplingRate,
         .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
         .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
         .communication_format = I2S_COMM_FORMAT_STAND_I2S,
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 4,
-        .dma_buf_len = AUDIO_N_SAMPLES,
+        .dma_buf_count = captureConfig.dmaBufCount,
+        .dma_buf_len = captureConfig.dmaBufLen,
         .use_apll = true,
         .tx_desc_auto_clear = false,
-        .fixed_mclk = 512 * AUDIO_SAMPLING_RATE,
+        .fixed_mclk = 512 * samplingRate,
         .mclk_multiple = I2S_MCLK_MULTIPLE_DEFAULT,
         .bits_per_chan = I2S_BITS_PER_CHAN_DEFAULT,
     };
@@ -161,7 +466,7 @@ static void setupLineIn() {
         .data_in_num = AUDIO_LINE_IN_DATA_PIN,
     };
 
-    esp_err_t err = i2s_driver_install(AUDIO_I2S_PORT, &i2sConfig, 0, NULL);
+    esp_err_t err = i2s_driver_install(AUDIO_I2S_PORT, &i2sConfig, AUDIO_I2S_EVENT_QUEUE_LEN, &i2sEvents);
     if (err != ESP_OK) {
         PRINTF("Error installing I2S driver: 0x(%x). Halt!\n", err);
         while (true) continue;
@@ -183,9 +488,37 @@ void setupAudioSource(AudioSource audioSource) {
 
     if (audioSource == AUDIO_SOURCE_MIC) {
         setupMic();
-    } else {
+    } else if (audioSource == AUDIO_SOURCE_LINE_IN) {
         setupLineIn();
+    } else {
+        setupSyntheticSignal(samplingRate);
+        syntheticStartTime = micros();
+        syntheticSamples = 0;
     }
+
+    captureSamples = 0;
+    captureAnchorSamples = 0;
+    captureAnchorTime = micros();
+}
+
+void setAudioCaptureConfig(AudioCaptureConfig config) {
+    config.dmaBufCount = config.dmaBufCount < 2 ? 2 : config.dmaBufCount;
+    config.dmaBufCount = config.dmaBufCount > 128 ? 128 : config.dmaBufCount;
+    config.dmaBufLen = config.dmaBufLen < 8 ? 8 : config.dmaBufLen;
+    config.dmaBufLen = config.dmaBufLen > 1024 ? 1024 : config.dmaBufLen;
+    config.readChunk -= config.readChunk % AUDIO_BASS_DECIMATION;
+    config.readChunk = config.readChunk < AUDIO_BASS_DECIMATION ? AUDIO_BASS_DECIMATION : config.readChunk;
+    config.readChunk = config.readChunk > fftSize ? fftSize : config.readChunk;
+
+    captureConfig = config;
+}
+
+AudioCaptureConfig getAudioCaptureConfig() {
+    return captureConfig;
+}
+
+unsigned long getAudioCaptureTimestamp() {
+    return captureTimestamp;
 }
 
 void teardownAudioSource() {
@@ -194,54 +527,351 @@ void teardownAudioSource() {
         while (true) continue;
     }
 
-    esp_err_t err = i2s_driver_uninstall(AUDIO_I2S_PORT);
-    if (err != ESP_OK) {
-        PRINTF("Error uninstalling I2S driver: 0x(%x). Halt!\n", err);
-        while (true) continue;
+    if (currentAudioSource != AUDIO_SOURCE_SYNTHETIC) {
+        esp_err_t err = i2s_driver_uninstall(AUDIO_I2S_PORT);
+        if (err != ESP_OK) {
+            PRINTF("Error uninstalling I2S driver: 0x(%x). Halt!\n", err);
+            while (true) continue;
+        }
+        i2sEvents = NULL; // Deleted by the driver
     }
 
     currentAudioSource = AUDIO_SOURCE_NONE;
 }
 
-void readAudioDataToBuffer() {
-    size_t bytesRead;
-    i2s_read(AUDIO_I2S_PORT, audioBuffer, sizeof(audioBuffer), &bytesRead, portMAX_DELAY);
+/**
+ * @brief Drains the I2S event queue and accounts DMA overflows in the stats and the recorder.
+ *
+ * The driver overwrites the oldest unread DMA buffer when all of them are full and posts
+ * `I2S_EVENT_RX_Q_OVF`, which would otherwise go unnoticed.
+ */
+static void countCaptureOverflows() {
+    if (i2sEvents == NULL) return;
+
+    i2s_event_t event;
+    unsigned nOverflows = 0;
+    while (xQueueReceive(i2sEvents, &event, 0) == pdPASS) {
+        nOverflows += event.type == I2S_EVENT_RX_Q_OVF ? 1 : 0;
+    }
+    if (nOverflows > 0) {
+        addStatsCaptureOverflow(nOverflows);
+        recordEvent(RECORDER_EVENT_CAPTURE_OVERFLOW, nOverflows);
+    }
+}
+
+/**
+ * @brief Produces samples of the synthetic source as `i2s_read` would return them.
+ *
+ * With `AUDIO_SYNTHETIC_PACED`, samples become available at the sampling rate since the source was set up.
+ * A read waits until all requested samples are available, or returns only those already available
+ * if it should not wait, like a read from the DMA queue.
+ */
+static size_t readSynthetic(void *dest, size_t size, TickType_t ticksToWait) {
+    int n = size / (sizeof(int32_t) * 2);
+
+#if AUDIO_SYNTHETIC_PACED
+    unsigned long dueTime = syntheticStartTime + (unsigned long)((uint64_t)(syntheticSamples + n) * 1000000 / samplingRate);
+    long early = (long)(dueTime - micros());
+    if (early > 0 && ticksToWait == 0) {
+        int missing = (int)((uint64_t)early * samplingRate / 1000000) + 1;
+        n = n > missing ? n - missing : 0;
+    } else if (early > 0) {
+        delay(early / 1000);
+        delayMicroseconds(early % 1000);
+    }
+#endif
+
+    generateSyntheticSamples((int32_t *)dest, n);
+    syntheticSamples += n;
+    return sizeof(int32_t) * 2 * n;
+}
+
+/**
+ * @brief Reads raw samples from I2S and updates the capture clock.
+ *
+ * @param dest Destination for interleaved stereo samples.
+ * @param size Number of bytes to read.
+ * @param ticksToWait Maximum time to wait for DMA.
+ *
+ * @return Number of bytes read.
+ */
+static size_t readCapture(void *dest, size_t size, TickType_t ticksToWait) {
+    size_t bytesRead = 0;
+    unsigned long readStart = micros();
+    if (currentAudioSource == AUDIO_SOURCE_SYNTHETIC) {
+        bytesRead = readSynthetic(dest, size, ticksToWait);
+    } else {
+        i2s_read(AUDIO_I2S_PORT, dest, size, &bytesRead, ticksToWait);
+    }
+    unsigned long readEnd = micros();
+
+    captureSamples += bytesRead / (sizeof(int32_t) * 2);
+    bool blocked = readEnd - readStart >= AUDIO_CAPTURE_BLOCKING_THRESHOLD_US;
+    if (blocked) {
+        captureAnchorTime = readEnd;
+        captureAnchorSamples = captureSamples;
+    }
+    addStatsCaptureWait(readEnd - readStart, blocked);
+    countCaptureOverflows();
+    return bytesRead;
+}
+
+/**
+ * @brief Updates the silence gate with the mean square of the newest samples, DC offset removed.
+ */
+static HOT_CODE void updateSilenceGate(float meanSquare) {
+    const float closeLevel = AUDIO_SILENCE_CLOSE_FACTOR * AUDIO_SILENCE_CLOSE_FACTOR * noiseFloorMeanSquare;
+    const float openLevel = AUDIO_SILENCE_OPEN_FACTOR * AUDIO_SILENCE_OPEN_FACTOR * noiseFloorMeanSquare;
+
+    if (meanSquare > openLevel) {
+        silenceGated = false;
+        silenceFrames = 0;
+    } else if (meanSquare >= closeLevel) {
+        silenceFrames = 0; // Between the levels the gate keeps its state
+    } else {
+        silenceFrames = silenceFrames < AUDIO_SILENCE_HOLD_FRAMES ? silenceFrames + 1 : silenceFrames;
+        silenceGated = silenceGated || silenceFrames == AUDIO_SILENCE_HOLD_FRAMES;
+    }
+}
+
+HOT_CODE void readAudioDataToBuffer() {
+    const size_t captureBytes = sizeof(float) * AUDIO_N_SAMPLES * 2;
+    if (currentAudioEngine == AUDIO_ENGINE_FILTERBANK) {
+        // Wait only for a single DMA buffer, then take whatever is already available.
+        const size_t chunkBytes = sizeof(int32_t) * 2 * captureConfig.dmaBufLen;
+        size_t bytesRead = readCapture(captureBuffer, chunkBytes, portMAX_DELAY);
+        bytesRead += readCapture((uint8_t *)captureBuffer + bytesRead, captureBytes - bytesRead, 0);
+        audioBufferLength = bytesRead / (sizeof(int32_t) * 2);
+    } else {
+        // Older samples are kept at the beginning of the history, so that frames can overlap.
+        const int chunk = captureConfig.readChunk;
+        historySum -= kernelSum(audioBuffer, chunk);
+        memmove(audioBuffer, audioBuffer + chunk, sizeof(int32_t) * (AUDIO_N_SAMPLES - chunk));
+        if (channelMode != AUDIO_CHANNELS_MONO) {
+            secondHistorySum -= kernelSum(secondAudioBuffer, chunk);
+            memmove(secondAudioBuffer, secondAudioBuffer + chunk, sizeof(int32_t) * (AUDIO_N_SAMPLES - chunk));
+        }
+        size_t bytesRead = readCapture(captureBuffer, sizeof(int32_t) * 2 * chunk, portMAX_DELAY);
+        audioBufferLength = bytesRead / (sizeof(int32_t) * 2);
+    }
+
+    unsigned long elapsedSamples = captureSamples - captureAnchorSamples;
+    captureTimestamp = captureAnchorTime + (unsigned long)((uint64_t)elapsedSamples * 1000000 / samplingRate);
+    unsigned long now = micros();
+    if ((long)(captureTimestamp - now) > 0) captureTimestamp = now;
 
     // The raw audio samples are stored in the most significant bytes, so we need to shift them right
     // to obtain the actual values. For both INMP441 mic and PCM1808 ADC, each sample is 24 bits,
     // so we shift by at least 8 bits + some more to reduce noise.
-    for (int i = 0; i < AUDIO_N_SAMPLES * 2; i++) {
-        audioBuffer[i] >>= 12;
+    // Shift and stereo to mono conversion (or split into channels) are done in a single pass over the raw samples.
+    if (currentAudioEngine == AUDIO_ENGINE_FILTERBANK) {
+        kernelDownmix(captureBuffer, audioBuffer, 12, audioBufferLength);
+        return;
+    }
+
+    int32_t *first = audioBuffer + AUDIO_N_SAMPLES - audioBufferLength;
+    int32_t *second = secondAudioBuffer + AUDIO_N_SAMPLES - audioBufferLength;
+    int64_t newSums[2] = {0, 0};
+    if (channelMode == AUDIO_CHANNELS_MONO) {
+        newSums[0] = kernelDownmix(captureBuffer, first, 12, audioBufferLength);
+    } else if (AUDIO_LEFT_CHANNEL_FIRST || channelMode == AUDIO_CHANNELS_MID_SIDE) {
+        // Swapped channels only flip the sign of the side signal, which doesn't change its spectrum
+        kernelSplitStereo(captureBuffer, first, second, 12, channelMode == AUDIO_CHANNELS_MID_SIDE, newSums, audioBufferLength);
+    } else {
+        kernelSplitStereo(captureBuffer, second, first, 12, false, newSums, audioBufferLength);
+        int64_t swap = newSums[0];
+        newSums[0] = newSums[1];
+        newSums[1] = swap;
+    }
+
+    // Average of the history is tracked from the samples that enter and leave it. It is subtracted
+    // while the samples are windowed into the FFT input, instead of rewriting the whole history.
+    historySum += newSums[0];
+    historyMean = (float)historySum / AUDIO_N_SAMPLES;
+    secondHistorySum += newSums[1];
+    secondHistoryMean = (float)secondHistorySum / AUDIO_N_SAMPLES;
+
+    if (audioBufferLength > 0) {
+        // Noise floor is the mean square of L + R. With independent noise in the channels,
+        // it is also the sum of mean squares of L and R, and half of that of mid and side.
+        float sumSquares = kernelSumSquares(first, historyMean, audioBufferLength);
+        if (channelMode != AUDIO_CHANNELS_MONO) {
+            sumSquares += kernelSumSquares(second, secondHistoryMean, audioBufferLength);
+            sumSquares *= channelMode == AUDIO_CHANNELS_MID_SIDE ? 0.5 : 1.0;
+        }
+        updateSilenceGate(sumSquares / audioBufferLength);
+    }
+}
+
+void setAudioEngine(AudioEngine audioEngine) {
+    currentAudioEngine = audioEngine;
+
+    // Filterbank engine doesn't keep the history, so its sum is recomputed
+    if (audioBuffer != NULL) {
+        historySum = kernelSum(audioBuffer, AUDIO_N_SAMPLES);
+        historyMean = (float)historySum / AUDIO_N_SAMPLES;
+        secondHistorySum = kernelSum(secondAudioBuffer, AUDIO_N_SAMPLES);
+        secondHistoryMean = (float)secondHistorySum / AUDIO_N_SAMPLES;
+    }
+
+    memset(filterbankDelays, 0, sizeof(filterbankDelays));
+    memset(filterbankEnvelopes, 0, sizeof(filterbankEnvelopes));
+
+    // Only the FFT engine is gated
+    silenceGated = false;
+    silenceFrames = 0;
+}
+
+AudioEngine getAudioEngine() {
+    return currentAudioEngine;
+}
+
+int getAudioBufferLength() {
+    return audioBufferLength;
+}
+
+/**
+ * @brief Returns FFT bins per Hz in a band, bass bands come from the decimated signal.
+ */
+static float binsPerHz(bool bass, float rate) {
+    return bass ? AUDIO_N_SAMPLES * AUDIO_BASS_DECIMATION / rate : AUDIO_N_SAMPLES / rate;
+}
+
+/**
+ * @brief Derives a noise table for the current sampling rate and band count from a table measured
+ * at `AUDIO_SAMPLING_RATE` with `AUDIO_N_BANDS` bands.
+ *
+ * Noise of each measured band is spread evenly over its bins, and current bands collect the noise
+ * of bins they overlap. Measured bass bands come from a signal decimated by `TABLES_BASS_DECIMATION`.
+ * Noise above the highest measured band is extrapolated from it.
+ */
+static void deriveNoiseTable(const float *reference, float *table) {
+    float referenceThresholds[AUDIO_N_BANDS];
+    computeFrequencyThresholds(AUDIO_SAMPLING_RATE, AUDIO_N_BANDS, referenceThresholds);
+
+    for (int i = 0; i < bandCount; i++) {
+        float low = i == 0 ? 0.0 : frequencyThresholds[i - 1];
+        float high = frequencyThresholds[i];
+
+        float noise = 0.0;
+        for (int j = 0; j < AUDIO_N_BANDS; j++) {
+            float referenceLow = j == 0 ? 0.0 : referenceThresholds[j - 1];
+            float referenceHigh = referenceThresholds[j];
+            float width = referenceHigh - referenceLow;
+            referenceHigh = j == AUDIO_N_BANDS - 1 ? FLT_MAX : referenceHigh;
+
+            float overlap = (high < referenceHigh ? high : referenceHigh) - (low > referenceLow ? low : referenceLow);
+            if (overlap <= 0.0) continue;
+            float referenceBinsPerHz = binsPerHz(false, AUDIO_SAMPLING_RATE);
+            referenceBinsPerHz *= j < AUDIO_BASS_N_BANDS ? TABLES_BASS_DECIMATION : 1;
+            noise += reference[j] / (width * referenceBinsPerHz) * overlap * binsPerHz(i < bassBandCount, samplingRate);
+        }
+        table[i] = noise;
+    }
+}
+
+/**
+ * @brief Derives a calibration table for the current sampling rate and band count from a table measured
+ * at `AUDIO_SAMPLING_RATE` with `AUDIO_N_BANDS` bands.
+ *
+ * Gains are interpolated at band centers on a logarithmic frequency axis. Bass bands are divided by
+ * the change in their bin density, as they collect more bins than when they were measured.
+ */
+static void deriveCalibrationTable(const float *reference, float *table) {
+    float referenceThresholds[AUDIO_N_BANDS];
+    computeFrequencyThresholds(AUDIO_SAMPLING_RATE, AUDIO_N_BANDS, referenceThresholds);
+
+    float referenceCenters[AUDIO_N_BANDS];
+    for (int j = 0; j < AUDIO_N_BANDS; j++) {
+        float low = j == 0 ? referenceThresholds[0] / 2.0 : referenceThresholds[j - 1];
+        referenceCenters[j] = sqrtf(low * referenceThresholds[j]);
     }
 
-    float avg = 0.0;
-    for (int i = 0; i < AUDIO_N_SAMPLES; i++) {
-        // Stereo to mono conversion
-        audioBuffer[i] = audioBuffer[i * 2] + audioBuffer[i * 2 + 1];
+    for (int i = 0; i < bandCount; i++) {
+        float low = i == 0 ? frequencyThresholds[0] / 2.0 : frequencyThresholds[i - 1];
+        float center = sqrtf(low * frequencyThresholds[i]);
+
+        if (center <= referenceCenters[0]) {
+            table[i] = reference[0];
+            continue;
+        }
+        int j = 0;
+        while (j < AUDIO_N_BANDS - 1 && referenceCenters[j + 1] < center) {
+            j++;
+        }
+        if (j == AUDIO_N_BANDS - 1) {
+            table[i] = reference[j];
+            continue;
+        }
+        float t = logf(center / referenceCenters[j]) / logf(referenceCenters[j + 1] / referenceCenters[j]);
+        table[i] = reference[j] * (1.0 - t) + reference[j + 1] * t;
+    }
 
-        avg += audioBuffer[i];
+    for (int i = 0; i < bassBandCount; i++) {
+        table[i] *= (float)TABLES_BASS_DECIMATION / AUDIO_BASS_DECIMATION;
     }
-    avg /= AUDIO_N_SAMPLES;
-    // Normalization by subtracting average signal
-    for (int i = 0; i < AUDIO_N_SAMPLES; i++) {
-        audioBuffer[i] -= avg;
+}
+
+/**
+ * @brief Estimates the mean square of the signal that produces the current noise table.
+ *
+ * Magnitudes of noise bins are Rayleigh distributed, so squared magnitudes of a band with B bins sum
+ * to about 4 / pi * noise^2 / B. By Parseval's theorem, positive frequency bins of an N point FFT sum
+ * to N^2 / 2 times the mean square of the signal. Bass bands come from an FFT of the same size.
+ */
+static void setupNoiseFloor() {
+    float sumSquares = 0.0;
+    for (int i = 0; i < bandCount; i++) {
+        float low = i == 0 ? 0.0 : frequencyThresholds[i - 1];
+        float nBins = (frequencyThresholds[i] - low) * binsPerHz(i < bassBandCount, samplingRate);
+        nBins = nBins < 1.0 ? 1.0 : nBins;
+        sumSquares += 4.0 / M_PI * currentNoiseTable[i] * currentNoiseTable[i] / nBins;
     }
+    noiseFloorMeanSquare = 2.0 * sumSquares / ((float)AUDIO_N_SAMPLES * AUDIO_N_SAMPLES);
+
+    silenceGated = false;
+    silenceFrames = 0;
 }
 
+#define TABLES_MATCH_CONFIG (samplingRate == AUDIO_SAMPLING_RATE && TABLES_BASS_DECIMATION == AUDIO_BASS_DECIMATION)
+
+// Tables are calibrated for the FFT engine only. Filterbank bands have roughly
+// constant relative bandwidth, so it uses neutral tables until calibrated.
+
 void setupAudioNoiseTable(AudioSource audioSource) {
-    if (audioSource == AUDIO_SOURCE_MIC) {
+    if (currentAudioEngine == AUDIO_ENGINE_FILTERBANK) {
+        currentNoiseTable = noiseTableNone;
+    } else if (audioSource == AUDIO_SOURCE_MIC) {
         currentNoiseTable = noiseTableMic;
+    } else if (audioSource == AUDIO_SOURCE_SYNTHETIC) {
+        currentNoiseTable = noiseTableNone; // Signals have no noise floor, tables of other sources can be tested on them
     } else {
         currentNoiseTable = noiseTableLineIn;
     }
+
+    // Neutral tables only have to be derived for another band count
+    if ((!TABLES_MATCH_CONFIG && currentNoiseTable != noiseTableNone) || bandCount != AUDIO_N_BANDS) {
+        deriveNoiseTable(currentNoiseTable, derivedNoiseTable);
+        currentNoiseTable = derivedNoiseTable;
+    }
+    setupNoiseFloor();
 }
 
 void setupAudioCalibrationTable(AudioSource audioSource) {
-    if (audioSource == AUDIO_SOURCE_MIC) {
+    if (currentAudioEngine == AUDIO_ENGINE_FILTERBANK) {
+        currentCalibrationTable = calibrationTableNone;
+    } else if (audioSource == AUDIO_SOURCE_MIC) {
         currentCalibrationTable = calibrationTableMic;
+    } else if (audioSource == AUDIO_SOURCE_SYNTHETIC) {
+        currentCalibrationTable = calibrationTableNone;
     } else {
         currentCalibrationTable = calibrationTableLineIn;
     }
+
+    if ((!TABLES_MATCH_CONFIG && currentCalibrationTable != calibrationTableNone) || bandCount != AUDIO_N_BANDS) {
+        deriveCalibrationTable(currentCalibrationTable, derivedCalibrationTable);
+        currentCalibrationTable = derivedCalibrationTable;
+    }
 }
 
 void setupAudioTables(AudioSource audioSource) {
@@ -257,59 +887,267 @@ void resetAudioBandScale(AudioSource audioSource) {
     }
 }
 
-void processAudioData(float *bands) {
-    for (int i = 0; i < AUDIO_N_SAMPLES; i++) {
-        fftBuffer[i * 2 + 0] = audioBuffer[i] * window[i];
+void setAudioBandScale(float scale) {
+    if (!(scale > 0.0)) return;
+    bandScale = scale;
+}
+
+float getAudioBandScale() {
+    return bandScale;
+}
+
+/**
+ * @brief Filters and decimates new samples from the end of a history and appends them to its bass history.
+ *
+ * @param history History of a channel, `audioBuffer` or `secondAudioBuffer`.
+ * @param bass Bass history of the same channel.
+ * @param tail Last input samples of the previous frame of the same channel.
+ * @param mean DC offset of the history.
+ */
+static HOT_CODE void decimateToBassBuffer(const int32_t *history, float *bass, float *tail, float mean) {
+    const int nNew = audioBufferLength;
+    const int nDecimated = nNew / AUDIO_BASS_DECIMATION;
+    const int32_t *input = history + AUDIO_N_SAMPLES - nNew;
+
+    memmove(bass, bass + nDecimated, sizeof(float) * (AUDIO_N_SAMPLES - nDecimated));
+    float *out = bass + AUDIO_N_SAMPLES - nDecimated;
+
+    for (int k = 0; k < nDecimated; k++) {
+        float sum = 0.0;
+        for (int j = 0; j < BASS_FILTER_N_TAPS; j++) {
+            int n = k * AUDIO_BASS_DECIMATION - (AUDIO_BASS_DECIMATION - 1) + j;
+            float sample = n < 0 ? tail[n + AUDIO_BASS_DECIMATION - 1] : input[n];
+            sum += bassFilter[j] * sample;
+        }
+        out[k] = sum - mean; // Filter has unity gain at DC
+    }
+
+    for (int i = 0; i < AUDIO_BASS_DECIMATION - 1; i++) {
+        tail[i] = input[nNew - (AUDIO_BASS_DECIMATION - 1) + i];
+    }
+}
+
+/**
+ * @brief Multiplies samples by the window and stores them in `fftBuffer` as complex values.
+ *
+ * @param samples Pointer to `fftSize` samples for the real parts.
+ * @param imagSamples Pointer to `fftSize` samples for the imaginary parts, or `NULL` for zeros.
+ */
+static HOT_CODE void applyWindow(const float *samples, const float *imagSamples) {
+    const int half = fftSize / 2;
+    kernelMultiply(samples, 1, window, 1, fftBuffer, 2, half);
+    kernelMultiply(samples + half, 1, window + half - 1, -1, fftBuffer + half * 2, 2, half);
+    if (imagSamples != NULL) {
+        kernelMultiply(imagSamples, 1, window, 1, fftBuffer + 1, 2, half);
+        kernelMultiply(imagSamples + half, 1, window + half - 1, -1, fftBuffer + half * 2 + 1, 2, half);
+        return;
+    }
+    for (int i = 0; i < fftSize; i++) {
         fftBuffer[i * 2 + 1] = 0;
     }
+}
 
-    esp_err_t err = dsps_fft2r_fc32(fftBuffer, AUDIO_N_SAMPLES);
+/**
+ * @brief Transforms windowed samples in `fftBuffer` in place into magnitude spectrum.
+ *
+ * After this call first `fftSize / 2` values of `fftBuffer` hold magnitudes of the bins. With `separate`,
+ * real and imaginary parts of the input are two signals, and magnitudes of their bins are interleaved
+ * (see `kernelSeparateMagnitudes`).
+ *
+ * @param separate `true` to separate spectra of the real and imaginary parts.
+ */
+static HOT_CODE void computeMagnitudes(bool separate) {
+    esp_err_t err = dsps_fft2r_fc32(fftBuffer, fftSize);
     if (err != ESP_OK) {
         PRINTF("FFT2R error: 0x(%x). Halt!\n", err);
         while (true) continue;
     }
-    err = dsps_bit_rev2r_fc32(fftBuffer, AUDIO_N_SAMPLES);
+    err = dsps_bit_rev2r_fc32(fftBuffer, fftSize);
     if (err != ESP_OK) {
         PRINTF("FFT2R bit reverse error: 0x(%x). Halt!\n", err);
         while (true) continue;
     }
 
     // Compute power spectrum
-    for (int i = 0; i < AUDIO_N_SAMPLES; i++) {
-        fftBuffer[i] = sqrtf(fftBuffer[i * 2 + 0] * fftBuffer[i * 2 + 0] + fftBuffer[i * 2 + 1] * fftBuffer[i * 2 + 1]);
+    if (separate) {
+        kernelSeparateMagnitudes(fftBuffer, fftSize);
+    } else {
+        kernelMagnitude(fftBuffer, fftBuffer, fftSize / 2);
     }
+}
 
-    // Distribute power spectrum values into frequency bands
-    memset(bands, 0, sizeof(float) * AUDIO_N_BANDS);
-    int bandIdx = 0;
-    for (int i = 1; i < AUDIO_N_SAMPLES / 2; i++) {
-        bands[bandIdx] += fftBuffer[i];
+/**
+ * @brief Distributes magnitudes into frequency bands.
+ *
+ * @param bands Pointer to an array of bands to add magnitudes to.
+ * @param bandIdx First band to fill.
+ * @param endBand Band at which grouping stops (exclusive).
+ * @param bin First bin to take magnitude from.
+ * @param binWidth Width of a single bin in Hz.
+ * @param magnitudes Magnitudes of the bins, in `fftBuffer`.
+ * @param stride Distance between magnitudes of consecutive bins, 2 for separated spectra.
+ */
+static HOT_CODE void groupBins(float *bands, int bandIdx, int endBand, int bin, float binWidth, const float *magnitudes, int stride) {
+    for (; bin < fftSize / 2 && bandIdx < endBand; bin++) {
+        bands[bandIdx] += magnitudes[bin * stride];
 
-        float frequency = i * AUDIO_SAMPLING_RATE / AUDIO_N_SAMPLES;
+        float frequency = bin * binWidth;
         if (frequencyThresholds[bandIdx] < frequency) {
             bandIdx++;
-
-            if (bandIdx > AUDIO_N_BANDS) {
-                PRINTF("Frequency band grouping error. Halt!\n");
-                while (true) continue;
-            }
         }
     }
+}
+
+/**
+ * @brief Runs captured samples through the band-pass filterbank and updates band envelopes.
+ *
+ * @param bands Pointer to an array where the band RMS values will be stored.
+ */
+static HOT_CODE void processFilterbank(float *bands) {
+    // FFT buffer is not used by this engine, so it holds both filter input and output
+    float *input = fftBuffer;
+    float *output = fftBuffer + AUDIO_N_SAMPLES;
+    const int n = audioBufferLength;
+
+    kernelToFloat(audioBuffer, input, 1, n);
+    const float inverseN = 1.0 / n;
 
-    // Apply noise reduction and calibration to each frequency band
-    for (int i = 0; i < AUDIO_N_BANDS; i++) {
-        bands[i] -= currentNoiseTable[i];
-        bands[i] *= currentCalibrationTable[i];
+    for (int i = 0; i < bandCount; i++) {
+        dsps_biquad_f32(input, output, n, filterbankCoefficients[i], filterbankDelays[i]);
 
-        bands[i] = bands[i] < 0.0 ? 0.0 : bands[i];
+        float energy;
+        dsps_dotprod_f32(output, output, &energy, n);
+        energy *= inverseN;
+
+        float alpha = 1.0 - expf(-n / (filterbankEnvelopeTimes[i] * samplingRate));
+        filterbankEnvelopes[i] += (energy - filterbankEnvelopes[i]) * alpha;
+
+        bands[i] = sqrtf(filterbankEnvelopes[i]) * FILTERBANK_GAIN;
     }
 }
 
-void scaleAudioData(float *bands) {
-    float max = 0.0;
-    for (int i = 0; i < AUDIO_N_BANDS; i++) {
-        max = max < bands[i] ? bands[i] : max;
+/**
+ * @brief Computes bands from captured samples with multirate FFT.
+ *
+ * In stereo modes, both channels go through the same FFTs, one in the real and the other in the
+ * imaginary part of the input, and their spectra are separated afterwards. This costs one pass
+ * over the bins more than mono, instead of two more FFTs.
+ *
+ * @param bands Pointer to a zeroed array where the band magnitudes will be stored.
+ * @param second Pointer to a zeroed array for the bands of the second channel, only used in stereo modes.
+ */
+static HOT_CODE void processFft(float *bands, float *second) {
+    const bool stereo = channelMode != AUDIO_CHANNELS_MONO;
+    const int stride = stereo ? 2 : 1;
+
+    // Bass bands from decimated signal
+    decimateToBassBuffer(audioBuffer, bassBuffer, bassFilterTail, historyMean);
+    if (stereo) {
+        decimateToBassBuffer(secondAudioBuffer, secondBassBuffer, secondBassFilterTail, secondHistoryMean);
     }
+    applyWindow(bassBuffer + AUDIO_N_SAMPLES - fftSize, stereo ? secondBassBuffer + AUDIO_N_SAMPLES - fftSize : NULL);
+    computeMagnitudes(stereo);
+    groupBins(bands, 0, bassBandCount, 1, BASS_SAMPLING_RATE / fftSize, fftBuffer, stride);
+    if (stereo) {
+        groupBins(second, 0, bassBandCount, 1, BASS_SAMPLING_RATE / fftSize, fftBuffer + 1, stride);
+    }
+
+    // Remaining bands from full rate signal, windowed straight from the history into the FFT input
+    const int32_t *samples = audioBuffer + AUDIO_N_SAMPLES - fftSize;
+    const int half = fftSize / 2;
+    if (stereo) {
+        const int32_t *secondSamples = secondAudioBuffer + AUDIO_N_SAMPLES - fftSize;
+        kernelWindowPairToComplex(samples, secondSamples, historyMean, secondHistoryMean, window, 1, fftBuffer, half);
+        kernelWindowPairToComplex(samples + half, secondSamples + half, historyMean, secondHistoryMean, window + half - 1, -1, fftBuffer + half * 2, half);
+    } else {
+        kernelWindowToComplex(samples, historyMean, window, 1, fftBuffer, half);
+        kernelWindowToComplex(samples + half, historyMean, window + half - 1, -1, fftBuffer + half * 2, half);
+    }
+    computeMagnitudes(stereo);
+    groupBins(bands, bassBandCount, bandCount, firstMainBin, (float)samplingRate / fftSize, fftBuffer, stride);
+    if (stereo) {
+        groupBins(second, bassBandCount, bandCount, firstMainBin, (float)samplingRate / fftSize, fftBuffer + 1, stride);
+    }
+
+    // Magnitude of a tone grows with the FFT size, tables are calibrated for `AUDIO_N_SAMPLES`
+    if (fftSize != AUDIO_N_SAMPLES) {
+        kernelScale(bands, bands, (float)AUDIO_N_SAMPLES / fftSize, bandCount);
+        if (stereo) kernelScale(second, second, (float)AUDIO_N_SAMPLES / fftSize, bandCount);
+    }
+}
+
+/**
+ * @brief Applies noise reduction and calibration to each frequency band.
+ *
+ * @param bands Pointer to an array of bands to correct in place.
+ * @param noiseScale Share of the noise table present in the bands.
+ */
+static HOT_CODE void correctBands(float *bands, float noiseScale) {
+    __attribute__((aligned(16))) float noise[AUDIO_MAX_BANDS];
+    kernelScale(currentNoiseTable, noise, noiseScale, bandCount);
+    kernelSubtract(bands, noise, bands, bandCount);
+    kernelMultiply(bands, 1, currentCalibrationTable, 1, bands, 1, bandCount);
+    kernelClamp(bands, 0.0, FLT_MAX, bandCount);
+}
+
+/**
+ * @brief Folds bands of two channels into halves of `bands`, with the lowest frequencies in the middle.
+ *
+ * Each pair of adjacent bands of a channel is summed into one band of its half.
+ *
+ * @param bands Bands of the first channel, replaced by the folded bands.
+ * @param second Bands of the second channel.
+ */
+static HOT_CODE void foldChannels(float *bands, const float *second) {
+    const int half = bandCount / 2;
+    __attribute__((aligned(16))) float first[AUDIO_MAX_BANDS];
+    memcpy(first, bands, sizeof(float) * bandCount);
+
+    for (int i = 0; i < half; i++) {
+        bands[half - 1 - i] = first[2 * i] + first[2 * i + 1];
+        bands[half + i] = second[2 * i] + second[2 * i + 1];
+    }
+}
+
+HOT_CODE void processAudioData(float *bands) {
+    unsigned long timeStart = micros();
+    memset(bands, 0, sizeof(float) * bandCount);
+
+    // Silence would be removed by noise reduction anyway. The bass history is not updated either,
+    // it only holds silence from before the gate closed.
+    if (silenceGated) {
+        float saved = processCost - (micros() - timeStart);
+        addStatsSilenceFrame(PIPELINE_STAGE_ANALYSIS, saved > 0.0 ? saved : 0.0);
+        return;
+    }
+
+    if (currentAudioEngine == AUDIO_ENGINE_FILTERBANK) {
+        processFilterbank(bands);
+        correctBands(bands, 1.0);
+    } else if (channelMode == AUDIO_CHANNELS_MONO) {
+        processFft(bands, NULL);
+        correctBands(bands, 1.0);
+    } else {
+        memset(secondBands, 0, sizeof(float) * bandCount);
+        processFft(bands, secondBands);
+
+        // Noise tables are measured on L + R. With independent noise in the channels, each of them
+        // has 1 / sqrt(2) of the noise magnitude, while mid and side have all of it.
+        float noiseScale = channelMode == AUDIO_CHANNELS_STEREO ? M_SQRT1_2 : 1.0;
+        correctBands(bands, noiseScale);
+        correctBands(secondBands, noiseScale);
+        foldChannels(bands, secondBands);
+    }
+
+    processCost += (float(micros() - timeStart) - processCost) / 16.0;
+}
+
+bool isAudioSilent() {
+    return silenceGated;
+}
+
+HOT_CODE void scaleAudioData(float *bands) {
+    float max = kernelMax(bands, 0.0, bandCount);
     // Scaling up should be quicker than scaling down (AUDIO_BAND_SCALE_UP_FACTOR < AUDIO_BAND_SCALE_DOWN_FACTOR),
     // but it shouldn't scale all the way up to the maximum value, allowing the bands to remain high for a while.
     if (max > bandScale) {
@@ -318,10 +1156,8 @@ void scaleAudioData(float *bands) {
         bandScale = (max + bandScale * (AUDIO_BAND_SCALE_DOWN_FACTOR - 1)) / AUDIO_BAND_SCALE_DOWN_FACTOR;
     }
     bandScale = bandScale < 1.0 ? 1.0 : bandScale;
-    for (int i = 0; i < AUDIO_N_BANDS; i++) {
-        bands[i] /= bandScale * 0.95;
-        bands[i] = bands[i] > 1.0 ? 1.0 : bands[i];
-    }
+    kernelScale(bands, bands, 1.0 / (bandScale * 0.95), bandCount);
+    kernelClamp(bands, 0.0, 1.0, bandCount);
 }
 
 void getInternalAudioBuffer(int32_t **buffer) {
@@ -0,0 +1,18 @@
+#include "console.h"
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+static SemaphoreHandle_t consoleMutex = NULL;
+
+void setupConsole() {
+    if (consoleMutex == NULL) consoleMutex = xSemaphoreCreateRecursiveMutex();
+}
+
+bool lockConsole(TickType_t wait) {
+    return consoleMutex == NULL || xSemaphoreTakeRecursive(consoleMutex, wait) == pdTRUE;
+}
+
+void unlockConsole() {
+    if (consoleMutex != NULL) xSemaphoreGiveRecursive(consoleMutex);
+}
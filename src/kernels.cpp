@@ -0,0 +1,158 @@
+#include "kernels.h"
+
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_dsp.h>
+#endif
+
+#include "placement.h"
+
+HOT_CODE void kernelToFloat(const int32_t *__restrict in, float *__restrict out, int strideOut, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i * strideOut] = in[i];
+    }
+}
+
+HOT_CODE int64_t kernelDownmix(const int32_t *__restrict in, int32_t *__restrict out, int shift, int n) {
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        out[i] = (in[2 * i] >> shift) + (in[2 * i + 1] >> shift);
+        sum += out[i];
+    }
+    return sum;
+}
+
+HOT_CODE void kernelSplitStereo(const int32_t *__restrict in, int32_t *__restrict a, int32_t *__restrict b, int shift, bool midSide, int64_t *sums, int n) {
+    int64_t sumA = 0;
+    int64_t sumB = 0;
+    if (midSide) {
+        for (int i = 0; i < n; i++) {
+            int32_t l = in[2 * i] >> shift;
+            int32_t r = in[2 * i + 1] >> shift;
+            a[i] = l + r;
+            b[i] = l - r;
+            sumA += a[i];
+            sumB += b[i];
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            a[i] = in[2 * i] >> shift;
+            b[i] = in[2 * i + 1] >> shift;
+            sumA += a[i];
+            sumB += b[i];
+        }
+    }
+    sums[0] = sumA;
+    sums[1] = sumB;
+}
+
+HOT_CODE int64_t kernelSum(const int32_t *x, int n) {
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+HOT_CODE float kernelSumSquares(const int32_t *x, float offset, int n) {
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float value = (float)x[i] - offset;
+        sum += value * value;
+    }
+    return sum;
+}
+
+HOT_CODE void kernelWindowToComplex(const int32_t *__restrict in, float offset, const float *w, int strideW, float *__restrict out, int n) {
+    for (int i = 0; i < n; i++) {
+        out[2 * i + 0] = ((float)in[i] - offset) * w[i * strideW];
+        out[2 * i + 1] = 0.0f;
+    }
+}
+
+HOT_CODE void kernelWindowPairToComplex(const int32_t *__restrict re, const int32_t *__restrict im, float offsetRe, float offsetIm, const float *w, int strideW, float *__restrict out, int n) {
+    for (int i = 0; i < n; i++) {
+        float weight = w[i * strideW];
+        out[2 * i + 0] = ((float)re[i] - offsetRe) * weight;
+        out[2 * i + 1] = ((float)im[i] - offsetIm) * weight;
+    }
+}
+
+HOT_CODE void kernelMultiply(const float *a, int strideA, const float *b, int strideB, float *out, int strideOut, int n) {
+#ifdef ESP_PLATFORM
+    if (strideA > 0 && strideB > 0 && strideOut > 0) {
+        dsps_mul_f32(a, b, out, n, strideA, strideB, strideOut);
+        return;
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+        out[i * strideOut] = a[i * strideA] * b[i * strideB];
+    }
+}
+
+HOT_CODE void kernelSubtract(const float *a, const float *b, float *out, int n) {
+#ifdef ESP_PLATFORM
+    dsps_sub_f32(a, b, out, n, 1, 1, 1);
+#else
+    for (int i = 0; i < n; i++) {
+        out[i] = a[i] - b[i];
+    }
+#endif
+}
+
+HOT_CODE void kernelScale(const float *in, float *out, float c, int n) {
+#ifdef ESP_PLATFORM
+    dsps_mulc_f32(in, out, n, c, 1, 1);
+#else
+    for (int i = 0; i < n; i++) {
+        out[i] = in[i] * c;
+    }
+#endif
+}
+
+// Ternaries below compile to conditional moves on the ESP32 FPU and to min/max instructions on
+// hosts, while `fminf`/`fmaxf` are library calls on the ESP32 because of NaN handling.
+
+HOT_CODE void kernelClamp(float *x, float low, float high, int n) {
+    for (int i = 0; i < n; i++) {
+        float value = x[i] < low ? low : x[i];
+        x[i] = value > high ? high : value;
+    }
+}
+
+HOT_CODE float kernelMax(const float *x, float init, int n) {
+    float max = init;
+    for (int i = 0; i < n; i++) {
+        max = x[i] > max ? x[i] : max;
+    }
+    return max;
+}
+
+HOT_CODE void kernelMagnitude(const float *in, float *out, int n) {
+    // Writing over the input is safe, since `out[i]` is at or before `in[2 * i]`
+    for (int i = 0; i < n; i++) {
+        float re = in[2 * i + 0];
+        float im = in[2 * i + 1];
+        out[i] = sqrtf(re * re + im * im);
+    }
+}
+
+HOT_CODE void kernelSeparateMagnitudes(float *x, int n) {
+    // Writing over the input is safe: `x[k]` is read right before it is overwritten, and `x[n - k]`
+    // is in the upper half, which is never written
+    for (int k = 0; k < n / 2; k++) {
+        int mirror = k == 0 ? 0 : n - k;
+        float re = x[2 * k + 0];
+        float im = x[2 * k + 1];
+        float mirrorRe = x[2 * mirror + 0];
+        float mirrorIm = x[2 * mirror + 1];
+
+        float sumRe = re + mirrorRe;
+        float diffRe = re - mirrorRe;
+        float sumIm = im + mirrorIm;
+        float diffIm = im - mirrorIm;
+        x[2 * k + 0] = 0.5f * sqrtf(sumRe * sumRe + diffIm * diffIm);
+        x[2 * k + 1] = 0.5f * sqrtf(sumIm * sumIm + diffRe * diffRe);
+    }
+}
@@ -0,0 +1,75 @@
+#include "latency.h"
+
+#include <Arduino.h>
+#include <stdlib.h>
+
+#define DEBUG
+
+#include "macros.h"
+
+static const char *stageNames[LATENCY_N_STAGES] = {
+    "capture",
+    "analysis",
+    "render",
+    "show",
+};
+
+static uint32_t history[LATENCY_N_STAGES][LATENCY_N_FRAMES] = {0}; // Latency of each stage in microseconds
+static int historyCursor = 0;
+static int historyLength = 0;
+
+static unsigned long frameStart = 0;
+static uint32_t frame[LATENCY_N_STAGES] = {0};
+
+void beginLatencyFrame(unsigned long dmaCompleteTime) {
+    frameStart = dmaCompleteTime;
+    for (int i = 0; i < LATENCY_N_STAGES; i++) {
+        frame[i] = 0;
+    }
+}
+
+void markLatencyStage(LatencyStage stage) {
+    frame[stage] = micros() - frameStart;
+}
+
+void markLatencyStageAt(LatencyStage stage, unsigned long time) {
+    frame[stage] = time - frameStart;
+}
+
+void endLatencyFrame() {
+    for (int i = 0; i < LATENCY_N_STAGES; i++) {
+        history[i][historyCursor] = frame[i];
+    }
+    historyCursor = (historyCursor + 1) % LATENCY_N_FRAMES;
+    historyLength = historyLength < LATENCY_N_FRAMES ? historyLength + 1 : LATENCY_N_FRAMES;
+}
+
+static int compareLatency(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void printLatencyReport() {
+    if (historyLength == 0) {
+        PRINTF("Latency: no frames recorded\n");
+        return;
+    }
+
+    static uint32_t sorted[LATENCY_N_FRAMES];
+
+    PRINTF("Latency over %d frames (us since DMA complete):\n", historyLength);
+    for (int i = 0; i < LATENCY_N_STAGES; i++) {
+        memcpy(sorted, history[i], sizeof(uint32_t) * historyLength);
+        qsort(sorted, historyLength, sizeof(uint32_t), compareLatency);
+
+        PRINTF(
+            "  %-8s p50: %6u  p95: %6u  p99: %6u  max: %6u\n",
+            stageNames[i],
+            (unsigned)sorted[historyLength * 50 / 100],
+            (unsigned)sorted[historyLength * 95 / 100],
+            (unsigned)sorted[historyLength * 99 / 100],
+            (unsigned)sorted[historyLength - 1]
+        );
+    }
+}
@@ -2,22 +2,60 @@
 
 #define DEBUG
 
+#include "arena.h"
 #include "audio.h"
 #include "buttons.h"
 #include "config.h"
+#include "console.h"
+#include "latency.h"
 #include "macros.h"
+#include "mirror.h"
+#include "pipeline.h"
+#include "power.h"
+#include "recorder.h"
+#include "scheduler.h"
+#include "settings.h"
+#include "stats.h"
+#include "synthetic.h"
+#include "tempo.h"
+#include "tuning.h"
 #include "visualization.h"
 
 #define DEFAULT_AUDIO_SOURCE       AUDIO_SOURCE_LINE_IN
+#define DEFAULT_AUDIO_ENGINE       AUDIO_ENGINE_FFT
 #define DEFAULT_VISUALIZATION_TYPE VISUALIZATION_TYPE_BARS
+#define BOOT_TARGET_MS             500 // Time from reset to the first frame shown, checked on every boot
 
+// Analysis of frame N + 1 on core 0 runs in parallel with rendering of frame N on core 1.
+// Band vectors are handed over through a lock-free exchange (see `pipeline.h`).
 TaskHandle_t controlerTaskHandle;
+TaskHandle_t analysisTaskHandle;
 TaskHandle_t executorTaskHandle;
 void controlerTask(void *pvParameters);
+void analysisTask(void *pvParameters);
 void executorTask(void *pvParameters);
 
 typedef enum {
     set_audio_source,
+    set_audio_signal,
+    set_audio_engine,
+    set_audio_capture_config,
+    set_audio_sampling_rate,
+    set_audio_channel_mode,
+    set_audio_band_count,
+    set_audio_tuning,
+    print_latency_report,
+    print_pipeline_report,
+    print_stats_report,
+    set_stats_period,
+    set_mirror_enabled,
+    print_mirror_report,
+    print_power_report,
+    set_power_scaling,
+    set_scheduler_policy,
+    clear_settings,
+    dump_recorder,
+    set_recorder_trigger,
     set_visualization_type,
     set_visualization_palette,
 } CommandType;
@@ -26,26 +64,84 @@ typedef struct {
     CommandType type;
     union {
         AudioSource audioSource;
+        SyntheticSignal audioSignal;
+        AudioEngine audioEngine;
+        AudioCaptureConfig audioCaptureConfig;
+        int audioSamplingRate;
+        AudioChannelMode audioChannelMode;
+        int audioBandCount;
+        TuningChoice tuning;
         VisualizationType visualizationType;
         VisualizationPalette visualizationPalette;
+        bool mirrorEnabled;
+        bool powerScalingEnabled;
+        SchedulerPolicy schedulerPolicy;
+        unsigned long statsPeriod;
+        unsigned long recorderTrigger;
     } data;
 } Command;
-QueueHandle_t commandQueue = NULL;
+QueueHandle_t audioCommandQueue = NULL;         // Commands for the analysis task
+QueueHandle_t visualizationCommandQueue = NULL; // Commands for the executor task
+
+/**
+ * @brief Sends the command to the task responsible for it.
+ *
+ * @param command Command to send.
+ */
+static void sendCommand(const Command *command) {
+    bool isAudioCommand = command->type == set_audio_source ||
+                          command->type == set_audio_signal ||
+                          command->type == set_audio_engine ||
+                          command->type == set_audio_capture_config ||
+                          command->type == set_audio_sampling_rate ||
+                          command->type == set_audio_channel_mode ||
+                          command->type == set_audio_band_count ||
+                          command->type == set_audio_tuning;
+    QueueHandle_t queue = isAudioCommand ? audioCommandQueue : visualizationCommandQueue;
+    xQueueSendToBack(queue, command, pdMS_TO_TICKS(200));
+}
 
 void setup() {
 #ifdef DEBUG
+    Serial.setTxBufferSize(MIRROR_TX_BUFFER_SIZE); // Must be set before `begin`
     Serial.begin(115200);
     delayMicroseconds(500);
 #endif
+    setupConsole();
 
-    commandQueue = xQueueCreate(32, sizeof(Command));
-    if (commandQueue == NULL) {
+    audioCommandQueue = xQueueCreate(16, sizeof(Command));
+    visualizationCommandQueue = xQueueCreate(16, sizeof(Command));
+    if (audioCommandQueue == NULL || visualizationCommandQueue == NULL) {
         PRINTF("Error creating command queue. Likely due to memory. Halt!\n");
         while (true) continue;
     }
+    registerStatsQueue(audioCommandQueue, "audio");
+    registerStatsQueue(visualizationCommandQueue, "visualization");
+
+    Settings defaults = {DEFAULT_AUDIO_SOURCE, DEFAULT_VISUALIZATION_TYPE, 0, {0.0}, {0}};
+    setupSettings(&defaults);
+
+    // Audio buffers are allocated here, before the tasks start, so that the arena is only
+    // used by the executor task afterwards. Costs of FFT sizes are measured for auto-tuning,
+    // unless this build already measured them on a previous boot.
+    AudioCalibration audioCalibration;
+    if (loadAudioCalibration(&audioCalibration)) {
+        setupAudioProcessing(false);
+        setAudioCalibration(&audioCalibration);
+    } else {
+        setupAudioProcessing(true);
+        getAudioCalibration(&audioCalibration);
+        saveAudioCalibration(&audioCalibration);
+    }
+    setupPower();
+
+    xTaskCreatePinnedToCore(executorTask, "executorTask", 8192, NULL, SCHEDULER_RENDER_PRIORITY, &executorTaskHandle, 1);
+    xTaskCreatePinnedToCore(analysisTask, "analysisTask", 8192, NULL, SCHEDULER_ANALYSIS_PRIORITY, &analysisTaskHandle, 0);
+    xTaskCreatePinnedToCore(controlerTask, "controlerTask", 8192, NULL, SCHEDULER_CONTROL_PRIORITY, &controlerTaskHandle, 0);
 
-    xTaskCreatePinnedToCore(executorTask, "executorTask", 8192, NULL, tskIDLE_PRIORITY, &executorTaskHandle, 1);
-    xTaskCreatePinnedToCore(controlerTask, "controlerTask", 8192, NULL, tskIDLE_PRIORITY, &controlerTaskHandle, 0);
+    registerStatsTask(analysisTaskHandle);
+    registerStatsTask(executorTaskHandle);
+    registerStatsTask(controlerTaskHandle);
 }
 
 void loop() { vTaskDelete(NULL); } // Get rid of the Arduino main loop
@@ -54,101 +150,354 @@ void loop() { vTaskDelete(NULL); } // Get rid of the Arduino main loop
 #define VISUALIZATION_TYPE_BUTTON_PIN    14
 #define VISUALIZATION_PALETTE_BUTTON_PIN 13
 
+#define SERIAL_COMMAND_MAX_LENGTH 32
+
+/**
+ * @brief Collects characters available on the serial port into a line buffer.
+ *
+ * @param line Buffer of `SERIAL_COMMAND_MAX_LENGTH` characters for the line being read.
+ * @param length Pointer to the number of characters already collected.
+ *
+ * @return `true` if a complete, null-terminated line is available in `line`, `false` otherwise.
+ */
+static bool readSerialLine(char *line, int *length) {
+    while (Serial.available() > 0) {
+        char c = Serial.read();
+        if (c == '\r') continue;
+        if (c == '\n') {
+            line[*length] = '\0';
+            *length = 0;
+            return true;
+        }
+        if (*length < SERIAL_COMMAND_MAX_LENGTH - 1) {
+            line[(*length)++] = c;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Translates a serial console line into a command.
+ *
+ * @param line Null-terminated line read from the serial port.
+ * @param command Pointer to the command to fill.
+ *
+ * @return `true` if the line is a valid command, `false` otherwise.
+ */
+static bool parseSerialCommand(const char *line, Command *command) {
+    if (strcmp(line, "engine fft") == 0) {
+        command->type = set_audio_engine;
+        command->data.audioEngine = AUDIO_ENGINE_FFT;
+        return true;
+    }
+    if (strcmp(line, "engine filterbank") == 0) {
+        command->type = set_audio_engine;
+        command->data.audioEngine = AUDIO_ENGINE_FILTERBANK;
+        return true;
+    }
+    AudioCaptureConfig config;
+    if (sscanf(line, "capture %d %d %d", &config.dmaBufCount, &config.dmaBufLen, &config.readChunk) == 3) {
+        command->type = set_audio_capture_config;
+        command->data.audioCaptureConfig = config;
+        return true;
+    }
+    int samplingRate;
+    if (sscanf(line, "rate %d", &samplingRate) == 1) {
+        command->type = set_audio_sampling_rate;
+        command->data.audioSamplingRate = samplingRate;
+        return true;
+    }
+    int bandCount;
+    if (sscanf(line, "bands %d", &bandCount) == 1) {
+        command->type = set_audio_band_count;
+        command->data.audioBandCount = bandCount;
+        return true;
+    }
+    static const char *audioSources[] = {"source mic", "source line", "source synthetic"};
+    for (int source = 0; source <= AUDIO_SOURCE_TYPE_MAX_VALUE; source++) {
+        if (strcmp(line, audioSources[source]) == 0) {
+            command->type = set_audio_source;
+            command->data.audioSource = source;
+            return true;
+        }
+    }
+    static const char *audioSignals[] = {"signal sweep", "signal noise", "signal impulses", "signal silence"};
+    for (int signal = 0; signal <= SYNTHETIC_SIGNAL_MAX_VALUE; signal++) {
+        if (strcmp(line, audioSignals[signal]) == 0) {
+            command->type = set_audio_signal;
+            command->data.audioSignal = signal;
+            return true;
+        }
+    }
+    static const char *channelModes[] = {"channels mono", "channels stereo", "channels midside"};
+    for (int mode = 0; mode <= AUDIO_CHANNELS_MAX_VALUE; mode++) {
+        if (strcmp(line, channelModes[mode]) == 0) {
+            command->type = set_audio_channel_mode;
+            command->data.audioChannelMode = mode;
+            return true;
+        }
+    }
+    if (strcmp(line, "latency") == 0) {
+        command->type = print_latency_report;
+        return true;
+    }
+    if (strcmp(line, "pipeline") == 0) {
+        command->type = print_pipeline_report;
+        return true;
+    }
+    if (strcmp(line, "mirror on") == 0 || strcmp(line, "mirror off") == 0) {
+        command->type = set_mirror_enabled;
+        command->data.mirrorEnabled = strcmp(line, "mirror on") == 0;
+        return true;
+    }
+    unsigned long statsPeriod;
+    if (sscanf(line, "stats %lu", &statsPeriod) == 1) {
+        command->type = set_stats_period;
+        command->data.statsPeriod = statsPeriod * 1000;
+        return true;
+    }
+    if (strcmp(line, "stats") == 0) {
+        command->type = print_stats_report;
+        return true;
+    }
+    if (strcmp(line, "mirror") == 0) {
+        command->type = print_mirror_report;
+        return true;
+    }
+    if (strcmp(line, "power on") == 0 || strcmp(line, "power off") == 0) {
+        command->type = set_power_scaling;
+        command->data.powerScalingEnabled = strcmp(line, "power on") == 0;
+        return true;
+    }
+    unsigned long recorderTrigger;
+    if (sscanf(line, "recorder trigger %lu", &recorderTrigger) == 1) {
+        command->type = set_recorder_trigger;
+        command->data.recorderTrigger = recorderTrigger;
+        return true;
+    }
+    if (strcmp(line, "recorder") == 0) {
+        command->type = dump_recorder;
+        return true;
+    }
+    if (strcmp(line, "settings clear") == 0) {
+        command->type = clear_settings;
+        return true;
+    }
+    if (strcmp(line, "power") == 0) {
+        command->type = print_power_report;
+        return true;
+    }
+    static const char *schedulerPolicies[] = {"deadline all", "deadline blur", "deadline drop"};
+    for (int policy = 0; policy <= SCHEDULER_POLICY_MAX_VALUE; policy++) {
+        if (strcmp(line, schedulerPolicies[policy]) == 0) {
+            command->type = set_scheduler_policy;
+            command->data.schedulerPolicy = policy;
+            return true;
+        }
+    }
+    return false;
+}
+
 void controlerTask(void *pvParameters) {
     ButtonDebounceState audioSourceBtnState;
     ButtonDebounceState visualizationTypeBtnState;
     ButtonDebounceState visualizationPaletteBtnState;
 
-    AudioSource audioSource = DEFAULT_AUDIO_SOURCE;
-    VisualizationType visualizationType = DEFAULT_VISUALIZATION_TYPE;
-    VisualizationPalette visualizationPalette = 0;
+    Settings settings;
+    getSettings(&settings);
+    AudioSource audioSource = settings.audioSource;
+    VisualizationType visualizationType = settings.visualizationType;
+    VisualizationPalette visualizationPalette = settings.visualizationPalette;
 
     pinMode(AUDIO_SOURCE_BUTTON_PIN, INPUT_PULLUP);
     pinMode(VISUALIZATION_TYPE_BUTTON_PIN, INPUT_PULLUP);
     pinMode(VISUALIZATION_PALETTE_BUTTON_PIN, INPUT_PULLUP);
 
+#ifdef DEBUG
+    char serialLine[SERIAL_COMMAND_MAX_LENGTH];
+    int serialLineLength = 0;
+#endif
+
     while (true) {
         if (debouncedRelease(&audioSourceBtnState, digitalRead(AUDIO_SOURCE_BUTTON_PIN))) {
             audioSource++;
-            audioSource %= AUDIO_SOURCE_TYPE_MAX_VALUE + 1;
+            audioSource %= AUDIO_SOURCE_HARDWARE_MAX_VALUE + 1; // Synthetic source is only selected over serial
             Command command = {
                 .type = set_audio_source,
                 .data = {.audioSource = audioSource},
             };
-            xQueueSendToBack(commandQueue, &command, pdMS_TO_TICKS(200));
+            sendCommand(&command);
         }
 
         if (debouncedRelease(&visualizationTypeBtnState, digitalRead(VISUALIZATION_TYPE_BUTTON_PIN))) {
             visualizationType++;
-            visualizationType %= VISUALIZATION_TYPE_MAX_VALUE + 1;
+            visualizationType %= getVisualizationCount();
             visualizationPalette = 0;
             Command command = {
                 .type = set_visualization_type,
                 .data = {.visualizationType = visualizationType},
             };
-            xQueueSendToBack(commandQueue, &command, pdMS_TO_TICKS(200));
+            sendCommand(&command);
         }
 
         if (debouncedRelease(&visualizationPaletteBtnState, digitalRead(VISUALIZATION_PALETTE_BUTTON_PIN))) {
-            int maxValue;
-            switch (visualizationType) {
-                case VISUALIZATION_TYPE_BARS:
-                    maxValue = VISUALIZATION_PALETTE_BARS_MAX_VALUE;
-                    break;
-                case VISUALIZATION_TYPE_SPECTRUM:
-                    maxValue = VISUALIZATION_PALETTE_SPECTRUM_MAX_VALUE;
-                    break;
-                case VISUALIZATION_TYPE_FIRE:
-                    maxValue = VISUALIZATION_PALETTE_FIRE_MAX_VALUE;
-                    break;
-            }
-
             visualizationPalette++;
-            visualizationPalette %= maxValue + 1;
+            visualizationPalette %= getVisualizationPaletteCount(visualizationType);
             Command command = {
                 .type = set_visualization_palette,
                 .data = {.visualizationPalette = visualizationPalette},
             };
-            xQueueSendToBack(commandQueue, &command, pdMS_TO_TICKS(200));
+            sendCommand(&command);
         }
 
+#ifdef DEBUG
+        if (readSerialLine(serialLine, &serialLineLength)) {
+            // Statistics are sampled, settings are written and the recorder is dumped by this task, so their commands are handled here
+            Command command;
+            if (!parseSerialCommand(serialLine, &command)) {
+                PRINTF("Unknown command: %s\n", serialLine);
+            } else if (command.type == print_stats_report) {
+                printStatsReport();
+            } else if (command.type == set_stats_period) {
+                setStatsPeriod(command.data.statsPeriod);
+            } else if (command.type == clear_settings) {
+                clearSettings();
+            } else if (command.type == dump_recorder) {
+                dumpRecorder();
+            } else if (command.type == set_recorder_trigger) {
+                setRecorderTrigger(command.data.recorderTrigger);
+            } else {
+                sendCommand(&command);
+            }
+        }
+#endif
+
+        sampleStats();
+        flushSettings();
+        if (isRecorderTriggered()) dumpRecorder();
         delay(5);
     }
 }
 
-void executorTask(void *pvParameters) {
-    __attribute__((aligned(16))) float audioBands[AUDIO_N_BANDS] = {0.0};
-    setupAudioSource(DEFAULT_AUDIO_SOURCE);
-    setupAudioTables(DEFAULT_AUDIO_SOURCE);
-    resetAudioBandScale(DEFAULT_AUDIO_SOURCE);
-    setupAudioProcessing();
+/**
+ * @brief Returns `true` if bands are computed as they are by default, the only configuration whose
+ * band scale is stored in settings. Other engines, rates or channel modes have different levels.
+ *
+ * @param audioSource Active audio source.
+ */
+static bool isDefaultAudioConfig(AudioSource audioSource) {
+    return audioSource <= AUDIO_SOURCE_HARDWARE_MAX_VALUE &&
+           getAudioEngine() == DEFAULT_AUDIO_ENGINE &&
+           getAudioSamplingRate() == AUDIO_SAMPLING_RATE &&
+           getAudioChannelMode() == AUDIO_CHANNELS_MONO;
+}
 
-    setupLedStrip();
-    setupVisualization(DEFAULT_VISUALIZATION_TYPE);
-    setVisualizationPalette(0);
+/**
+ * @brief Restores the band scale stored for the source, or adapts it again if none matches the configuration.
+ *
+ * @param audioSource Active audio source.
+ */
+static void restoreBandScale(AudioSource audioSource) {
+    Settings settings;
+    getSettings(&settings);
+    if (isDefaultAudioConfig(audioSource) &&
+        settings.bandScales[audioSource] > 0.0 &&
+        settings.bandScaleCounts[audioSource] == getAudioBandCount()) {
+        setAudioBandScale(settings.bandScales[audioSource]);
+    } else {
+        resetAudioBandScale(audioSource);
+    }
+}
+
+/**
+ * @brief Changes the number of bands computed by the analysis, if it is different.
+ *
+ * Tables are derived for the new bands, whose levels are different, so the scale is adapted again.
+ *
+ * @param count Number of bands.
+ * @param audioSource Active audio source.
+ */
+static void applyBandCount(int count, AudioSource audioSource) {
+    if (count == getAudioBandCount()) return;
+    setAudioBandCount(count);
+    setupAudioTables(audioSource);
+    restoreBandScale(audioSource);
+}
+
+void analysisTask(void *pvParameters) {
+    __attribute__((aligned(16))) BandFrame frame;
+    Settings settings;
+    getSettings(&settings);
+    AudioSource audioSource = settings.audioSource;
+    setAudioEngine(DEFAULT_AUDIO_ENGINE);
+    setupAudioSource(audioSource);
+    setupAudioTables(audioSource);
+    restoreBandScale(audioSource);
+    setupTempo();
 
     Command command;
     while (true) {
-        while (xQueueReceive(commandQueue, &command, 0) == pdPASS) {
+        while (xQueueReceive(audioCommandQueue, &command, 0) == pdPASS) {
+            recordEvent(RECORDER_EVENT_COMMAND, command.type);
             switch (command.type) {
                 case set_audio_source:
                     teardownAudioSource();
                     setupAudioSource(command.data.audioSource);
                     setupAudioTables(command.data.audioSource);
-                    resetAudioBandScale(command.data.audioSource);
+                    restoreBandScale(command.data.audioSource);
+                    setSettingsAudioSource(command.data.audioSource);
+                    recordEvent(RECORDER_EVENT_AUDIO_SOURCE, command.data.audioSource);
+                    audioSource = command.data.audioSource;
                     break;
-                case set_visualization_type:
-                    teardownVisualization();
-                    setupVisualization(command.data.visualizationType);
-                    setVisualizationPalette(0);
+                case set_audio_signal:
+                    setSyntheticSignal(command.data.audioSignal);
                     break;
-                case set_visualization_palette:
-                    setVisualizationPalette(command.data.visualizationPalette);
+                case set_audio_engine:
+                    setAudioEngine(command.data.audioEngine);
+                    setupAudioTables(audioSource);
+                    restoreBandScale(audioSource);
+                    break;
+                case set_audio_capture_config:
+                    setAudioCaptureConfig(command.data.audioCaptureConfig);
+                    teardownAudioSource();
+                    setupAudioSource(audioSource);
+                    break;
+                case set_audio_sampling_rate:
+                    teardownAudioSource();
+                    setAudioSamplingRate(command.data.audioSamplingRate);
+                    setupAudioSource(audioSource);
+                    setupAudioTables(audioSource);
+                    restoreBandScale(audioSource);
+                    break;
+                case set_audio_channel_mode:
+                    // Folded bands have different levels, so the scale is adapted again
+                    setAudioChannelMode(command.data.audioChannelMode);
+                    restoreBandScale(audioSource);
+                    break;
+                case set_audio_band_count:
+                    // Kept until the next visualization is tuned
+                    applyBandCount(command.data.audioBandCount, audioSource);
+                    break;
+                case set_audio_tuning: {
+                    // Only the read chunk changes, so the I2S driver is kept
+                    setAudioFftSize(command.data.tuning.fftSize);
+                    applyBandCount(command.data.tuning.nBands, audioSource);
+                    AudioCaptureConfig config = getAudioCaptureConfig();
+                    config.readChunk = command.data.tuning.hop;
+                    setAudioCaptureConfig(config);
+                    break;
+                }
+                default:
                     break;
             }
         }
 
         readAudioDataToBuffer();
+        beginPowerWork(PIPELINE_STAGE_ANALYSIS);
+        unsigned long timeStart = micros();
+        frame.captureTime = getAudioCaptureTimestamp();
+        frame.readTime = timeStart;
+        frame.period = (unsigned long)((uint64_t)getAudioBufferLength() * 1000000 / getAudioSamplingRate());
 
         // //
         // // min-max for testing
@@ -170,10 +519,181 @@ void executorTask(void *pvParameters) {
         // //
         // //
 
-        processAudioData(audioBands);
-        scaleAudioData(audioBands);
+        processAudioData(frame.bands);
+        scaleAudioData(frame.bands);
+        frame.nBands = getAudioBandCount();
+        frame.silent = isAudioSilent();
+        frame.bandScale = getAudioBandScale();
+        // Scale only adapts to sound, so the one reached before a power cycle is kept
+        if (!frame.silent && isDefaultAudioConfig(audioSource)) {
+            setSettingsBandScale(audioSource, frame.nBands, frame.bandScale);
+        }
+        updateTempo(frame.bands, frame.nBands, frame.period, &frame.tempo);
+        frame.analysisTime = micros();
+
+        publishBandFrame(&frame);
+        xTaskNotifyGive(executorTaskHandle);
+        addPipelineBusyTime(PIPELINE_STAGE_ANALYSIS, micros() - timeStart);
+        endPowerWork(PIPELINE_STAGE_ANALYSIS);
+    }
+}
+
+/**
+ * @brief Selects analysis and render settings for the visualization from cached measurements and applies them.
+ *
+ * Blur radius is applied directly, audio settings are sent to the analysis task.
+ *
+ * @param visualization The type of visualization that will be rendered.
+ */
+static void applyTuning(VisualizationType visualization) {
+    TuningChoice choice = selectTuning(visualization);
+    setVisualizationBlurRadius(choice.blurRadius);
+
+    Command command = {
+        .type = set_audio_tuning,
+        .data = {.tuning = choice},
+    };
+    sendCommand(&command);
+}
+
+void executorTask(void *pvParameters) {
+    __attribute__((aligned(16))) BandFrame frame;
+    Settings settings;
+    getSettings(&settings);
+    VisualizationType visualizationType = settings.visualizationType;
+    bool wasSilent = false;
+    bool booted = false;
+
+    setupLedStrip();
+    VisualizationCalibration calibration;
+    if (loadVisualizationCalibration(&calibration)) {
+        setVisualizationCalibration(&calibration);
+    } else {
+        calibrateVisualizations();
+        getVisualizationCalibration(&calibration);
+        saveVisualizationCalibration(&calibration);
+    }
+    setupVisualization(visualizationType);
+    setVisualizationPalette(settings.visualizationPalette);
+    applyTuning(visualizationType);
+    printArenaReport();
+
+    Command command;
+    while (true) {
+        while (xQueueReceive(visualizationCommandQueue, &command, 0) == pdPASS) {
+            recordEvent(RECORDER_EVENT_COMMAND, command.type);
+            switch (command.type) {
+                case print_latency_report:
+                    printLatencyReport();
+                    break;
+                case print_pipeline_report:
+                    printPipelineReport();
+                    break;
+                case set_mirror_enabled:
+                    setMirrorEnabled(command.data.mirrorEnabled);
+                    break;
+                case print_mirror_report:
+                    printMirrorReport();
+                    break;
+                case print_power_report:
+                    printPowerReport();
+                    break;
+                case set_power_scaling:
+                    setPowerScalingEnabled(command.data.powerScalingEnabled);
+                    break;
+                case set_scheduler_policy:
+                    setSchedulerPolicy(command.data.schedulerPolicy);
+                    break;
+                case set_visualization_type:
+                    // Transition frames render two visualizations
+                    boostPower();
+                    transitionVisualization(command.data.visualizationType);
+                    recordEvent(RECORDER_EVENT_VISUALIZATION, command.data.visualizationType);
+                    applyTuning(command.data.visualizationType);
+                    visualizationType = command.data.visualizationType;
+                    setSettingsVisualization(visualizationType, 0);
+                    break;
+                case set_visualization_palette:
+                    boostPower();
+                    setVisualizationPalette(command.data.visualizationPalette);
+                    setSettingsVisualization(visualizationType, command.data.visualizationPalette);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // Wait for the analysis task, but wake up periodically to handle commands
+        if (!acquireBandFrame(&frame)) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        unsigned long analysisBusyTime = frame.analysisTime - frame.readTime;
+
+        // Analysis gets heavy at once when the silence gate opens
+        if (wasSilent && !frame.silent) boostPower();
+        wasSilent = frame.silent;
+
+        // Once the visualization has decayed on silence, the display is left as it is
+        if (frame.silent && isVisualizationDecayed()) {
+            addStatsSilenceFrame(PIPELINE_STAGE_RENDER, getVisualizationCost(visualizationType, getVisualizationBlurRadius()));
+            unsigned long now = micros();
+            recordFrame(&frame, FRAME_ACTION_RENDER, false, false, now, now);
+            updatePowerGovernor(frame.period, analysisBusyTime, false);
+            continue;
+        }
+        beginPowerWork(PIPELINE_STAGE_RENDER);
+        unsigned long timeStart = micros();
+
+        int blurRadius = getVisualizationBlurRadius();
+        FrameAction action = planFrame(&frame, timeStart, getVisualizationCost(visualizationType, blurRadius), getVisualizationCost(visualizationType, 0));
+        setVisualizationTempo(&frame.tempo);
+        if (action == FRAME_ACTION_DROP) {
+            unsigned long timeEnd = micros();
+            completeFrame(&frame, action, timeEnd);
+            recordFrame(&frame, action, false, false, timeStart, timeEnd);
+            addPipelineBusyTime(PIPELINE_STAGE_RENDER, timeEnd - timeStart);
+            endPowerWork(PIPELINE_STAGE_RENDER);
+            updatePowerGovernor(frame.period, analysisBusyTime, true);
+            continue;
+        }
 
-        updateVisualization(audioBands);
+        beginLatencyFrame(frame.captureTime);
+        markLatencyStageAt(LATENCY_STAGE_CAPTURE, frame.readTime);
+        markLatencyStageAt(LATENCY_STAGE_ANALYSIS, frame.analysisTime);
+
+        // Blur is only disabled for this frame, the tuned radius stays selected
+        if (action == FRAME_ACTION_SKIP_BLUR) setVisualizationBlurRadius(0);
+        if (frame.silent) {
+            decayVisualization();
+        } else {
+            updateVisualization(frame.bands, frame.nBands);
+        }
+        setVisualizationBlurRadius(blurRadius);
+        markLatencyStage(LATENCY_STAGE_RENDER);
         showVisualization();
+        markLatencyStage(LATENCY_STAGE_SHOW);
+        if (!booted) {
+            // Time spent in the bootloader before the application starts is not included
+            unsigned long bootTime = millis();
+            PRINTF("Boot: first frame after %lums, target %dms%s\n", bootTime, BOOT_TARGET_MS, bootTime > BOOT_TARGET_MS ? ", too slow!" : "");
+            booted = true;
+        }
+        endLatencyFrame();
+
+        const uint8_t *color, *brightness, *palette;
+        if (isMirrorEnabled() && getVisualizationFrame(&color, &brightness, &palette)) {
+            sendMirrorFrame(color, brightness, palette);
+        }
+
+        unsigned long timeEnd = micros();
+        addPipelineBusyTime(PIPELINE_STAGE_RENDER, timeEnd - timeStart);
+        endPowerWork(PIPELINE_STAGE_RENDER);
+
+        unsigned long renderBusyTime = timeEnd - timeStart;
+        bool missed = completeFrame(&frame, action, timeEnd);
+        recordFrame(&frame, action, true, missed, timeStart, timeEnd);
+        updatePowerGovernor(frame.period, renderBusyTime > analysisBusyTime ? renderBusyTime : analysisBusyTime, missed);
     }
 }
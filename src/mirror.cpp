@@ -0,0 +1,178 @@
+#include "mirror.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#define DEBUG
+
+#include "console.h"
+#include "macros.h"
+#include "visualization.h"
+
+#define MAGIC_0 0xA5
+#define MAGIC_1 0x5A
+
+#define FLAG_KEYFRAME   0x01
+#define FLAG_PALETTE    0x02
+#define FLAG_BRIGHTNESS 0x04
+
+#define PALETTE_SIZE 48
+#define HEADER_SIZE  5
+
+// Worst case of `encodePlane`: every value, plus a run header per 255 values and for the first run
+#define MAX_PLANE_BYTES    (LED_MATRIX_N + 2 * (LED_MATRIX_N / 255 + 2))
+#define MAX_KEYFRAME_BYTES (PALETTE_SIZE + 2 * MAX_PLANE_BYTES)
+static_assert(MAX_KEYFRAME_BYTES >= MIRROR_MAX_BYTES_PER_FRAME, "Keyframes must not have a smaller budget than delta frames");
+static_assert(HEADER_SIZE + MAX_KEYFRAME_BYTES + 1 <= MIRROR_TX_BUFFER_SIZE, "Full keyframe doesn't fit in the serial transmit buffer");
+static_assert(MAX_KEYFRAME_BYTES <= 0xFFFF, "Full keyframe doesn't fit in the packet length");
+
+static bool enabled = false;
+static bool keyframePending = true;
+static int framesSinceKeyframe = 0;
+
+// Last frame that was sent, which the host also has
+static uint8_t referenceColor[LED_MATRIX_N];
+static uint8_t referenceBrightness[LED_MATRIX_N];
+static uint8_t referencePalette[PALETTE_SIZE];
+
+static uint8_t packet[HEADER_SIZE + MAX_KEYFRAME_BYTES + 1];
+
+static uint32_t nSent = 0;
+static uint32_t nSkipped = 0;
+static uint32_t nBytes = 0;
+static unsigned long encodeTime = 0;
+
+void setMirrorEnabled(bool value) {
+    enabled = value;
+    keyframePending = true;
+}
+
+bool isMirrorEnabled() {
+    return enabled;
+}
+
+/**
+ * @brief Encodes a plane as runs of unchanged and changed values against the reference.
+ *
+ * @return Number of bytes written, or -1 if the plane doesn't fit.
+ */
+static int encodePlane(const uint8_t *plane, const uint8_t *reference, uint8_t *out, int capacity) {
+    int length = 0;
+    int i = 0;
+    while (i < LED_MATRIX_N) {
+        int unchanged = 0;
+        while (i < LED_MATRIX_N && unchanged < 255 && plane[i] == reference[i]) {
+            unchanged++;
+            i++;
+        }
+
+        // Changed run ends at two unchanged values in a row, a single one is cheaper to send as is
+        int start = i;
+        int changed = 0;
+        while (i < LED_MATRIX_N && changed < 255) {
+            bool same = plane[i] == reference[i];
+            bool nextSame = i + 1 >= LED_MATRIX_N || plane[i + 1] == reference[i + 1];
+            if (same && nextSame) break;
+            changed++;
+            i++;
+        }
+
+        if (length + 2 + changed > capacity) return -1;
+        out[length++] = unchanged;
+        out[length++] = changed;
+        memcpy(out + length, plane + start, changed);
+        length += changed;
+    }
+    return length;
+}
+
+void sendMirrorFrame(const uint8_t *color, const uint8_t *brightness, const uint8_t *palette) {
+    if (!enabled) return;
+    unsigned long timeStart = micros();
+
+    bool keyframe = keyframePending || framesSinceKeyframe >= MIRROR_KEYFRAME_INTERVAL;
+    if (keyframe) {
+        memset(referenceColor, 0, sizeof(referenceColor));
+        memset(referenceBrightness, 0, sizeof(referenceBrightness));
+        memset(referencePalette, 0, sizeof(referencePalette));
+    }
+
+    // Keyframes are encoded against zero, so a frame with every LED lit needs whole planes
+    int capacity = keyframe ? MAX_KEYFRAME_BYTES : MIRROR_MAX_BYTES_PER_FRAME;
+    uint8_t flags = keyframe ? FLAG_KEYFRAME : 0;
+    uint8_t *payload = packet + HEADER_SIZE;
+    int length = 0;
+
+    if (keyframe || memcmp(palette, referencePalette, PALETTE_SIZE) != 0) {
+        flags |= FLAG_PALETTE;
+        memcpy(payload, palette, PALETTE_SIZE);
+        length += PALETTE_SIZE;
+    }
+
+    int planeLength = encodePlane(color, referenceColor, payload + length, capacity - length);
+    if (planeLength >= 0) {
+        length += planeLength;
+        if (brightness != NULL) {
+            flags |= FLAG_BRIGHTNESS;
+            planeLength = encodePlane(brightness, referenceBrightness, payload + length, capacity - length);
+            length += planeLength;
+        }
+    }
+
+    // Render stage doesn't wait for the console, e.g. while the recorder is dumped. Space is checked
+    // under the lock, so that text written in between can't make the write block.
+    int packetLength = HEADER_SIZE + length + 1;
+    bool locked = planeLength >= 0 && lockConsole(0);
+    if (!locked || Serial.availableForWrite() < packetLength) {
+        if (locked) unlockConsole();
+        // Reference stays at the last sent frame, so the next frame is still decodable.
+        // A skipped keyframe was already applied to the reference, so it has to be retried.
+        keyframePending = keyframe;
+        nSkipped++;
+        encodeTime += micros() - timeStart;
+        return;
+    }
+
+    packet[0] = MAGIC_0;
+    packet[1] = MAGIC_1;
+    packet[2] = flags;
+    packet[3] = length & 0xFF;
+    packet[4] = length >> 8;
+    uint8_t checksum = 0;
+    for (int i = 0; i < length; i++) {
+        checksum ^= payload[i];
+    }
+    packet[HEADER_SIZE + length] = checksum;
+    Serial.write(packet, packetLength);
+    unlockConsole();
+
+    memcpy(referenceColor, color, LED_MATRIX_N);
+    if (brightness != NULL) {
+        memcpy(referenceBrightness, brightness, LED_MATRIX_N);
+    } else {
+        memset(referenceBrightness, 255, LED_MATRIX_N);
+    }
+    memcpy(referencePalette, palette, PALETTE_SIZE);
+
+    keyframePending = false;
+    framesSinceKeyframe = keyframe ? 0 : framesSinceKeyframe + 1;
+    nSent++;
+    nBytes += packetLength;
+    encodeTime += micros() - timeStart;
+}
+
+void printMirrorReport() {
+    uint32_t nFrames = nSent + nSkipped;
+    PRINTF(
+        "Mirror %s: %u sent, %u skipped, %.1f bytes per sent frame, %.1fus per frame\n",
+        enabled ? "on" : "off",
+        (unsigned)nSent,
+        (unsigned)nSkipped,
+        nSent > 0 ? float(nBytes) / nSent : 0.0,
+        nFrames > 0 ? float(encodeTime) / nFrames : 0.0
+    );
+    nSent = 0;
+    nSkipped = 0;
+    nBytes = 0;
+    encodeTime = 0;
+}
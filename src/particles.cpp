@@ -0,0 +1,61 @@
+#include "particles.h"
+
+#include "arena.h"
+#include "placement.h"
+
+static_assert(PARTICLE_SIZE == sizeof(uint16_t) + sizeof(int16_t) + sizeof(uint8_t) + sizeof(uint8_t), "PARTICLE_SIZE out of date");
+
+void setupParticlePool(ParticlePool *pool, int capacity, const char *tag) {
+    pool->y = (uint16_t *)arenaAllocate(sizeof(uint16_t) * capacity, tag);
+    pool->vy = (int16_t *)arenaAllocate(sizeof(int16_t) * capacity, tag);
+    pool->x = (uint8_t *)arenaAllocate(sizeof(uint8_t) * capacity, tag);
+    pool->life = (uint8_t *)arenaAllocate(sizeof(uint8_t) * capacity, tag);
+    pool->count = 0;
+    pool->capacity = capacity;
+}
+
+void clearParticles(ParticlePool *pool) {
+    pool->count = 0;
+}
+
+bool spawnParticle(ParticlePool *pool, uint8_t x, uint16_t y, int16_t vy, uint8_t life) {
+    if (pool->count == pool->capacity) return false;
+
+    int i = pool->count++;
+    pool->y[i] = y;
+    pool->vy[i] = vy;
+    pool->x[i] = x;
+    pool->life[i] = life;
+    return true;
+}
+
+void killParticle(ParticlePool *pool, int index) {
+    int last = --pool->count;
+    pool->y[index] = pool->y[last];
+    pool->vy[index] = pool->vy[last];
+    pool->x[index] = pool->x[last];
+    pool->life[index] = pool->life[last];
+}
+
+HOT_CODE void stepParticles(ParticlePool *pool, int16_t gravity, uint8_t decay, int nRows) {
+    const int32_t top = nRows << PARTICLE_FIXED_SHIFT;
+
+    // Walking backwards, the particle moved into a killed one's place has already been stepped
+    for (int i = pool->count - 1; i >= 0; i--) {
+        int32_t y = pool->y[i] + pool->vy[i];
+        if (pool->life[i] <= decay || y < 0 || y >= top) {
+            killParticle(pool, i);
+            continue;
+        }
+        pool->y[i] = y;
+        pool->vy[i] -= gravity;
+        pool->life[i] -= decay;
+    }
+}
+
+HOT_CODE void drawParticles(const ParticlePool *pool, uint8_t *color, int nRows) {
+    for (int i = 0; i < pool->count; i++) {
+        int k = pool->x[i] * nRows + (pool->y[i] >> PARTICLE_FIXED_SHIFT);
+        color[k] = pool->life[i] > color[k] ? pool->life[i] : color[k];
+    }
+}
@@ -0,0 +1,74 @@
+#include "pipeline.h"
+
+#include <Arduino.h>
+#include <atomic>
+
+#define DEBUG
+
+#include "macros.h"
+
+// Lock-free exchange of band frames between the cores. Besides the frame being written by the
+// producer (back) and the frame being read by the consumer (front), there is a spare slot that
+// holds the latest published frame. Both sides only swap their slot with the spare one, so neither
+// ever waits for the other, and the consumer always gets the newest frame.
+#define SLOT_MASK  0x03
+#define FRESH_FLAG 0x04 // Set when the spare slot holds a frame the consumer did not see yet
+
+static BandFrame slots[3];
+static std::atomic<uint8_t> spareSlot(2);
+static uint8_t backSlot = 0;  // Owned by the producer
+static uint8_t frontSlot = 1; // Owned by the consumer
+
+static uint32_t nextSequence = 0;
+static std::atomic<uint32_t> nPublished(0);
+static std::atomic<uint32_t> nDropped(0);
+
+static std::atomic<uint32_t> busyTimes[PIPELINE_N_STAGES];
+static unsigned long reportTime = 0;
+
+static const char *stageNames[PIPELINE_N_STAGES] = {
+    "analysis",
+    "render",
+};
+
+void publishBandFrame(BandFrame *frame) {
+    frame->sequence = nextSequence++;
+    slots[backSlot] = *frame;
+
+    uint8_t previous = spareSlot.exchange(backSlot | FRESH_FLAG, std::memory_order_acq_rel);
+    backSlot = previous & SLOT_MASK;
+
+    nPublished.fetch_add(1, std::memory_order_relaxed);
+    if (previous & FRESH_FLAG) {
+        nDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool acquireBandFrame(BandFrame *frame) {
+    if (!(spareSlot.load(std::memory_order_acquire) & FRESH_FLAG)) return false;
+
+    uint8_t previous = spareSlot.exchange(frontSlot, std::memory_order_acq_rel);
+    frontSlot = previous & SLOT_MASK;
+
+    *frame = slots[frontSlot];
+    return true;
+}
+
+void addPipelineBusyTime(PipelineStage stage, unsigned long busyTime) {
+    busyTimes[stage].fetch_add(busyTime, std::memory_order_relaxed);
+}
+
+void printPipelineReport() {
+    unsigned long now = micros();
+    float elapsed = now - reportTime;
+    reportTime = now;
+
+    uint32_t published = nPublished.exchange(0);
+    uint32_t dropped = nDropped.exchange(0);
+
+    PRINTF("Pipeline over %.2fs: %u frames published, %u dropped\n", elapsed / 1000000.0, (unsigned)published, (unsigned)dropped);
+    for (int i = 0; i < PIPELINE_N_STAGES; i++) {
+        float busy = busyTimes[i].exchange(0);
+        PRINTF("  %-8s utilization: %5.1f%%\n", stageNames[i], 100.0 * busy / elapsed);
+    }
+}
@@ -0,0 +1,200 @@
+#include "power.h"
+
+#include <Arduino.h>
+#include <cfloat>
+
+#define DEBUG
+
+#include "macros.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// Frequencies that keep APB clock at 80 MHz, so that changing them doesn't disturb peripherals
+static const int levels[] = {POWER_MIN_MHZ, 160, POWER_MAX_MHZ};
+#define N_LEVELS (int)(sizeof(levels) / sizeof(levels[0]))
+
+static bool scalingEnabled = true;
+static int level = N_LEVELS - 1;
+static int holdFrames = 0;      // Frames in a row with headroom at the lower level
+static int boostFramesLeft = 0; // Frames left at the maximum frequency after `boostPower`
+
+static unsigned long reportTime = 0;
+static unsigned long levelTime = 0; // Time up to which `mhzTime` is accounted
+static uint64_t mhzTime = 0;        // Sum of MHz * microseconds since the last report
+static uint32_t nFrames = 0;
+static uint32_t nMissed = 0;
+static uint32_t nLevelChanges = 0;
+
+#ifdef CONFIG_PM_ENABLE
+// Light sleep can only be entered from tickless idle
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define LIGHT_SLEEP true
+#else
+#define LIGHT_SLEEP false
+#endif
+
+// CPU runs at the selected frequency only while at least one stage holds its lock
+static esp_pm_lock_handle_t locks[PIPELINE_N_STAGES];
+static portMUX_TYPE workMux = portMUX_INITIALIZER_UNLOCKED;
+static int nWorking = 0;
+static unsigned long workStart = 0;
+static unsigned long workTime = 0; // Time with at least one stage working, since `levelTime`
+#endif
+
+/**
+ * @brief Adds the time since the last call at the current level to `mhzTime`.
+ */
+static void accountLevelTime() {
+    unsigned long now = micros();
+    unsigned long elapsed = now - levelTime;
+    levelTime = now;
+
+#ifdef CONFIG_PM_ENABLE
+    portENTER_CRITICAL(&workMux);
+    unsigned long busy = workTime;
+    workTime = 0;
+    if (nWorking > 0) {
+        busy += now - workStart;
+        workStart = now;
+    }
+    portEXIT_CRITICAL(&workMux);
+
+    busy = busy > elapsed ? elapsed : busy;
+    mhzTime += (uint64_t)levels[level] * busy + (uint64_t)POWER_MIN_MHZ * (elapsed - busy);
+#else
+    mhzTime += (uint64_t)levels[level] * elapsed;
+#endif
+}
+
+/**
+ * @brief Sets the CPU frequency, or the maximum frequency of dynamic frequency scaling.
+ */
+static void applyFrequency(int mhz) {
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t config = {
+        .max_freq_mhz = mhz,
+        .min_freq_mhz = POWER_MIN_MHZ,
+        .light_sleep_enable = LIGHT_SLEEP,
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK) {
+        PRINTF("Error configuring power management: 0x(%x). Halt!\n", err);
+        while (true) continue;
+    }
+#else
+    setCpuFrequencyMhz(mhz);
+#endif
+}
+
+/**
+ * @brief Switches to the specified level, if it is not the current one.
+ */
+static void setLevel(int k) {
+    if (k == level) return;
+    accountLevelTime();
+    level = k;
+    nLevelChanges++;
+    applyFrequency(levels[k]);
+}
+
+void setupPower() {
+#ifdef CONFIG_PM_ENABLE
+    static const char *lockNames[PIPELINE_N_STAGES] = {"analysis", "render"};
+    for (int i = 0; i < PIPELINE_N_STAGES; i++) {
+        esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, lockNames[i], &locks[i]);
+        if (err != ESP_OK) {
+            PRINTF("Error creating power management lock: 0x(%x). Halt!\n", err);
+            while (true) continue;
+        }
+    }
+#endif
+
+    level = N_LEVELS - 1;
+    applyFrequency(levels[level]);
+    reportTime = levelTime = micros();
+}
+
+void setPowerScalingEnabled(bool enabled) {
+    scalingEnabled = enabled;
+    holdFrames = 0;
+    if (!enabled) setLevel(N_LEVELS - 1);
+}
+
+void beginPowerWork(PipelineStage stage) {
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(locks[stage]);
+
+    portENTER_CRITICAL(&workMux);
+    if (nWorking++ == 0) workStart = micros();
+    portEXIT_CRITICAL(&workMux);
+#endif
+}
+
+void endPowerWork(PipelineStage stage) {
+#ifdef CONFIG_PM_ENABLE
+    portENTER_CRITICAL(&workMux);
+    if (--nWorking == 0) workTime += micros() - workStart;
+    portEXIT_CRITICAL(&workMux);
+
+    esp_pm_lock_release(locks[stage]);
+#endif
+}
+
+void updatePowerGovernor(unsigned long period, unsigned long busyTime, bool missed) {
+    nFrames++;
+    nMissed += missed ? 1 : 0;
+    if (period == 0) return;
+
+    float load = (float)busyTime / period;
+    if (!scalingEnabled || missed || load > POWER_BOOST_LOAD || boostFramesLeft > 0) {
+        boostFramesLeft -= boostFramesLeft > 0 ? 1 : 0;
+        holdFrames = 0;
+        setLevel(N_LEVELS - 1);
+        return;
+    }
+
+    // Assumes that all busy time scales with the clock. Sending data to the LEDs doesn't, so the load
+    // at the lower frequency is overestimated, which errs on the side of the frame rate.
+    float lowerLoad = level > 0 ? load * levels[level] / levels[level - 1] : FLT_MAX;
+    holdFrames = lowerLoad < POWER_TARGET_LOAD ? holdFrames + 1 : 0;
+    if (holdFrames >= POWER_HOLD_FRAMES) {
+        holdFrames = 0;
+        setLevel(level - 1);
+    }
+}
+
+void boostPower() {
+    boostFramesLeft = POWER_BOOST_FRAMES;
+    holdFrames = 0;
+    setLevel(N_LEVELS - 1);
+}
+
+void printPowerReport() {
+    accountLevelTime();
+    float elapsed = levelTime - reportTime;
+    if (elapsed <= 0.0) elapsed = 1.0;
+
+#ifdef CONFIG_PM_ENABLE
+    const char *backend = LIGHT_SLEEP ? "pm locks, light sleep" : "pm locks";
+#else
+    const char *backend = "clock switching";
+#endif
+    PRINTF(
+        "Power: %.1f MHz average, %d MHz now, %u/%u deadline misses, %u level changes (%s%s)\n",
+        mhzTime / elapsed,
+        levels[level],
+        (unsigned)nMissed,
+        (unsigned)nFrames,
+        (unsigned)nLevelChanges,
+        backend,
+        scalingEnabled ? "" : ", scaling off"
+    );
+
+    reportTime = levelTime;
+    mhzTime = 0;
+    nFrames = 0;
+    nMissed = 0;
+    nLevelChanges = 0;
+}
@@ -0,0 +1,207 @@
+#include "recorder.h"
+
+#include <Arduino.h>
+#include <atomic>
+
+#define DEBUG
+
+#include "console.h"
+#include "macros.h"
+#include "placement.h"
+#include "visualization.h"
+
+#define MAGIC_0 0x5A
+#define MAGIC_1 0xA5
+
+#define PACKET_HEADER 0
+#define PACKET_FRAME  1
+#define PACKET_EVENT  2
+#define PACKET_END    3
+
+#define FLAG_SILENT   0x01
+#define FLAG_RENDERED 0x02
+#define FLAG_MISSED   0x04
+
+#define RECORDER_VERSION 1
+#define HEADER_SIZE      5
+
+/**
+ * @brief Frame as it is kept and dumped. Fields are ordered so that there is no padding.
+ */
+typedef struct {
+    uint32_t sequence;
+    uint32_t captureTime;
+    uint32_t readTime;
+    uint32_t analysisTime;
+    uint32_t renderStart;
+    uint32_t renderEnd;
+    float bandScale;
+    uint8_t nBands;
+    uint8_t action;
+    uint8_t flags;
+    uint8_t blurRadius;
+    uint8_t bands[AUDIO_MAX_BANDS];
+} RecordedFrame;
+static_assert(sizeof(RecordedFrame) == 32 + AUDIO_MAX_BANDS, "Recorded frame has padding");
+
+/**
+ * @brief Event as it is kept. `sequence` is cleared before the fields are written and set last, so an
+ * event whose sequence doesn't match its slot, before and after it is copied, is incomplete or was overwritten.
+ */
+typedef struct {
+    uint32_t time;
+    int32_t value;
+    uint8_t type;
+    std::atomic<uint32_t> sequence;
+} RecordedEvent;
+
+static RecordedFrame frames[RECORDER_N_FRAMES];
+static RecordedEvent events[RECORDER_N_EVENTS];
+static std::atomic<uint32_t> nFrames(0); // Frames recorded since boot, the next one goes to `nFrames % RECORDER_N_FRAMES`
+static std::atomic<uint32_t> nEvents(0); // Events reserved since boot
+
+static std::atomic<bool> stopped(false);          // Recording stopped for a dump
+static std::atomic<bool> triggered(false);        // Recording stopped by the trigger, waiting for a dump
+static std::atomic<uint32_t> triggerThreshold(0); // Frame time in microseconds, 0 if disabled, disarmed by the dump it fired
+static int postTriggerFrames = -1;                // Frames left to record after the trigger fired, -1 if it didn't
+
+// Cost of recording, only used by the task that records frames
+static uint32_t recordTime = 0;
+static uint32_t nRecordTimed = 0;
+
+static uint8_t packet[HEADER_SIZE + sizeof(RecordedFrame) + 1];
+
+HOT_CODE void recordFrame(const BandFrame *frame, FrameAction action, bool rendered, bool missed, unsigned long renderStart, unsigned long renderEnd) {
+    if (stopped.load(std::memory_order_acquire)) return;
+    unsigned long timeStart = micros();
+
+    uint32_t index = nFrames.load(std::memory_order_relaxed);
+    RecordedFrame *recorded = &frames[index % RECORDER_N_FRAMES];
+    recorded->sequence = frame->sequence;
+    recorded->captureTime = frame->captureTime;
+    recorded->readTime = frame->readTime;
+    recorded->analysisTime = frame->analysisTime;
+    recorded->renderStart = renderStart;
+    recorded->renderEnd = renderEnd;
+    recorded->bandScale = frame->bandScale;
+    recorded->nBands = frame->nBands;
+    recorded->action = action;
+    recorded->flags = (frame->silent ? FLAG_SILENT : 0) | (rendered ? FLAG_RENDERED : 0) | (missed ? FLAG_MISSED : 0);
+    recorded->blurRadius = getVisualizationBlurRadius();
+    for (int i = 0; i < frame->nBands; i++) {
+        float value = frame->bands[i] * 255.0f + 0.5f;
+        recorded->bands[i] = value <= 0.0f ? 0 : value >= 255.0f ? 255 : (uint8_t)value;
+    }
+    nFrames.store(index + 1, std::memory_order_release);
+
+    uint32_t threshold = triggerThreshold.load(std::memory_order_relaxed);
+    uint32_t frameTime = renderEnd - frame->readTime;
+    if (postTriggerFrames < 0 && threshold > 0 && frameTime > threshold) {
+        postTriggerFrames = RECORDER_POST_TRIGGER_FRAMES;
+        recordEvent(RECORDER_EVENT_TRIGGER, frameTime);
+    } else if (postTriggerFrames > 0 && --postTriggerFrames == 0) {
+        postTriggerFrames = -1;
+        stopped.store(true, std::memory_order_release);
+        triggered.store(true, std::memory_order_release);
+    }
+
+    recordTime += micros() - timeStart;
+    nRecordTimed++;
+}
+
+void recordEvent(RecorderEvent event, int32_t value) {
+    if (stopped.load(std::memory_order_acquire)) return;
+
+    uint32_t index = nEvents.fetch_add(1, std::memory_order_relaxed);
+    RecordedEvent *recorded = &events[index % RECORDER_N_EVENTS];
+    recorded->sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    recorded->time = micros();
+    recorded->value = value;
+    recorded->type = event;
+    recorded->sequence.store(index + 1, std::memory_order_release);
+}
+
+void setRecorderTrigger(unsigned long threshold) {
+    triggerThreshold.store(threshold, std::memory_order_relaxed);
+    PRINTF("Recorder trigger: %s\n", threshold > 0 ? "armed" : "off");
+}
+
+bool isRecorderTriggered() {
+    return triggered.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Frames a payload already written after the packet header and sends it, waiting for space in the transmit buffer.
+ */
+static void sendPacket(uint8_t type, int length) {
+    packet[0] = MAGIC_0;
+    packet[1] = MAGIC_1;
+    packet[2] = type;
+    packet[3] = length & 0xFF;
+    packet[4] = length >> 8;
+    uint8_t checksum = 0;
+    for (int i = 0; i < length; i++) {
+        checksum ^= packet[HEADER_SIZE + i];
+    }
+    packet[HEADER_SIZE + length] = checksum;
+    Serial.write(packet, HEADER_SIZE + length + 1);
+}
+
+void dumpRecorder() {
+    stopped.store(true, std::memory_order_release);
+
+    // Whole dump is written under the console lock, mirror frames are skipped and text waits until it ends
+    lockConsole(portMAX_DELAY);
+
+    // The slot after the newest frame may be being written, so only the ones before it are sent
+    uint32_t frameCount = nFrames.load(std::memory_order_acquire);
+    uint32_t eventCount = nEvents.load(std::memory_order_acquire);
+    uint32_t firstFrame = frameCount > RECORDER_N_FRAMES - 1 ? frameCount - (RECORDER_N_FRAMES - 1) : 0;
+    uint32_t firstEvent = eventCount > RECORDER_N_EVENTS ? eventCount - RECORDER_N_EVENTS : 0;
+    uint32_t nsPerFrame = nRecordTimed > 0 ? (uint32_t)((uint64_t)recordTime * 1000 / nRecordTimed) : 0;
+
+    PRINTF("Recorder: dumping %u frames and %u events, %.2fus per frame recorded\n", (unsigned)(frameCount - firstFrame), (unsigned)(eventCount - firstEvent), nsPerFrame / 1000.0);
+
+    uint8_t *payload = packet + HEADER_SIZE;
+    uint16_t dumpedFrames = frameCount - firstFrame;
+    uint16_t dumpedEvents = eventCount - firstEvent;
+    uint32_t threshold = triggerThreshold.load(std::memory_order_relaxed);
+    uint32_t dumpTime = micros();
+    payload[0] = RECORDER_VERSION;
+    payload[1] = AUDIO_MAX_BANDS;
+    memcpy(payload + 2, &dumpedFrames, 2);
+    memcpy(payload + 4, &dumpedEvents, 2);
+    memcpy(payload + 6, &threshold, 4);
+    memcpy(payload + 10, &dumpTime, 4);
+    memcpy(payload + 14, &nsPerFrame, 4);
+    sendPacket(PACKET_HEADER, 18);
+
+    for (uint32_t i = firstFrame; i < frameCount; i++) {
+        memcpy(payload, &frames[i % RECORDER_N_FRAMES], sizeof(RecordedFrame));
+        sendPacket(PACKET_FRAME, sizeof(RecordedFrame));
+    }
+
+    for (uint32_t i = firstEvent; i < eventCount; i++) {
+        // Event that passed the `stopped` check before the dump may wrap onto the slot while it is copied
+        const RecordedEvent *event = &events[i % RECORDER_N_EVENTS];
+        uint32_t sequence = event->sequence.load(std::memory_order_acquire);
+        uint32_t time = event->time;
+        uint8_t type = event->type;
+        int32_t value = event->value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != i + 1 || event->sequence.load(std::memory_order_relaxed) != sequence) continue;
+        memcpy(payload, &time, 4);
+        payload[4] = type;
+        memcpy(payload + 5, &value, 4);
+        sendPacket(PACKET_EVENT, 9);
+    }
+
+    sendPacket(PACKET_END, 0);
+    Serial.flush();
+    unlockConsole();
+
+    if (triggered.load(std::memory_order_acquire)) triggerThreshold.store(0, std::memory_order_relaxed);
+    triggered.store(false, std::memory_order_release);
+    stopped.store(false, std::memory_order_release);
+}
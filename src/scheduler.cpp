@@ -0,0 +1,45 @@
+#include "scheduler.h"
+
+#include "stats.h"
+
+static SchedulerPolicy policy = SCHEDULER_DEFAULT_POLICY;
+static int nDropsInRow = 0;
+
+void setSchedulerPolicy(SchedulerPolicy value) {
+    if (value < 0 || value > SCHEDULER_POLICY_MAX_VALUE) return;
+    policy = value;
+}
+
+SchedulerPolicy getSchedulerPolicy() {
+    return policy;
+}
+
+/**
+ * @brief Returns `true` if work of the given cost started at `start` ends before the deadline.
+ */
+static bool fitsDeadline(unsigned long start, unsigned long cost, unsigned long deadline) {
+    if (cost == 0) return true;
+    return (long)(start + cost + SCHEDULER_MARGIN_US - deadline) <= 0;
+}
+
+FrameAction planFrame(const BandFrame *frame, unsigned long now, unsigned long cost, unsigned long reducedCost) {
+    unsigned long deadline = frame->analysisTime + frame->period;
+
+    FrameAction action = FRAME_ACTION_RENDER;
+    if (policy != SCHEDULER_POLICY_RENDER_ALL && !fitsDeadline(now, cost, deadline)) {
+        action = FRAME_ACTION_SKIP_BLUR;
+        if (policy == SCHEDULER_POLICY_DROP && !fitsDeadline(now, reducedCost, deadline) && nDropsInRow < SCHEDULER_MAX_DROPS) {
+            action = FRAME_ACTION_DROP;
+        }
+    }
+
+    nDropsInRow = action == FRAME_ACTION_DROP ? nDropsInRow + 1 : 0;
+    return action;
+}
+
+bool completeFrame(const BandFrame *frame, FrameAction action, unsigned long endTime) {
+    // Frame is late if the next one was ready before it was shown
+    bool late = action != FRAME_ACTION_DROP && (long)(endTime - (frame->analysisTime + frame->period)) > 0;
+    addStatsRenderFrame(action, late);
+    return late || action == FRAME_ACTION_DROP;
+}
@@ -0,0 +1,248 @@
+#include "settings.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+
+#define DEBUG
+
+#include "macros.h"
+#include "recorder.h"
+
+#define BUILD_ID_LENGTH 8 // Leading bytes of the hash of the application that identify a build
+
+/**
+ * @brief Settings as they are stored, with the version that stored them.
+ */
+typedef struct {
+    uint32_t version;
+    Settings settings;
+} StoredSettings;
+
+static Preferences preferences;
+static bool opened = false; // NVS namespace is open, nothing is stored otherwise
+
+// Recorded by the tasks that apply the settings
+static portMUX_TYPE settingsMux = portMUX_INITIALIZER_UNLOCKED;
+static Settings current;
+static uint32_t nChanges = 0;        // Changes of source, visualization or palette
+static unsigned long changeTime = 0; // Time of the last change (`millis()`)
+
+// Only used by the task that flushes the settings
+static Settings stored;                 // Settings in NVS
+static uint32_t nStoredChanges = 0;     // Value of `nChanges` when settings were last written
+static unsigned long bandScaleTime = 0; // Time at which band scales were last written (`millis()`)
+
+/**
+ * @brief Copies the settings that are in range from `loaded` into `settings`.
+ */
+static void restoreValidSettings(const Settings *loaded, Settings *settings) {
+    if (loaded->audioSource >= 0 && loaded->audioSource <= AUDIO_SOURCE_HARDWARE_MAX_VALUE) {
+        settings->audioSource = loaded->audioSource;
+    }
+    if (loaded->visualizationType >= 0 && loaded->visualizationType < getVisualizationCount()) {
+        settings->visualizationType = loaded->visualizationType;
+        settings->visualizationPalette = 0;
+        if (loaded->visualizationPalette >= 0 && loaded->visualizationPalette < getVisualizationPaletteCount(loaded->visualizationType)) {
+            settings->visualizationPalette = loaded->visualizationPalette;
+        }
+    }
+    for (int i = 0; i <= AUDIO_SOURCE_HARDWARE_MAX_VALUE; i++) {
+        float scale = loaded->bandScales[i];
+        int count = loaded->bandScaleCounts[i];
+        if (scale > 0.0 && scale < INFINITY && count >= AUDIO_MIN_BANDS && count <= AUDIO_MAX_BANDS) {
+            settings->bandScales[i] = scale;
+            settings->bandScaleCounts[i] = count;
+        }
+    }
+}
+
+/**
+ * @brief Drops cached calibration if it was measured by another build, whose code may be faster or slower.
+ */
+static void checkCalibrationBuild() {
+    const uint8_t *build = esp_ota_get_app_description()->app_elf_sha256;
+
+    Preferences calibration;
+    if (!calibration.begin(SETTINGS_CALIBRATION_NAMESPACE, false)) return;
+    uint8_t cachedBuild[BUILD_ID_LENGTH];
+    bool sameBuild = calibration.isKey("build") &&
+                     calibration.getBytes("build", cachedBuild, BUILD_ID_LENGTH) == BUILD_ID_LENGTH &&
+                     memcmp(cachedBuild, build, BUILD_ID_LENGTH) == 0;
+    if (!sameBuild) {
+        calibration.clear();
+        calibration.putBytes("build", build, BUILD_ID_LENGTH);
+    }
+    calibration.end();
+}
+
+void setupSettings(const Settings *defaults) {
+    current = *defaults;
+    opened = preferences.begin(SETTINGS_NAMESPACE, false);
+    if (!opened) {
+        PRINTF("Settings can't be opened, defaults are used and nothing is stored\n");
+        stored = current;
+        return;
+    }
+
+    StoredSettings loaded;
+    if (preferences.isKey("settings") &&
+        preferences.getBytesLength("settings") == sizeof(loaded) &&
+        preferences.getBytes("settings", &loaded, sizeof(loaded)) == sizeof(loaded) &&
+        loaded.version == SETTINGS_VERSION) {
+        restoreValidSettings(&loaded.settings, &current);
+    }
+    stored = current;
+
+    checkCalibrationBuild();
+}
+
+void getSettings(Settings *settings) {
+    portENTER_CRITICAL(&settingsMux);
+    *settings = current;
+    portEXIT_CRITICAL(&settingsMux);
+}
+
+void setSettingsAudioSource(AudioSource audioSource) {
+    if (audioSource < 0 || audioSource > AUDIO_SOURCE_HARDWARE_MAX_VALUE) return;
+
+    unsigned long now = millis();
+    portENTER_CRITICAL(&settingsMux);
+    if (current.audioSource != audioSource) {
+        current.audioSource = audioSource;
+        nChanges++;
+        changeTime = now;
+    }
+    portEXIT_CRITICAL(&settingsMux);
+}
+
+void setSettingsVisualization(VisualizationType visualization, VisualizationPalette palette) {
+    unsigned long now = millis();
+    portENTER_CRITICAL(&settingsMux);
+    if (current.visualizationType != visualization || current.visualizationPalette != palette) {
+        current.visualizationType = visualization;
+        current.visualizationPalette = palette;
+        nChanges++;
+        changeTime = now;
+    }
+    portEXIT_CRITICAL(&settingsMux);
+}
+
+void setSettingsBandScale(AudioSource audioSource, int nBands, float scale) {
+    if (audioSource < 0 || audioSource > AUDIO_SOURCE_HARDWARE_MAX_VALUE) return;
+
+    portENTER_CRITICAL(&settingsMux);
+    current.bandScales[audioSource] = scale;
+    current.bandScaleCounts[audioSource] = nBands;
+    portEXIT_CRITICAL(&settingsMux);
+}
+
+/**
+ * @brief Returns `true` if a band scale changed enough since it was stored to be written again.
+ */
+static bool isBandScaleChanged(const Settings *settings) {
+    for (int i = 0; i <= AUDIO_SOURCE_HARDWARE_MAX_VALUE; i++) {
+        float scale = settings->bandScales[i];
+        float storedScale = stored.bandScales[i];
+        if (scale <= 0.0) continue;
+        if (storedScale <= 0.0 || settings->bandScaleCounts[i] != stored.bandScaleCounts[i]) return true;
+        if (scale > storedScale * SETTINGS_BAND_SCALE_CHANGE_FACTOR || scale * SETTINGS_BAND_SCALE_CHANGE_FACTOR < storedScale) return true;
+    }
+    return false;
+}
+
+void flushSettings() {
+    if (!opened) return;
+
+    unsigned long now = millis();
+    portENTER_CRITICAL(&settingsMux);
+    Settings settings = current;
+    uint32_t changes = nChanges;
+    unsigned long lastChange = changeTime;
+    portEXIT_CRITICAL(&settingsMux);
+
+    // Changes that were undone, e.g. by cycling through all palettes, are not written
+    bool changed = changes != nStoredChanges && now - lastChange >= SETTINGS_WRITE_DELAY_MS;
+    if (changed &&
+        settings.audioSource == stored.audioSource &&
+        settings.visualizationType == stored.visualizationType &&
+        settings.visualizationPalette == stored.visualizationPalette) {
+        nStoredChanges = changes;
+        changed = false;
+    }
+    bool bandScaleChanged = now - bandScaleTime >= SETTINGS_BAND_SCALE_INTERVAL_MS && isBandScaleChanged(&settings);
+    if (!changed && !bandScaleChanged) return;
+
+    // Pending changes of the other kind are written along, they are due sooner or later
+    StoredSettings value = {SETTINGS_VERSION, settings};
+    unsigned long timeStart = micros();
+    if (preferences.putBytes("settings", &value, sizeof(value)) != sizeof(value)) {
+        PRINTF("Settings can't be written\n");
+    }
+    unsigned long writeTime = micros() - timeStart;
+    recordEvent(RECORDER_EVENT_SETTINGS_WRITE, writeTime);
+    PRINTF("Settings written in %luus\n", writeTime);
+
+    stored = settings;
+    nStoredChanges = changes;
+    bandScaleTime = bandScaleChanged ? now : bandScaleTime;
+}
+
+void clearSettings() {
+    if (!opened) return;
+    preferences.clear();
+
+    Preferences calibration;
+    if (calibration.begin(SETTINGS_CALIBRATION_NAMESPACE, false)) {
+        calibration.clear();
+        calibration.end();
+    }
+
+    // Current settings are only written again when they change
+    portENTER_CRITICAL(&settingsMux);
+    nStoredChanges = nChanges;
+    portEXIT_CRITICAL(&settingsMux);
+    bandScaleTime = millis();
+    PRINTF("Settings cleared, defaults and calibration are used from the next boot\n");
+}
+
+/**
+ * @brief Loads a value cached in the calibration namespace.
+ */
+static bool loadCalibration(const char *key, void *value, size_t size) {
+    Preferences calibration;
+    if (!calibration.begin(SETTINGS_CALIBRATION_NAMESPACE, true)) return false;
+    bool loaded = calibration.isKey(key) &&
+                  calibration.getBytesLength(key) == size &&
+                  calibration.getBytes(key, value, size) == size;
+    calibration.end();
+    return loaded;
+}
+
+/**
+ * @brief Stores a value in the calibration namespace.
+ */
+static void saveCalibration(const char *key, const void *value, size_t size) {
+    Preferences calibration;
+    if (!calibration.begin(SETTINGS_CALIBRATION_NAMESPACE, false)) return;
+    if (calibration.putBytes(key, value, size) != size) {
+        PRINTF("Calibration %s can't be cached\n", key);
+    }
+    calibration.end();
+}
+
+bool loadAudioCalibration(AudioCalibration *calibration) {
+    return loadCalibration("audio", calibration, sizeof(AudioCalibration));
+}
+
+void saveAudioCalibration(const AudioCalibration *calibration) {
+    saveCalibration("audio", calibration, sizeof(AudioCalibration));
+}
+
+bool loadVisualizationCalibration(VisualizationCalibration *calibration) {
+    return loadCalibration("visualization", calibration, sizeof(VisualizationCalibration));
+}
+
+void saveVisualizationCalibration(const VisualizationCalibration *calibration) {
+    saveCalibration("visualization", calibration, sizeof(VisualizationCalibration));
+}
@@ -0,0 +1,33 @@
+#include "smoothing.h"
+
+#include "placement.h"
+
+// Deltas from -1 to 1 are mapped to indexes from 0 to `SMOOTHING_LUT_SIZE`
+#define LUT_SCALE (SMOOTHING_LUT_SIZE / 2.0f)
+
+void setupSmoothingProfile(SmoothingProfile *profile) {
+    for (int i = 0; i < SMOOTHING_LUT_SIZE; i++) {
+        float delta = (i + 0.5f) / LUT_SCALE - 1.0f;
+
+        int k = 0;
+        while (k < profile->nSegments - 1 && delta <= profile->segments[k].above) {
+            k++;
+        }
+        const SmoothingSegment *segment = &profile->segments[k];
+        profile->lut[i] = {segment->retain, segment->follow, segment->release};
+    }
+}
+
+HOT_CODE void smoothBands(const SmoothingProfile *profile, const float *bands, float *smoothed, int n) {
+    for (int i = 0; i < n; i++) {
+        float delta = bands[i] - smoothed[i];
+
+        int index = int((delta + 1.0f) * LUT_SCALE);
+        index = index < 0 ? 0 : index;
+        index = index > SMOOTHING_LUT_SIZE - 1 ? SMOOTHING_LUT_SIZE - 1 : index;
+        const SmoothingCoefficients *c = &profile->lut[index];
+
+        float value = smoothed[i] * c->retain + delta * c->follow - c->release;
+        smoothed[i] = value < 0.0f ? 0.0f : value;
+    }
+}
@@ -0,0 +1,276 @@
+#include "stats.h"
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_freertos_hooks.h>
+
+#define DEBUG
+
+#include "macros.h"
+
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t runTime; // Run time counter at the last report
+} StatsTask;
+
+typedef struct {
+    QueueHandle_t handle;
+    const char *name;
+    UBaseType_t maxDepth; // Highest depth since the last report
+} StatsQueue;
+
+static StatsTask tasks[STATS_MAX_TASKS];
+static int nTasks = 0;
+static StatsQueue queues[STATS_MAX_QUEUES];
+static int nQueues = 0;
+
+static std::atomic<uint32_t> captureWaitTime(0);
+static std::atomic<uint32_t> nCaptureReads(0);
+static std::atomic<uint32_t> nCaptureBlockedReads(0);
+static std::atomic<uint32_t> nCaptureOverflows(0);
+static std::atomic<uint32_t> nRenderFrames(0);
+static std::atomic<uint32_t> nLateFrames(0);
+static std::atomic<uint32_t> nBlurSkippedFrames(0);
+static std::atomic<uint32_t> nDroppedFrames(0);
+static std::atomic<uint32_t> nSilenceFrames[PIPELINE_N_STAGES] = {{0}, {0}};
+static std::atomic<uint32_t> silenceSavedTime(0);
+
+static unsigned long period = 0;
+static unsigned long reportTime = 0;
+
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1
+static TaskStatus_t systemState[STATS_MAX_SYSTEM_TASKS];
+static uint32_t lastTotalRunTime = 0;
+static uint32_t lastIdleRunTimes[portNUM_PROCESSORS] = {0};
+#else
+static_assert(portNUM_PROCESSORS <= 2, "Idle hooks are defined for two cores");
+static bool idleAccounting = false; // Idle hooks are registered, only while there is a stats period
+static bool idleCovered = false;    // Idle time covers the period since the last report
+static std::atomic<uint32_t> idleTimes[portNUM_PROCESSORS] = {}; // Idle time since boot in microseconds
+static uint32_t lastIdleCalls[portNUM_PROCESSORS] = {0};          // Time of the previous idle hook call, only used by the idle task of each core
+static uint32_t lastIdleTimes[portNUM_PROCESSORS] = {0};          // Idle time at the last report
+#endif
+
+void registerStatsTask(TaskHandle_t task) {
+    if (nTasks == STATS_MAX_TASKS) {
+        PRINTF("Too many tasks for stats, increase STATS_MAX_TASKS. Halt!\n");
+        while (true) continue;
+    }
+    tasks[nTasks++] = {task, 0};
+}
+
+void registerStatsQueue(QueueHandle_t queue, const char *name) {
+    if (nQueues == STATS_MAX_QUEUES) {
+        PRINTF("Too many queues for stats, increase STATS_MAX_QUEUES. Halt!\n");
+        while (true) continue;
+    }
+    queues[nQueues++] = {queue, name, 0};
+}
+
+void addStatsCaptureWait(unsigned long waitTime, bool blocked) {
+    captureWaitTime.fetch_add(waitTime, std::memory_order_relaxed);
+    nCaptureReads.fetch_add(1, std::memory_order_relaxed);
+    if (blocked) {
+        nCaptureBlockedReads.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void addStatsCaptureOverflow(unsigned count) {
+    nCaptureOverflows.fetch_add(count, std::memory_order_relaxed);
+}
+
+void addStatsRenderFrame(FrameAction action, bool late) {
+    nRenderFrames.fetch_add(1, std::memory_order_relaxed);
+    if (late) {
+        nLateFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (action == FRAME_ACTION_SKIP_BLUR) {
+        nBlurSkippedFrames.fetch_add(1, std::memory_order_relaxed);
+    } else if (action == FRAME_ACTION_DROP) {
+        nDroppedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void addStatsSilenceFrame(PipelineStage stage, unsigned long savedTime) {
+    nSilenceFrames[stage].fetch_add(1, std::memory_order_relaxed);
+    silenceSavedTime.fetch_add(savedTime, std::memory_order_relaxed);
+}
+
+#if !(configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1)
+/**
+ * @brief Accumulates idle time of a core. Called by its idle task as fast as it loops, a long gap
+ * since the previous call means that the core ran other tasks or interrupts in between.
+ *
+ * Time is measured rather than calls counted, so the result doesn't depend on the CPU frequency
+ * selected by the power governor and needs no calibration against an unloaded baseline.
+ */
+static void accountIdleTime(int core) {
+    uint32_t now = micros();
+    uint32_t gap = now - lastIdleCalls[core];
+    lastIdleCalls[core] = now;
+    if (gap < STATS_IDLE_GAP_US) {
+        idleTimes[core].fetch_add(gap, std::memory_order_relaxed);
+    }
+}
+
+// Returning `false` keeps the hook called in a loop while the core is idle
+static bool idleHookCore0() {
+    accountIdleTime(0);
+    return false;
+}
+
+static bool idleHookCore1() {
+    accountIdleTime(1);
+    return false;
+}
+
+/**
+ * @brief Registers the idle hooks. Idle cores spin in them instead of waiting for interrupts or
+ * entering light sleep, until `stopIdleAccounting`.
+ */
+static void startIdleAccounting() {
+    if (idleAccounting) return;
+    idleAccounting = true;
+    idleCovered = false;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (esp_register_freertos_idle_hook_for_cpu(core == 0 ? idleHookCore0 : idleHookCore1, core) != ESP_OK) {
+            PRINTF("Idle hook can't be registered, CPU load is not reported\n");
+        }
+    }
+}
+
+/**
+ * @brief Deregisters the idle hooks, so that idle cores save power again.
+ */
+static void stopIdleAccounting() {
+    if (!idleAccounting) return;
+    idleAccounting = false;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        esp_deregister_freertos_idle_hook_for_cpu(core == 0 ? idleHookCore0 : idleHookCore1, core);
+    }
+}
+#endif
+
+void setStatsPeriod(unsigned long value) {
+    period = value;
+#if !(configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1)
+    if (period > 0) {
+        startIdleAccounting();
+    } else {
+        stopIdleAccounting();
+    }
+#endif
+}
+
+void sampleStats() {
+    for (int i = 0; i < nQueues; i++) {
+        UBaseType_t depth = uxQueueMessagesWaiting(queues[i].handle);
+        queues[i].maxDepth = depth > queues[i].maxDepth ? depth : queues[i].maxDepth;
+    }
+
+    if (period > 0 && (micros() - reportTime) / 1000 >= period) {
+        printStatsReport();
+    }
+}
+
+/**
+ * @brief Prints CPU load of each core and CPU share of registered tasks since the last report.
+ *
+ * @param elapsedTime Time since the last report in microseconds.
+ */
+static void printCpuStats(float elapsedTime) {
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1
+    uint32_t totalRunTime = 0;
+    UBaseType_t nSystemTasks = uxTaskGetSystemState(systemState, STATS_MAX_SYSTEM_TASKS, &totalRunTime);
+    if (nSystemTasks == 0) {
+        PRINTF(" cpu n/a (increase STATS_MAX_SYSTEM_TASKS)");
+        return;
+    }
+    float elapsed = totalRunTime - lastTotalRunTime;
+    lastTotalRunTime = totalRunTime;
+    if (elapsed <= 0.0) elapsed = 1.0;
+
+    PRINTF(" cpu");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        for (UBaseType_t i = 0; i < nSystemTasks; i++) {
+            if (systemState[i].xHandle != idle) continue;
+            float idleTime = systemState[i].ulRunTimeCounter - lastIdleRunTimes[core];
+            lastIdleRunTimes[core] = systemState[i].ulRunTimeCounter;
+            PRINTF(" %.1f%%", 100.0 - 100.0 * idleTime / elapsed);
+        }
+    }
+
+    PRINTF(" | task cpu");
+    for (int k = 0; k < nTasks; k++) {
+        for (UBaseType_t i = 0; i < nSystemTasks; i++) {
+            if (systemState[i].xHandle != tasks[k].handle) continue;
+            float runTime = systemState[i].ulRunTimeCounter - tasks[k].runTime;
+            tasks[k].runTime = systemState[i].ulRunTimeCounter;
+            PRINTF(" %s %.1f%%", systemState[i].pcTaskName, 100.0 * runTime / elapsed);
+        }
+    }
+#else
+    if (!idleAccounting) {
+        PRINTF(" cpu n/a (needs a stats period)");
+        return;
+    }
+    if (!idleCovered) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            lastIdleTimes[core] = idleTimes[core].load(std::memory_order_relaxed);
+        }
+        idleCovered = true;
+        PRINTF(" cpu n/a (idle accounting started)");
+        return;
+    }
+    if (elapsedTime <= 0.0) elapsedTime = 1.0;
+
+    PRINTF(" cpu");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t idle = idleTimes[core].load(std::memory_order_relaxed);
+        float idleTime = idle - lastIdleTimes[core];
+        lastIdleTimes[core] = idle;
+        float load = 100.0 - 100.0 * idleTime / elapsedTime;
+        PRINTF(" %.1f%%", load < 0.0 ? 0.0 : load);
+    }
+#endif
+}
+
+void printStatsReport() {
+    unsigned long now = micros();
+    float elapsed = now - reportTime;
+    reportTime = now;
+
+    PRINTF("stats %.2fs", elapsed / 1000000.0);
+    printCpuStats(elapsed);
+
+    float waitTime = captureWaitTime.exchange(0);
+    uint32_t reads = nCaptureReads.exchange(0);
+    uint32_t blockedReads = nCaptureBlockedReads.exchange(0);
+    uint32_t overflows = nCaptureOverflows.exchange(0);
+    PRINTF(" | i2s wait %.1f%% %u/%u blocked %u overflow", 100.0 * waitTime / elapsed, (unsigned)blockedReads, (unsigned)reads, (unsigned)overflows);
+
+    uint32_t frames = nRenderFrames.exchange(0);
+    uint32_t lateFrames = nLateFrames.exchange(0);
+    uint32_t blurSkipped = nBlurSkippedFrames.exchange(0);
+    uint32_t dropped = nDroppedFrames.exchange(0);
+    PRINTF(" | deadline %u/%u late %u no blur %u dropped", (unsigned)lateFrames, (unsigned)frames, (unsigned)blurSkipped, (unsigned)dropped);
+
+    uint32_t silentAnalysis = nSilenceFrames[PIPELINE_STAGE_ANALYSIS].exchange(0);
+    uint32_t silentRender = nSilenceFrames[PIPELINE_STAGE_RENDER].exchange(0);
+    float savedTime = silenceSavedTime.exchange(0);
+    PRINTF(" | silence %u/%u saved %.1f%%", (unsigned)silentAnalysis, (unsigned)silentRender, 100.0 * savedTime / elapsed);
+
+    // Stack depth is in bytes on ESP32
+    PRINTF(" | stack free");
+    for (int k = 0; k < nTasks; k++) {
+        PRINTF(" %s %u", pcTaskGetName(tasks[k].handle), (unsigned)uxTaskGetStackHighWaterMark(tasks[k].handle));
+    }
+
+    PRINTF(" | queue");
+    for (int i = 0; i < nQueues; i++) {
+        PRINTF(" %s %u/%u", queues[i].name, (unsigned)uxQueueMessagesWaiting(queues[i].handle), (unsigned)queues[i].maxDepth);
+        queues[i].maxDepth = 0;
+    }
+    PRINTF("\n");
+}
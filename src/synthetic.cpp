@@ -0,0 +1,173 @@
+#include "synthetic.h"
+
+#include <string.h>
+
+// Semitone ratio, 2^(1/12), in 16.16 fixed point
+#define SEMITONE_Q16 69433
+#define NOISE_ROWS   16 // Random rows of the pink noise generator, row k is updated every 2^(k + 1) samples
+
+static_assert((SYNTHETIC_NOISE_LENGTH & (SYNTHETIC_NOISE_LENGTH - 1)) == 0, "SYNTHETIC_NOISE_LENGTH must be a power of two");
+
+// First quarter of a sine period at 16-bit full scale, including its peak, the rest follows by symmetry
+static const int16_t quarterSine[257] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210, 2410, 2611, 2811, 3012,
+    3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609, 4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195,
+    6393, 6590, 6786, 6983, 7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+    9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605, 11793, 11980, 12167, 12353,
+    12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828, 14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+    15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+    18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000, 20159, 20317, 20475, 20631,
+    20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856, 22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027,
+    23170, 23311, 23452, 23592, 23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+    25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+    27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001, 28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803,
+    28898, 28992, 29085, 29177, 29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+    30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297,
+    31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736, 31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098,
+    32137, 32176, 32213, 32250, 32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+    32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752, 32757, 32761, 32765, 32766,
+    32767,
+};
+
+static uint32_t sweepIncrements[SYNTHETIC_SWEEP_MAX_STEPS]; // Sine phase increment per sample of each semitone
+static int nSweepSteps = 0;
+static uint32_t stepLength = 0; // Samples per semitone
+static int16_t pinkNoise[SYNTHETIC_NOISE_LENGTH];
+static uint32_t impulsePeriod = 0; // Samples between impulses
+
+static SyntheticSignal currentSignal = SYNTHETIC_SIGNAL_SWEEP;
+static uint32_t position = 0;     // Samples produced since the signal was restarted, modulo the signal period
+static int sweepStep = 0;         // Semitone of the sweep being played
+static uint32_t sweepPhase = 0;   // Phase of the sweep, a full period is 2^32
+static uint32_t noiseState = 0;   // State of the linear congruential generator
+
+/**
+ * @brief Returns the sine of a phase, where a full period is 2^32, at 16-bit full scale.
+ */
+static int32_t lookupSine(uint32_t phase) {
+    uint32_t index = phase >> 22; // 1024 steps per period
+    uint32_t i = index & 255;
+    switch (index >> 8) {
+        case 0:
+            return quarterSine[i];
+        case 1:
+            return quarterSine[256 - i];
+        case 2:
+            return -quarterSine[i];
+        default:
+            return -quarterSine[256 - i];
+    }
+}
+
+/**
+ * @brief Returns the next value of the noise generator, uniform from -2048 to 2047.
+ */
+static int32_t nextNoise() {
+    noiseState = noiseState * 1664525 + 1013904223;
+    return (int32_t)(noiseState >> 20) - 2048;
+}
+
+/**
+ * @brief Fills the pink noise table with the Voss-McCartney algorithm.
+ *
+ * The sum of white noise rows, where row k is redrawn every 2^(k + 1) samples, falls by about 3 dB per octave.
+ */
+static void setupPinkNoise() {
+    int32_t rows[NOISE_ROWS];
+    int32_t sum = 0;
+    noiseState = SYNTHETIC_NOISE_SEED;
+    for (int k = 0; k < NOISE_ROWS; k++) {
+        rows[k] = nextNoise();
+        sum += rows[k];
+    }
+
+    for (int n = 0; n < SYNTHETIC_NOISE_LENGTH; n++) {
+        int row = n == 0 ? NOISE_ROWS : __builtin_ctz(n);
+        if (row < NOISE_ROWS) {
+            sum -= rows[row];
+            rows[row] = nextNoise();
+            sum += rows[row];
+        }
+        // Sum of `NOISE_ROWS + 1` values is halved to fit 16 bits
+        pinkNoise[n] = (int16_t)((sum + nextNoise()) / 2);
+    }
+}
+
+void setupSyntheticSignal(int rate) {
+    // Semitones up to 0.9 of the Nyquist frequency, in phase increments (2^32 per period)
+    uint64_t increment = ((uint64_t)SYNTHETIC_SWEEP_MIN_HZ << 32) / rate;
+    nSweepSteps = 0;
+    while (nSweepSteps < SYNTHETIC_SWEEP_MAX_STEPS && increment * 20 < (uint64_t)9 << 32) {
+        sweepIncrements[nSweepSteps++] = (uint32_t)increment;
+        increment = (increment * SEMITONE_Q16) >> 16;
+    }
+    stepLength = (uint32_t)rate * SYNTHETIC_SWEEP_STEP_MS / 1000;
+    impulsePeriod = (uint32_t)rate * SYNTHETIC_IMPULSE_PERIOD_MS / 1000;
+
+    setupPinkNoise();
+    setSyntheticSignal(currentSignal);
+}
+
+void setSyntheticSignal(SyntheticSignal signal) {
+    if (signal < 0 || signal > SYNTHETIC_SIGNAL_MAX_VALUE) return;
+    currentSignal = signal;
+    position = 0;
+    sweepStep = 0;
+    sweepPhase = 0;
+}
+
+SyntheticSignal getSyntheticSignal() {
+    return currentSignal;
+}
+
+/**
+ * @brief Produces the sweep, gliding linearly from each semitone to the next one.
+ */
+static void generateSweep(int32_t *values, int n) {
+    for (int k = 0; k < n; k++) {
+        uint32_t from = sweepIncrements[sweepStep];
+        uint32_t to = sweepStep + 1 < nSweepSteps ? sweepIncrements[sweepStep + 1] : from;
+        sweepPhase += from + (uint32_t)((uint64_t)(to - from) * position / stepLength);
+        values[k] = lookupSine(sweepPhase);
+
+        if (++position == stepLength) {
+            position = 0;
+            sweepStep = sweepStep + 1 < nSweepSteps ? sweepStep + 1 : 0;
+        }
+    }
+}
+
+static void generatePinkNoise(int32_t *values, int n) {
+    for (int k = 0; k < n; k++) {
+        values[k] = pinkNoise[position];
+        position = (position + 1) & (SYNTHETIC_NOISE_LENGTH - 1);
+    }
+}
+
+static void generateImpulses(int32_t *values, int n) {
+    for (int k = 0; k < n; k++) {
+        values[k] = position == 0 ? INT16_MAX : 0;
+        position = position + 1 < impulsePeriod ? position + 1 : 0;
+    }
+}
+
+void generateSyntheticSamples(int32_t *dest, int n) {
+    // Mono samples are generated into the second half of the destination, then spread over both channels
+    int32_t *values = dest + n;
+    if (currentSignal == SYNTHETIC_SIGNAL_SWEEP) {
+        generateSweep(values, n);
+    } else if (currentSignal == SYNTHETIC_SIGNAL_PINK_NOISE) {
+        generatePinkNoise(values, n);
+    } else if (currentSignal == SYNTHETIC_SIGNAL_IMPULSES) {
+        generateImpulses(values, n);
+    } else {
+        memset(values, 0, sizeof(int32_t) * n);
+    }
+
+    // Front to back, so that every value is read before its slot is overwritten
+    for (int k = 0; k < n; k++) {
+        int32_t value = values[k] * (1 << SYNTHETIC_SHIFT);
+        dest[2 * k] = value;
+        dest[2 * k + 1] = value;
+    }
+}
@@ -0,0 +1,219 @@
+#include "tempo.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "audio.h"
+#include "placement.h"
+
+// Beat periods in ticks, from the fastest to the slowest tempo
+#define MIN_LAG (int)(60000000.0 / (TEMPO_MAX_BPM * TEMPO_TICK_US))
+#define MAX_LAG (int)(60000000.0 / (TEMPO_MIN_BPM * TEMPO_TICK_US) + 0.999)
+#define N_LAGS  (MAX_LAG - MIN_LAG + 1)
+
+static_assert((TEMPO_HISTORY & (TEMPO_HISTORY - 1)) == 0, "TEMPO_HISTORY must be a power of two");
+static_assert(MAX_LAG < TEMPO_HISTORY, "TEMPO_HISTORY is shorter than the slowest beat period");
+
+static float previousBands[AUDIO_MAX_BANDS]; // Compressed bands of the previous frame
+static int previousCount = 0;                // Number of bands of the previous frame
+static float history[TEMPO_HISTORY];         // Onset strength of recent ticks with the mean removed
+static int head = 0;                         // Index of the next tick in `history`
+static float tickOnset = 0.0;                // Onset strength accumulated into the current tick
+static unsigned long tickFill = 0;           // Time accumulated into the current tick, in microseconds
+
+static float onsetMean = 0.0;
+static float energy = 0.0;        // Decayed sum of squares of `history`, autocorrelation at lag 0
+static float scores[N_LAGS];      // Decayed autocorrelation at each beat period
+static float priorWeights[N_LAGS];
+
+static int lag = 0;               // Index of the selected beat period in `scores`
+static float beatTicks = 0.0;     // Selected beat period in ticks, refined between lags
+static float phase = 0.0;
+static uint32_t beats = 0;
+static float confidence = 0.0;
+
+// Tick rate constants, derived from the time constants
+static float scoreDecay = 0.0;
+static float meanAlpha = 0.0;
+
+void setupTempo() {
+    memset(previousBands, 0, sizeof(previousBands));
+    previousCount = 0;
+    memset(history, 0, sizeof(history));
+    memset(scores, 0, sizeof(scores));
+    head = 0;
+    tickOnset = 0.0;
+    tickFill = 0;
+    onsetMean = 0.0;
+    energy = 0.0;
+    phase = 0.0;
+    beats = 0;
+    confidence = 0.0;
+
+    scoreDecay = expf(-TEMPO_TICK_US / (TEMPO_WINDOW_S * 1000000.0));
+    meanAlpha = 1.0 - expf(-TEMPO_TICK_US / (TEMPO_MEAN_S * 1000000.0));
+
+    // Log-normal prior, so that halving or doubling the tempo is penalized the same
+    float bestWeight = 0.0;
+    for (int k = 0; k < N_LAGS; k++) {
+        float bpm = 60000000.0 / ((MIN_LAG + k) * TEMPO_TICK_US);
+        float octaves = log2f(bpm / TEMPO_PRIOR_BPM) / TEMPO_PRIOR_OCTAVES;
+        priorWeights[k] = expf(-0.5 * octaves * octaves);
+        if (priorWeights[k] > bestWeight) {
+            bestWeight = priorWeights[k];
+            lag = k;
+        }
+    }
+    beatTicks = MIN_LAG + lag;
+}
+
+/**
+ * @brief Returns the spectral flux of the bands against the previous frame and remembers them.
+ *
+ * Bands of a different count can't be compared, so the first frame after a change has no flux.
+ */
+static HOT_CODE float computeFlux(const float *bands, int nBands) {
+    bool comparable = nBands == previousCount;
+    float flux = 0.0;
+    for (int i = 0; i < nBands; i++) {
+        float compressed = logf(1.0 + bands[i] * TEMPO_COMPRESSION);
+        float rise = compressed - previousBands[i];
+        flux += rise > 0.0 && comparable ? rise : 0.0;
+        previousBands[i] = compressed;
+    }
+    previousCount = nBands;
+    return flux;
+}
+
+/**
+ * @brief Returns the score of a beat period with its neighbors, without the prior.
+ */
+static HOT_CODE float rawScore(int k) {
+    float left = k > 0 ? scores[k - 1] : scores[k];
+    float right = k < N_LAGS - 1 ? scores[k + 1] : scores[k];
+    return left + 2.0 * scores[k] + right;
+}
+
+/**
+ * @brief Returns the score of a beat period with its neighbors, weighted by the tempo prior.
+ *
+ * Sharp onsets at a period between two lags split their score between them, neighbors make up for it.
+ */
+static HOT_CODE float weightedScore(int k) {
+    return rawScore(k) * priorWeights[k];
+}
+
+/**
+ * @brief Selects the beat period with the best weighted score and refines it between lags.
+ *
+ * Beats repeat at every multiple of their period, so a period whose half scores nearly as well is
+ * replaced by the half (see `TEMPO_OCTAVE_RATIO`). The prior alone can't tell fast tempos from half
+ * of them, e.g. 174 from 87 BPM. The current period is kept unless another one scores
+ * `TEMPO_SWITCH_RATIO` times more, so that the tempo doesn't flicker between close candidates.
+ */
+static HOT_CODE void selectBeatPeriod() {
+    int best = 0;
+    float bestScore = -INFINITY;
+    for (int k = 0; k < N_LAGS; k++) {
+        float score = weightedScore(k);
+        if (score > bestScore) {
+            bestScore = score;
+            best = k;
+        }
+    }
+
+    int half = (int)((MIN_LAG + best) / 2.0 + 0.5) - MIN_LAG;
+    if (half >= 0 && rawScore(best) > 0.0 && rawScore(half) >= TEMPO_OCTAVE_RATIO * rawScore(best)) {
+        best = half;
+        bestScore = weightedScore(half);
+    }
+    if (best != lag && bestScore > TEMPO_SWITCH_RATIO * weightedScore(lag)) {
+        lag = best;
+    }
+
+    // Parabola through the peak and its neighbors
+    float offset = 0.0;
+    if (lag > 0 && lag < N_LAGS - 1) {
+        float left = scores[lag - 1];
+        float center = scores[lag];
+        float right = scores[lag + 1];
+        float curvature = left - 2.0 * center + right;
+        offset = curvature < 0.0 ? 0.5 * (left - right) / curvature : 0.0;
+        offset = offset < -0.5 ? -0.5 : (offset > 0.5 ? 0.5 : offset);
+    }
+    beatTicks = MIN_LAG + lag + offset;
+
+    confidence = energy > 0.0 ? scores[lag] / energy : 0.0;
+    confidence = confidence < 0.0 ? 0.0 : (confidence > 1.0 ? 1.0 : confidence);
+}
+
+/**
+ * @brief Advances the beat phase by a tick and pulls it towards the beat if the tick has an onset.
+ *
+ * Phase error is about the distance to the nearest beat, so onsets just before a beat move it earlier
+ * and onsets just after move it later. It is a sine, so that off-beat onsets (half a beat away) don't
+ * pull the phase either way. Correction is proportional to the onset in units of its RMS.
+ */
+static HOT_CODE void advancePhase(float onset) {
+    phase += 1.0 / beatTicks;
+
+    float meanSquare = energy * (1.0 - scoreDecay);
+    if (onset > 0.0 && meanSquare > 0.0) {
+        float weight = onset / sqrtf(meanSquare);
+        weight = weight > 4.0 ? 4.0 : weight;
+        float error = sinf(2.0 * M_PI * phase) / (2.0 * M_PI);
+        phase -= TEMPO_PHASE_GAIN * weight * error;
+    }
+
+    // Beat count never goes back, a late beat is only delayed
+    phase = phase < 0.0 ? 0.0 : phase;
+    if (phase >= 1.0) {
+        phase -= 1.0;
+        beats++;
+    }
+}
+
+/**
+ * @brief Adds a complete tick of onset strength to the history and updates scores and phase.
+ */
+static HOT_CODE void processTick(float onset) {
+    onsetMean += (onset - onsetMean) * meanAlpha;
+    float x = onset - onsetMean;
+
+    energy = energy * scoreDecay + x * x;
+    for (int k = 0; k < N_LAGS; k++) {
+        scores[k] = scores[k] * scoreDecay + x * history[(head - MIN_LAG - k) & (TEMPO_HISTORY - 1)];
+    }
+    history[head] = x;
+    head = (head + 1) & (TEMPO_HISTORY - 1);
+
+    selectBeatPeriod();
+    advancePhase(x);
+}
+
+HOT_CODE void updateTempo(const float *bands, int nBands, unsigned long period, TempoEstimate *estimate) {
+    float flux = computeFlux(bands, nBands);
+    uint32_t beatsBefore = beats;
+
+    // Flux is spread evenly over the frame, so that a frame covering several ticks fills all of them
+    float density = period > 0 ? flux / period : 0.0;
+    while (period > 0) {
+        unsigned long take = TEMPO_TICK_US - tickFill;
+        take = take < period ? take : period;
+        tickOnset += density * take;
+        tickFill += take;
+        period -= take;
+
+        if (tickFill == TEMPO_TICK_US) {
+            processTick(tickOnset);
+            tickOnset = 0.0;
+            tickFill = 0;
+        }
+    }
+
+    estimate->bpm = 60000000.0 / (beatTicks * TEMPO_TICK_US);
+    estimate->phase = phase;
+    estimate->beats = beats;
+    estimate->confidence = confidence;
+    estimate->beat = beats != beatsBefore;
+}
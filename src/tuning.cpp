@@ -0,0 +1,47 @@
+#include "tuning.h"
+
+#include <Arduino.h>
+
+#define DEBUG
+
+#include "audio.h"
+#include "macros.h"
+
+TuningChoice selectTuning(VisualizationType visualization) {
+    int targetHop = (int)(getAudioSamplingRate() / TUNING_TARGET_FPS + 0.5);
+    targetHop -= targetHop % AUDIO_BASS_DECIMATION;
+
+    TuningChoice choice = {AUDIO_FFT_MIN_SIZE, 0, 0, getVisualizationBandCount(visualization)};
+    for (int size = AUDIO_N_SAMPLES; size >= AUDIO_FFT_MIN_SIZE; size /= 2) {
+        // Hop can't be longer than the FFT, so smaller sizes run at higher frame rate
+        int hop = targetHop < size ? targetHop : size;
+        float budget = TUNING_BUDGET_FRACTION * 1000000.0 * hop / getAudioSamplingRate();
+        if (getAudioFftCost(size) <= budget || size == AUDIO_FFT_MIN_SIZE) {
+            choice.fftSize = size;
+            choice.hop = hop;
+            break;
+        }
+    }
+
+    float budget = TUNING_BUDGET_FRACTION * 1000000.0 * choice.hop / getAudioSamplingRate();
+    for (int radius = VISUALIZATION_MAX_BLUR_RADIUS; radius >= 0; radius--) {
+        if (getVisualizationCost(visualization, radius) <= budget || radius == 0) {
+            choice.blurRadius = radius;
+            break;
+        }
+    }
+
+    PRINTF(
+        "Tuning for %s: FFT size %d (%luus), hop %d (%.1f fps), %d bands, blur radius %d (%luus), budget %.0fus\n",
+        getVisualizationName(visualization),
+        choice.fftSize,
+        getAudioFftCost(choice.fftSize),
+        choice.hop,
+        (float)getAudioSamplingRate() / choice.hop,
+        choice.nBands,
+        choice.blurRadius,
+        getVisualizationCost(visualization, choice.blurRadius),
+        budget
+    );
+    return choice;
+}
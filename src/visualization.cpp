@@ -6,7 +6,11 @@
 
 #define DEBUG
 
+#include "arena.h"
 #include "macros.h"
+#include "particles.h"
+#include "placement.h"
+#include "smoothing.h"
 
 // clang-format off
 
@@ -121,18 +125,82 @@ const static CRGBPalette16 fireRedPalette = fireRed_gp;
 const static CRGBPalette16 fireBluePalette = fireBlue_gp;
 const static CRGBPalette16 fireGreenPalette = fireGreen_gp;
 
-static VisualizationType currentVisualization = VISUALIZATION_TYPE_NONE;
-static CRGBPalette16 currentPalette = blankPalette;
+/**
+ * @brief Output of a visualization update, consumed by `pushBuffer`.
+ */
+typedef struct {
+    const uint8_t *color;      // Palette index of each LED
+    const uint8_t *brightness; // Brightness of each LED, full brightness if `NULL`
+} VisualizationFrame;
+
+/**
+ * @brief Describes a visualization effect.
+ *
+ * Working memory of the effect (`stateSize` bytes) is allocated from the arena and zeroed when the
+ * visualization is set up, and released when it is torn down. Effects are listed in `visualizations`,
+ * indexed by `VisualizationType`.
+ *
+ * State starts with `LED_MATRIX_N_BANDS` smoothed bands, which are moved towards the input bands
+ * (resampled to columns) with the `smoothing` profile before every `update`. With fewer input bands
+ * than columns, bands are smoothed at their count and resampled after smoothing instead.
+ */
+typedef struct {
+    const char *name;
+    size_t stateSize;
+    void (*setup)(void *state); // Optional, called after the state is allocated
+    void (*update)(void *state, float *bands, VisualizationFrame *frame);
+    SmoothingProfile *smoothing;
+    const CRGBPalette16 *const *palettes; // Indexed by `VisualizationPalette`
+    int nPalettes;
+    int nBands; // Bands requested from the analysis
+} Visualization;
 
-// Two buffers, primary (A) and secondary (B), are required to apply effects like blur.
-// If an animation does not require a secondary buffer, it can operate only on the primary buffer.
-static uint8_t colorBufferA[LED_MATRIX_N] = {0};     // Primary LED color buffer
-static uint8_t colorBufferB[LED_MATRIX_N] = {0};     // Secondary LED color buffer
-static uint8_t brightnessBuffer[LED_MATRIX_N] = {0}; //
-static CRGB leds[LED_MATRIX_N] = {CRGB::Black};      // Array of LED colors used directly by the FastLED library
-static float bandsBuffer[LED_MATRIX_N_BANDS] = {0};  // Internal buffer for bands values that drive the animation
+/**
+ * @brief Active visualization together with its state and palette.
+ */
+typedef struct {
+    const Visualization *visualization; // `NULL` if not active
+    void *state;
+    CRGBPalette16 palette;
+    float *smoothed; // Bands smoothed at their count while it is below `LED_MATRIX_N_BANDS`
+    int nSmoothed;   // Count of `smoothed` bands, `LED_MATRIX_N_BANDS` if the state holds them, 0 after setup
+} VisualizationLayer;
+
+// During a transition, the outgoing layer keeps rendering and is blended with the current one.
+// States of both layers live in two arena slots, so a transition never waits for memory.
+// For palette-only transitions the outgoing layer has no visualization, only the old palette.
+static VisualizationLayer currentLayer = {NULL, NULL, blankPalette, NULL, 0};
+static VisualizationLayer outgoingLayer = {NULL, NULL, blankPalette, NULL, 0};
+static void *stateSlots[2] = {NULL, NULL};
+static float smoothedSlots[2][LED_MATRIX_N_BANDS]; // Smoothed bands of the layer in the matching state slot
+static int transitionFramesLeft = 0;
+static int decayFramesLeft = 0; // Frames of silent input left before the visualization is settled
+static unsigned long renderCosts[VISUALIZATION_TYPE_MAX_VALUE + 1][VISUALIZATION_MAX_BLUR_RADIUS + 1] = {{0}};
+static unsigned long showCost = 0;
+static VisualizationFrame lastFrame = {NULL, NULL}; // Last frame of the current layer, for the mirror
+static TempoEstimate tempo = {TEMPO_PRIOR_BPM, 0.0, 0, 0.0, false};
+
+// Bands are resampled to columns through a mapping computed for the band count of the last update
+static int mappedBands = 0;                          // Band count of the mapping, 0 before the first update
+static uint8_t columnFirstBands[LED_MATRIX_N_BANDS]; // First band of each column
+static uint8_t columnBandCounts[LED_MATRIX_N_BANDS]; // Bands of each column, at least one
+
+static_assert(sizeof(CRGB) == 3, "VISUALIZATION_ARENA_SIZE assumes 3 bytes per LED");
+static_assert(PARTICLE_SIZE == 6, "VISUALIZATION_ARENA_SIZE assumes 6 bytes per particle");
+
+static CRGB *leds = NULL; // Array of LED colors used directly by the FastLED library
+
+// Particles outlive a single update, but not the visualization. The pool is too large for a state slot,
+// so there is one pool, owned by the particle effect that was set up last.
+static ParticlePool particles = {NULL, NULL, NULL, NULL, 0, 0};
+static void *particlesOwner = NULL; // State of the effect that owns the pool
 
 void setupLedStrip() {
+    leds = (CRGB *)arenaAllocate(sizeof(CRGB) * LED_MATRIX_N, "leds");
+    stateSlots[0] = arenaAllocate(VISUALIZATION_MAX_STATE_SIZE, "visualization slot 0");
+    stateSlots[1] = arenaAllocate(VISUALIZATION_MAX_STATE_SIZE, "visualization slot 1");
+    setupParticlePool(&particles, VISUALIZATION_MAX_PARTICLES, "particles");
+
     FastLED.addLeds<WS2812B, LED_MATRIX_DATA_PIN_A, GRB>(leds, 0 * LED_MATRIX_N_PER_DATA_PIN, LED_MATRIX_N_PER_DATA_PIN);
     FastLED.addLeds<WS2812B, LED_MATRIX_DATA_PIN_B, GRB>(leds, 1 * LED_MATRIX_N_PER_DATA_PIN, LED_MATRIX_N_PER_DATA_PIN);
     FastLED.addLeds<WS2812B, LED_MATRIX_DATA_PIN_C, GRB>(leds, 2 * LED_MATRIX_N_PER_DATA_PIN, LED_MATRIX_N_PER_DATA_PIN);
@@ -140,102 +208,60 @@ void setupLedStrip() {
     FastLED.show();
 }
 
-void setupVisualization(VisualizationType visualization) {
-    if (currentVisualization != VISUALIZATION_TYPE_NONE) {
-        PRINTF("Visualization is already set up. Halt!\n");
-        while (true) continue;
-    }
-    currentVisualization = visualization;
+/**
+ * @brief Transfers the values from the visualization frame to the LED array (`leds`).
+ */
+static HOT_CODE void pushBuffer(const VisualizationFrame *frame, const CRGBPalette16 *palette) {
+    const uint8_t *color = frame->color;
+    const uint8_t *brightness = frame->brightness;
 
-    for (int i = 0; i < LED_MATRIX_N; i++) {
-        brightnessBuffer[i] = 255;
-    }
-}
+    for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
+        int offset = i * LED_MATRIX_N_PER_BAND;
 
-void setVisualizationPalette(VisualizationPalette palette) {
-    if (currentVisualization == VISUALIZATION_TYPE_NONE) {
-        PRINTF("Visualization is not set up. Halt!\n");
-        while (true) continue;
-    }
-    switch (currentVisualization) {
-        case VISUALIZATION_TYPE_BARS:
-            switch (palette) {
-                case VISUALIZATION_PALETTE_BARS_WARM:
-                    currentPalette = warmPalette;
-                    break;
-                case VISUALIZATION_PALETTE_BARS_OCEAN:
-                    currentPalette = oceanPalette;
-                    break;
-                case VISUALIZATION_PALETTE_BARS_FUNKY:
-                    currentPalette = funkyPalette;
-                    break;
-            }
-            break;
-        case VISUALIZATION_TYPE_SPECTRUM:
-            switch (palette) {
-                case VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_GREEN:
-                    currentPalette = heatmapGreenPalette;
-                    break;
-                case VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_BLUE:
-                    currentPalette = heatmapBluePalette;
-                    break;
-                case VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_RED:
-                    currentPalette = heatmapRedPalette;
-                    break;
-                case VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_PINK:
-                    currentPalette = heatmapPinkPalette;
-                    break;
+        // Every other column is wired bottom to top
+        int start = i % 2 == 0 ? offset : offset + LED_MATRIX_N_PER_BAND - 1;
+        int step = i % 2 == 0 ? 1 : -1;
+
+        if (brightness == NULL) {
+            for (int j = 0, k = start; j < LED_MATRIX_N_PER_BAND; j++, k += step) {
+                leds[k] = ColorFromPalette(*palette, color[offset + j]);
             }
-            break;
-        case VISUALIZATION_TYPE_FIRE:
-            switch (palette) {
-                case VISUALIZATION_PALETTE_FIRE_RED:
-                    currentPalette = fireRedPalette;
-                    break;
-                case VISUALIZATION_PALETTE_FIRE_BLUE:
-                    currentPalette = fireBluePalette;
-                    break;
-                case VISUALIZATION_PALETTE_FIRE_GREEN:
-                    currentPalette = fireGreenPalette;
-                    break;
+        } else {
+            for (int j = 0, k = start; j < LED_MATRIX_N_PER_BAND; j++, k += step) {
+                leds[k] = ColorFromPalette(*palette, color[offset + j], brightness[offset + j]);
             }
-            break;
-    }
-}
-
-void teardownVisualization() {
-    if (currentVisualization == VISUALIZATION_TYPE_NONE) {
-        PRINTF("Visualization is not set up. Halt!\n");
-        while (true) continue;
-    }
-    currentVisualization = VISUALIZATION_TYPE_NONE;
-    currentPalette = blankPalette;
-    for (int i = 0; i < LED_MATRIX_N; i++) {
-        colorBufferA[i] = 0;
-        colorBufferB[i] = 0;
-        brightnessBuffer[i] = 0;
-        leds[i] = CRGB::Black;
-    }
-    for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        bandsBuffer[i] = 0;
+        }
     }
 }
 
 /**
- * @brief Transfers the values from the primary buffer (`colorBufferA`) to the LED array (`leds`).
+ * @brief Blends two visualization frames into the LED array (`leds`).
+ *
+ * @param from Outgoing frame.
+ * @param fromPalette Palette of the outgoing frame.
+ * @param to Incoming frame.
+ * @param toPalette Palette of the incoming frame.
+ * @param amount Blend amount, from 0 (only outgoing frame) to 255 (only incoming frame).
  */
-static void pushBuffer() {
+static HOT_CODE void pushBlendedBuffer(
+    const VisualizationFrame *from, const CRGBPalette16 *fromPalette,
+    const VisualizationFrame *to, const CRGBPalette16 *toPalette,
+    uint8_t amount
+) {
     for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
         int offset = i * LED_MATRIX_N_PER_BAND;
 
-        if (i % 2 == 0) {
-            for (int j = 0; j < LED_MATRIX_N_PER_BAND; j++) {
-                leds[offset + j] = ColorFromPalette(currentPalette, colorBufferA[offset + j], brightnessBuffer[offset + j]);
-            }
-        } else {
-            for (int j = 0, k = LED_MATRIX_N_PER_BAND - 1; j < LED_MATRIX_N_PER_BAND; j++, k--) {
-                leds[offset + k] = ColorFromPalette(currentPalette, colorBufferA[offset + j], brightnessBuffer[offset + j]);
-            }
+        // Every other column is wired bottom to top
+        int start = i % 2 == 0 ? offset : offset + LED_MATRIX_N_PER_BAND - 1;
+        int step = i % 2 == 0 ? 1 : -1;
+
+        for (int j = 0, k = start; j < LED_MATRIX_N_PER_BAND; j++, k += step) {
+            uint8_t fromBrightness = from->brightness == NULL ? 255 : from->brightness[offset + j];
+            uint8_t toBrightness = to->brightness == NULL ? 255 : to->brightness[offset + j];
+
+            CRGB fromColor = ColorFromPalette(*fromPalette, from->color[offset + j], fromBrightness);
+            CRGB toColor = ColorFromPalette(*toPalette, to->color[offset + j], toBrightness);
+            leds[k] = blend(fromColor, toColor, amount);
         }
     }
 }
@@ -250,8 +276,14 @@ static float gaussianKernel[5][5]{
 };
 // clang-format on
 
-static void gaussianBlur(int nCols, int nRows, uint8_t *inp, uint8_t *out) {
-    const int margin = 2;
+static_assert(VISUALIZATION_MAX_BLUR_RADIUS == 2, "Gaussian kernel is 5x5");
+
+static int blurRadius = VISUALIZATION_MAX_BLUR_RADIUS;
+
+static HOT_CODE void gaussianBlur(int nCols, int nRows, uint8_t *inp, uint8_t *out) {
+    // Smaller radius uses the center of the kernel
+    const int margin = blurRadius;
+    const int center = VISUALIZATION_MAX_BLUR_RADIUS;
 
     float sum = 0.0;
     int count = 0;
@@ -269,115 +301,611 @@ static void gaussianBlur(int nCols, int nRows, uint8_t *inp, uint8_t *out) {
                     if (y == nRows) break;
                     if (y < 0) y = 0;
 
-                    float kernelValue = gaussianKernel[y - row + margin][x - col + margin];
+                    float kernelValue = gaussianKernel[y - row + center][x - col + center];
 
                     count += kernelValue;
                     sum += kernelValue * inp[x * nRows + y];
                 }
             }
 
-            out[col * nRows + row] = uint8_t(round(sum / count));
+            // Same as `round`, which would convert to double and call into the library, for non-negative values
+            out[col * nRows + row] = uint8_t(sum / count + 0.5f);
         }
     }
 }
 
-static void updateColorBars(float *bands) {
-    const float decay = 0.02;
-    for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        float d = bands[i] - bandsBuffer[i];
-        if (d > 0.2) {
-            bandsBuffer[i] = (bandsBuffer[i] * 2.0 + bands[i]) / 3.0;
-        } else if (d > 0.0) {
-            bandsBuffer[i] = (bandsBuffer[i] * 6.0 + bands[i]) / 7.0;
-        } else {
-            bandsBuffer[i] = bandsBuffer[i] < decay ? 0.0 : bandsBuffer[i] - decay;
-        }
-    }
+//
+// Bars
+//
+
+#define BARS_PULSE_DEPTH 96 // Brightness (of 255) lost by the bars over a beat, when the tempo is known
+
+typedef struct {
+    float bands[LED_MATRIX_N_BANDS]; // Smoothed bands that drive the animation
+    uint8_t color[LED_MATRIX_N];
+    uint8_t brightness[LED_MATRIX_N];
+} BarsState;
+
+static const CRGBPalette16 *const barsPalettes[] = {
+    &warmPalette,  // VISUALIZATION_PALETTE_BARS_WARM
+    &oceanPalette, // VISUALIZATION_PALETTE_BARS_OCEAN
+    &funkyPalette, // VISUALIZATION_PALETTE_BARS_FUNKY
+};
+
+#define N_SEGMENTS(segments) (int)(sizeof(segments) / sizeof(segments[0]))
+
+// Quick rise on big jumps, slow rise otherwise, linear fall
+static const SmoothingSegment barsSmoothingSegments[] = {
+    {0.2, 1.0, 1.0 / 3.0, 0.0},
+    {0.0, 1.0, 1.0 / 7.0, 0.0},
+    {-1.0, 1.0, 0.0, 0.02},
+};
+
+static SmoothingProfile barsSmoothing = {barsSmoothingSegments, N_SEGMENTS(barsSmoothingSegments)};
+
+static HOT_CODE void updateColorBars(void *state, float *bands, VisualizationFrame *frame) {
+    BarsState *bars = (BarsState *)state;
+
+    // Bars flash on the beat and dim towards the next one
+    uint8_t peak = tempo.confidence >= TEMPO_MIN_CONFIDENCE ? 255 - int(BARS_PULSE_DEPTH * tempo.phase) : 255;
 
     for (int j = 0; j < LED_MATRIX_N; j++) {
-        colorBufferA[j] = 1;
-        brightnessBuffer[j] = 255;
+        bars->color[j] = 1;
+        bars->brightness[j] = 255;
     }
 
     for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        float band = bandsBuffer[i];
+        float band = bars->bands[i];
         if (band > 1.0) band = 1.0;
 
         int left = int(band * LED_MATRIX_N_PER_BAND * 255);
-        for (int j = 0; i < LED_MATRIX_N_PER_BAND; j++) {
+        for (int j = 0; j < LED_MATRIX_N_PER_BAND; j++) {
 
-            colorBufferA[i * LED_MATRIX_N_PER_BAND + j] = 80 + j * 6;
-            brightnessBuffer[i * LED_MATRIX_N_PER_BAND + j] = left > 255 ? 255 : left;
+            bars->color[i * LED_MATRIX_N_PER_BAND + j] = 80 + j * 6;
+            bars->brightness[i * LED_MATRIX_N_PER_BAND + j] = scale8(left > 255 ? 255 : left, peak);
 
             left -= 255;
             if (left < 0) break;
         }
     }
+
+    frame->color = bars->color;
+    frame->brightness = bars->brightness;
 }
 
-static void updateSpectrum(float *bands) {
+//
+// Spectrum
+//
+
+#define SPECTRUM_ROWS_PER_BEAT 16 // Rows scrolled per beat when the tempo is known, otherwise one per frame
+
+typedef struct {
+    float bands[LED_MATRIX_N_BANDS]; // Smoothed bands that drive the animation
+    uint8_t color[LED_MATRIX_N];
+    float scroll;   // Fraction of a row scrolled but not shown yet
+    uint32_t beats; // Beat clock at the last update
+    float phase;
+} SpectrumState;
+
+static const CRGBPalette16 *const spectrumPalettes[] = {
+    &heatmapGreenPalette, // VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_GREEN
+    &heatmapBluePalette,  // VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_BLUE
+    &heatmapRedPalette,   // VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_RED
+    &heatmapPinkPalette,  // VISUALIZATION_PALETTE_SPECTRUM_HEATMAP_PINK
+};
+
+// Rise proportional to the jump, exponential fall
+static const SmoothingSegment spectrumSmoothingSegments[] = {
+    {0.6, 1.0, 1.0 / 2.0, 0.0},
+    {0.2, 1.0, 1.0 / 3.0, 0.0},
+    {0.0, 1.0, 1.0 / 4.0, 0.0},
+    {-1.0, 0.92, 0.0, 0.0},
+};
+
+static SmoothingProfile spectrumSmoothing = {spectrumSmoothingSegments, N_SEGMENTS(spectrumSmoothingSegments)};
+
+static HOT_CODE void updateSpectrum(void *state, float *bands, VisualizationFrame *frame) {
+    SpectrumState *spectrum = (SpectrumState *)state;
+
+    // With a known tempo, history scrolls by the beats elapsed since the last frame, so that
+    // a beat always spans the same number of rows. Jumps of the beat clock (e.g. the first frame) don't scroll.
+    int rows = 1;
+    if (tempo.confidence >= TEMPO_MIN_CONFIDENCE) {
+        float elapsed = (float)(tempo.beats - spectrum->beats) + tempo.phase - spectrum->phase;
+        spectrum->scroll += elapsed >= 0.0 && elapsed <= 1.0 ? elapsed * SPECTRUM_ROWS_PER_BEAT : 0.0;
+        rows = int(spectrum->scroll);
+        spectrum->scroll -= rows;
+        rows = rows > LED_MATRIX_N_PER_BAND ? LED_MATRIX_N_PER_BAND : rows;
+    }
+    spectrum->beats = tempo.beats;
+    spectrum->phase = tempo.phase;
+
     for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        float d = bands[i] - bandsBuffer[i];
-        if (d > 0.6) {
-            bandsBuffer[i] = (bandsBuffer[i] * 1.0 + bands[i]) / 2.0;
-        } else if (d > 0.2) {
-            bandsBuffer[i] = (bandsBuffer[i] * 2.0 + bands[i]) / 3.0;
-        } else if (d > 0.0) {
-            bandsBuffer[i] = (bandsBuffer[i] * 3.0 + bands[i]) / 4.0;
-        } else {
-            bandsBuffer[i] *= 0.92;
+        float band = spectrum->bands[i];
+        if (band > 1.0) band = 1.0;
+        uint8_t colorIndex = int(band * 255.0);
+        uint8_t *column = &spectrum->color[i * LED_MATRIX_N_PER_BAND];
+
+        // Without scrolling, the newest row keeps the peak of the frames it covers
+        if (rows == 0) {
+            column[0] = column[0] > colorIndex ? column[0] : colorIndex;
+            continue;
+        }
+        for (int j = LED_MATRIX_N_PER_BAND - 1; j >= rows; j--) {
+            column[j] = column[j - rows];
+        }
+        for (int j = 0; j < rows; j++) {
+            column[j] = colorIndex;
         }
     }
 
+    frame->color = spectrum->color;
+    frame->brightness = NULL;
+}
+
+//
+// Fire
+//
+
+typedef struct {
+    float bands[LED_MATRIX_N_BANDS]; // Smoothed bands that drive the animation
+    uint8_t heat[LED_MATRIX_N];      // Unblurred heat, rising from the bottom
+    uint8_t color[LED_MATRIX_N];     // Blurred heat
+} FireState;
+
+static const CRGBPalette16 *const firePalettes[] = {
+    &fireRedPalette,   // VISUALIZATION_PALETTE_FIRE_RED
+    &fireBluePalette,  // VISUALIZATION_PALETTE_FIRE_BLUE
+    &fireGreenPalette, // VISUALIZATION_PALETTE_FIRE_GREEN
+};
+
+// Instant rise, exponential fall
+static const SmoothingSegment fireSmoothingSegments[] = {
+    {0.0, 1.0, 1.0, 0.0},
+    {-1.0, 0.95, 0.0, 0.0},
+};
+
+static SmoothingProfile fireSmoothing = {fireSmoothingSegments, N_SEGMENTS(fireSmoothingSegments)};
+
+static HOT_CODE void updateFire(void *state, float *bands, VisualizationFrame *frame) {
+    FireState *fire = (FireState *)state;
+
     for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        float band = bandsBuffer[i];
+        float band = fire->bands[i];
         if (band > 1.0) band = 1.0;
-        uint8_t colorIndex = int(band * 255.0);
 
         for (int j = LED_MATRIX_N_PER_BAND - 1; j > 0; j--) {
-            colorBufferA[i * LED_MATRIX_N_PER_BAND + j] = colorBufferA[i * LED_MATRIX_N_PER_BAND + j - 1];
+            fire->heat[i * LED_MATRIX_N_PER_BAND + j] = fire->heat[i * LED_MATRIX_N_PER_BAND + j - 1] * 0.975;
         }
-        colorBufferA[i * LED_MATRIX_N_PER_BAND] = colorIndex;
+        fire->heat[i * LED_MATRIX_N_PER_BAND] += int(band * 255.0);
+        fire->heat[i * LED_MATRIX_N_PER_BAND] /= 2.0;
     }
+
+    gaussianBlur(LED_MATRIX_N_BANDS, LED_MATRIX_N_PER_BAND, fire->heat, fire->color);
+
+    frame->color = fire->color;
+    frame->brightness = NULL;
 }
 
-static void updateFire(float *bands) {
-    for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        float d = bands[i] - bandsBuffer[i];
-        if (d > 0.0) {
-            bandsBuffer[i] = bands[i];
-        } else {
-            bandsBuffer[i] *= 0.95;
+//
+// Sparks
+//
+
+#define SPARKS_PER_BAND    6    // Sparks spawned per frame in a column at full band
+#define SPARKS_PER_ONSET   48   // Additional sparks per unit of sudden rise of the raw band
+#define SPARKS_ONSET_RISE  0.1  // Smallest rise of the raw band between frames treated as an onset
+#define SPARKS_GRAVITY     6    // Rows per frame squared, fixed point
+#define SPARKS_DECAY       5    // Life lost per frame
+#define SPARKS_TRAIL_SCALE 200  // Fraction (of 256) of the color kept by trails every frame
+
+typedef struct {
+    float bands[LED_MATRIX_N_BANDS];    // Smoothed bands that drive the animation
+    float previous[LED_MATRIX_N_BANDS]; // Raw bands of the previous frame, for onsets
+    uint8_t color[LED_MATRIX_N];        // Fading trails with particles drawn on top
+} SparksState;
+
+static const CRGBPalette16 *const sparksPalettes[] = {
+    &fireRedPalette,     // VISUALIZATION_PALETTE_SPARKS_EMBER
+    &fireBluePalette,    // VISUALIZATION_PALETTE_SPARKS_ICE
+    &heatmapPinkPalette, // VISUALIZATION_PALETTE_SPARKS_PINK
+};
+
+// Instant rise, fast exponential fall, so that spawning follows the beat
+static const SmoothingSegment sparksSmoothingSegments[] = {
+    {0.0, 1.0, 1.0, 0.0},
+    {-1.0, 0.8, 0.0, 0.0},
+};
+
+static SmoothingProfile sparksSmoothing = {sparksSmoothingSegments, N_SEGMENTS(sparksSmoothingSegments)};
+
+static void setupSparks(void *state) {
+    particlesOwner = state;
+    clearParticles(&particles);
+}
+
+static HOT_CODE void updateSparks(void *state, float *bands, VisualizationFrame *frame) {
+    SparksState *sparks = (SparksState *)state;
+
+    for (int k = 0; k < LED_MATRIX_N; k++) {
+        sparks->color[k] = scale8(sparks->color[k], SPARKS_TRAIL_SCALE);
+    }
+
+    // Effect that lost the pool to a newer one (during a transition to itself) only fades out
+    if (particlesOwner == state) {
+        for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
+            float band = sparks->bands[i];
+            if (band > 1.0) band = 1.0;
+
+            // Fractional rate is dithered, so that quiet bands still spawn now and then
+            float rise = bands[i] - sparks->previous[i];
+            float rate = band * SPARKS_PER_BAND + (rise > SPARKS_ONSET_RISE ? rise * SPARKS_PER_ONSET : 0.0);
+            int n = int(rate + random8() / 256.0);
+
+            // Louder bands throw sparks higher, at most about 2/3 of the column
+            int16_t speed = 64 + int(band * 192);
+            for (int j = 0; j < n; j++) {
+                if (!spawnParticle(&particles, i, random8(), speed + random8(32), 160 + random8(96))) break;
+            }
+            sparks->previous[i] = bands[i];
         }
+
+        stepParticles(&particles, SPARKS_GRAVITY, SPARKS_DECAY, LED_MATRIX_N_PER_BAND);
+        drawParticles(&particles, sparks->color, LED_MATRIX_N_PER_BAND);
     }
 
+    frame->color = sparks->color;
+    frame->brightness = NULL;
+}
+
+//
+// Registry
+//
+
+#define N_PALETTES(palettes) (int)(sizeof(palettes) / sizeof(palettes[0]))
+
+// Read on every frame through the function pointers
+HOT_DATA static const Visualization visualizations[] = {
+    {"bars", sizeof(BarsState), NULL, updateColorBars, &barsSmoothing, barsPalettes, N_PALETTES(barsPalettes), LED_MATRIX_N_BANDS},
+    {"spectrum", sizeof(SpectrumState), NULL, updateSpectrum, &spectrumSmoothing, spectrumPalettes, N_PALETTES(spectrumPalettes), LED_MATRIX_N_BANDS},
+    {"fire", sizeof(FireState), NULL, updateFire, &fireSmoothing, firePalettes, N_PALETTES(firePalettes), LED_MATRIX_N_BANDS},
+    {"sparks", sizeof(SparksState), setupSparks, updateSparks, &sparksSmoothing, sparksPalettes, N_PALETTES(sparksPalettes), LED_MATRIX_N_BANDS},
+};
+
+static_assert(sizeof(visualizations) / sizeof(visualizations[0]) == VISUALIZATION_TYPE_MAX_VALUE + 1, "Visualization missing in registry");
+static_assert(N_PALETTES(barsPalettes) == VISUALIZATION_PALETTE_BARS_MAX_VALUE + 1, "Bars palette missing");
+static_assert(N_PALETTES(spectrumPalettes) == VISUALIZATION_PALETTE_SPECTRUM_MAX_VALUE + 1, "Spectrum palette missing");
+static_assert(N_PALETTES(firePalettes) == VISUALIZATION_PALETTE_FIRE_MAX_VALUE + 1, "Fire palette missing");
+static_assert(N_PALETTES(sparksPalettes) == VISUALIZATION_PALETTE_SPARKS_MAX_VALUE + 1, "Sparks palette missing");
+static_assert(sizeof(BarsState) <= VISUALIZATION_MAX_STATE_SIZE, "Bars state exceeds VISUALIZATION_MAX_STATE_SIZE");
+static_assert(sizeof(SpectrumState) <= VISUALIZATION_MAX_STATE_SIZE, "Spectrum state exceeds VISUALIZATION_MAX_STATE_SIZE");
+static_assert(sizeof(FireState) <= VISUALIZATION_MAX_STATE_SIZE, "Fire state exceeds VISUALIZATION_MAX_STATE_SIZE");
+static_assert(sizeof(SparksState) <= VISUALIZATION_MAX_STATE_SIZE, "Sparks state exceeds VISUALIZATION_MAX_STATE_SIZE");
+static_assert(offsetof(BarsState, bands) == 0, "Bars state must start with smoothed bands");
+static_assert(offsetof(SpectrumState, bands) == 0, "Spectrum state must start with smoothed bands");
+static_assert(offsetof(FireState, bands) == 0, "Fire state must start with smoothed bands");
+static_assert(offsetof(SparksState, bands) == 0, "Sparks state must start with smoothed bands");
+
+int getVisualizationCount() {
+    return sizeof(visualizations) / sizeof(visualizations[0]);
+}
+
+int getVisualizationPaletteCount(VisualizationType visualization) {
+    if (visualization < 0 || visualization >= getVisualizationCount()) return 0;
+    return visualizations[visualization].nPalettes;
+}
+
+const char *getVisualizationName(VisualizationType visualization) {
+    if (visualization < 0 || visualization >= getVisualizationCount()) return "none";
+    return visualizations[visualization].name;
+}
+
+int getVisualizationBandCount(VisualizationType visualization) {
+    if (visualization < 0 || visualization >= getVisualizationCount()) return LED_MATRIX_N_BANDS;
+    return visualizations[visualization].nBands;
+}
+
+/**
+ * @brief Zeroes the state of a visualization and prepares it for the first update.
+ */
+static void setupState(const Visualization *visualization, void *state) {
+    memset(state, 0, VISUALIZATION_MAX_STATE_SIZE);
+    setupSmoothingProfile(visualization->smoothing);
+    if (visualization->setup != NULL) {
+        visualization->setup(state);
+    }
+}
+
+/**
+ * @brief Computes the first band and the number of bands of every column for the band count.
+ */
+static void setupColumnMapping(int nBands) {
     for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
-        float band = bandsBuffer[i];
-        if (band > 1.0) band = 1.0;
+        int first = i * nBands / LED_MATRIX_N_BANDS;
+        int end = (i + 1) * nBands / LED_MATRIX_N_BANDS;
+        columnFirstBands[i] = first;
+        columnBandCounts[i] = end > first ? end - first : 1;
+    }
+    mappedBands = nBands;
+}
 
-        for (int j = LED_MATRIX_N_PER_BAND - 1; j > 0; j--) {
-            colorBufferB[i * LED_MATRIX_N_PER_BAND + j] = colorBufferB[i * LED_MATRIX_N_PER_BAND + j - 1] * 0.975;
+/**
+ * @brief Resamples bands to columns through the mapping, taking the loudest band of each column.
+ */
+static HOT_CODE void resampleBands(const float *bands, float *columns) {
+    for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
+        const float *first = &bands[columnFirstBands[i]];
+        float value = first[0];
+        for (int k = 1; k < columnBandCounts[i]; k++) {
+            value = first[k] > value ? first[k] : value;
         }
-        colorBufferB[i * LED_MATRIX_N_PER_BAND] += int(band * 255.0);
-        colorBufferB[i * LED_MATRIX_N_PER_BAND] /= 2.0;
+        columns[i] = value;
+    }
+}
+
+/**
+ * @brief Smooths bands of a layer and updates its visualization.
+ *
+ * Smoothing runs at the smaller of the band and column counts. With fewer bands than columns, the bands
+ * are smoothed at their count and resampled to the columns of the state through the current mapping.
+ * When the count changes, smoothed bands start from the columns that showed them.
+ *
+ * @param bands Input bands, `nBands` of them.
+ * @param columns Input bands resampled to columns, the same array as `bands` if there is a band per column.
+ */
+static HOT_CODE void updateLayer(VisualizationLayer *layer, const float *bands, float *columns, int nBands, VisualizationFrame *frame) {
+    float *state = (float *)layer->state;
+    const SmoothingProfile *smoothing = layer->visualization->smoothing;
+
+    if (nBands < LED_MATRIX_N_BANDS) {
+        if (layer->nSmoothed != nBands) {
+            for (int i = 0; i < nBands; i++) {
+                layer->smoothed[i] = state[i * LED_MATRIX_N_BANDS / nBands];
+            }
+            layer->nSmoothed = nBands;
+        }
+        smoothBands(smoothing, bands, layer->smoothed, nBands);
+        resampleBands(layer->smoothed, state);
+    } else {
+        smoothBands(smoothing, columns, state, LED_MATRIX_N_BANDS);
+        layer->nSmoothed = LED_MATRIX_N_BANDS;
+    }
+    layer->visualization->update(layer->state, columns, frame);
+}
+
+/**
+ * @brief Activates the specified visualization in the slot that is not used by the outgoing layer.
+ */
+static void setupLayer(VisualizationType visualization) {
+    if (visualization < 0 || visualization >= getVisualizationCount()) {
+        PRINTF("Unknown visualization %d. Halt!\n", visualization);
+        while (true) continue;
+    }
+    if (stateSlots[0] == NULL) {
+        PRINTF("LED strip is not set up. Halt!\n");
+        while (true) continue;
+    }
+
+    int slot = outgoingLayer.state == stateSlots[0] ? 1 : 0;
+    currentLayer.visualization = &visualizations[visualization];
+    currentLayer.state = stateSlots[slot];
+    currentLayer.palette = blankPalette;
+    currentLayer.smoothed = smoothedSlots[slot];
+    currentLayer.nSmoothed = 0;
+    decayFramesLeft = VISUALIZATION_DECAY_FRAMES;
+
+    setupState(currentLayer.visualization, currentLayer.state);
+}
+
+/**
+ * @brief Starts a transition from the current layer, which becomes the outgoing layer.
+ *
+ * If a transition is already in progress, its outgoing layer is dropped.
+ */
+static void startTransition(bool keepVisualization) {
+    outgoingLayer = currentLayer;
+    if (!keepVisualization) {
+        outgoingLayer.visualization = NULL;
+        outgoingLayer.state = NULL;
+    }
+    transitionFramesLeft = VISUALIZATION_TRANSITION_FRAMES;
+}
+
+void setupVisualization(VisualizationType visualization) {
+    if (currentLayer.visualization != NULL) {
+        PRINTF("Visualization is already set up. Halt!\n");
+        while (true) continue;
+    }
+    setupLayer(visualization);
+}
+
+void transitionVisualization(VisualizationType visualization) {
+    if (currentLayer.visualization == NULL) {
+        PRINTF("Visualization is not set up. Halt!\n");
+        while (true) continue;
+    }
+    startTransition(true);
+    setupLayer(visualization);
+    currentLayer.palette = *currentLayer.visualization->palettes[0];
+}
+
+void setVisualizationPalette(VisualizationPalette palette) {
+    if (currentLayer.visualization == NULL) {
+        PRINTF("Visualization is not set up. Halt!\n");
+        while (true) continue;
+    }
+    if (palette < 0 || palette >= currentLayer.visualization->nPalettes) return;
+
+    // Palette of an incoming visualization is changed without starting another transition
+    if (transitionFramesLeft == 0) startTransition(false);
+    currentLayer.palette = *currentLayer.visualization->palettes[palette];
+}
+
+void teardownVisualization() {
+    if (currentLayer.visualization == NULL) {
+        PRINTF("Visualization is not set up. Halt!\n");
+        while (true) continue;
     }
+    currentLayer = {NULL, NULL, blankPalette, NULL, 0};
+    outgoingLayer = {NULL, NULL, blankPalette, NULL, 0};
+    transitionFramesLeft = 0;
+    lastFrame = {NULL, NULL};
 
-    gaussianBlur(LED_MATRIX_N_BANDS, LED_MATRIX_N_PER_BAND, colorBufferB, colorBufferA);
+    for (int i = 0; i < LED_MATRIX_N; i++) {
+        leds[i] = CRGB::Black;
+    }
+}
+
+/**
+ * @brief Resamples bands to columns, updates the current and outgoing layers and renders them into the LED array (`leds`).
+ */
+static HOT_CODE void renderLayers(float *bands, int nBands) {
+    float resampled[LED_MATRIX_N_BANDS];
+    float *columns = bands;
+    if (nBands != LED_MATRIX_N_BANDS) {
+        if (nBands != mappedBands) setupColumnMapping(nBands);
+        resampleBands(bands, resampled);
+        columns = resampled;
+    }
+
+    VisualizationFrame frame;
+    updateLayer(&currentLayer, bands, columns, nBands, &frame);
+    lastFrame = frame;
+
+    if (transitionFramesLeft == 0) {
+        pushBuffer(&frame, &currentLayer.palette);
+        return;
+    }
+
+    VisualizationFrame outgoingFrame = frame;
+    if (outgoingLayer.visualization != NULL) {
+        updateLayer(&outgoingLayer, bands, columns, nBands, &outgoingFrame);
+    }
+
+    uint8_t amount = 255 * (VISUALIZATION_TRANSITION_FRAMES - transitionFramesLeft + 1) / (VISUALIZATION_TRANSITION_FRAMES + 1);
+    pushBlendedBuffer(&outgoingFrame, &outgoingLayer.palette, &frame, &currentLayer.palette, amount);
+
+    if (--transitionFramesLeft == 0) {
+        outgoingLayer = {NULL, NULL, blankPalette, NULL, 0};
+    }
+}
+
+void updateVisualization(float *bands, int nBands) {
+    if (currentLayer.visualization == NULL) return;
+    if (nBands < 1 || nBands > 255) {
+        PRINTF("Unsupported number of bands %d. Halt!\n", nBands);
+        while (true) continue;
+    }
+
+    decayFramesLeft = VISUALIZATION_DECAY_FRAMES;
+    renderLayers(bands, nBands);
+}
+
+void decayVisualization() {
+    if (currentLayer.visualization == NULL) return;
+
+    float bands[LED_MATRIX_N_BANDS] = {0.0};
+    decayFramesLeft -= decayFramesLeft > 0 ? 1 : 0;
+    renderLayers(bands, LED_MATRIX_N_BANDS);
+}
+
+void setVisualizationTempo(const TempoEstimate *estimate) {
+    tempo = *estimate;
+}
+
+bool isVisualizationDecayed() {
+    return currentLayer.visualization != NULL && decayFramesLeft == 0 && transitionFramesLeft == 0;
+}
+
+void setVisualizationBlurRadius(int radius) {
+    radius = radius < 0 ? 0 : radius;
+    blurRadius = radius > VISUALIZATION_MAX_BLUR_RADIUS ? VISUALIZATION_MAX_BLUR_RADIUS : radius;
+}
+
+int getVisualizationBlurRadius() {
+    return blurRadius;
 }
 
-void updateVisualization(float *bands) {
-    switch (currentVisualization) {
-        case VISUALIZATION_TYPE_BARS:
-            updateColorBars(bands);
-            break;
-        case VISUALIZATION_TYPE_SPECTRUM:
-            updateSpectrum(bands);
-            break;
-        case VISUALIZATION_TYPE_FIRE:
-            updateFire(bands);
-            break;
+void calibrateVisualizations() {
+    if (currentLayer.visualization != NULL) {
+        PRINTF("Visualization is already set up. Halt!\n");
+        while (true) continue;
+    }
+    if (stateSlots[0] == NULL) {
+        PRINTF("LED strip is not set up. Halt!\n");
+        while (true) continue;
     }
-    pushBuffer();
+
+    // Moving synthetic bands, so that effects don't settle into a cheaper steady state
+    float bands[LED_MATRIX_N_BANDS];
+    VisualizationFrame frame;
+    for (int type = 0; type <= VISUALIZATION_TYPE_MAX_VALUE; type++) {
+        const Visualization *visualization = &visualizations[type];
+        VisualizationLayer layer = {visualization, stateSlots[0], blankPalette, smoothedSlots[0], 0};
+        for (int radius = 0; radius <= VISUALIZATION_MAX_BLUR_RADIUS; radius++) {
+            blurRadius = radius;
+            setupState(visualization, stateSlots[0]);
+
+            unsigned long timeStart = micros();
+            for (int n = 0; n < VISUALIZATION_N_CALIBRATION_FRAMES; n++) {
+                for (int i = 0; i < LED_MATRIX_N_BANDS; i++) {
+                    bands[i] = float((i * 7 + n * 5) % LED_MATRIX_N_BANDS) / LED_MATRIX_N_BANDS;
+                }
+                updateLayer(&layer, bands, bands, LED_MATRIX_N_BANDS, &frame);
+                pushBuffer(&frame, visualization->palettes[0]);
+            }
+            renderCosts[type][radius] = (micros() - timeStart) / VISUALIZATION_N_CALIBRATION_FRAMES;
+        }
+        PRINTF(
+            "Visualization %s: %luus per frame (blur radius %d)\n",
+            visualization->name,
+            renderCosts[type][VISUALIZATION_MAX_BLUR_RADIUS],
+            VISUALIZATION_MAX_BLUR_RADIUS
+        );
+    }
+
+    // Time to send the frame depends only on the number of LEDs
+    for (int i = 0; i < LED_MATRIX_N; i++) {
+        leds[i] = CRGB::Black;
+    }
+    unsigned long timeStart = micros();
+    for (int n = 0; n < VISUALIZATION_N_CALIBRATION_FRAMES; n++) {
+        FastLED.show();
+    }
+    showCost = (micros() - timeStart) / VISUALIZATION_N_CALIBRATION_FRAMES;
+    PRINTF("LED strip: %luus per frame\n", showCost);
+
+    blurRadius = VISUALIZATION_MAX_BLUR_RADIUS;
+    memset(stateSlots[0], 0, VISUALIZATION_MAX_STATE_SIZE);
+}
+
+unsigned long getVisualizationCost(VisualizationType visualization, int radius) {
+    if (visualization < 0 || visualization > VISUALIZATION_TYPE_MAX_VALUE) return 0;
+    if (radius < 0 || radius > VISUALIZATION_MAX_BLUR_RADIUS) return 0;
+    if (renderCosts[visualization][radius] == 0) return 0;
+    return renderCosts[visualization][radius] + showCost;
+}
+
+void getVisualizationCalibration(VisualizationCalibration *calibration) {
+    memcpy(calibration->renderCosts, renderCosts, sizeof(renderCosts));
+    calibration->showCost = showCost;
+}
+
+void setVisualizationCalibration(const VisualizationCalibration *calibration) {
+    memcpy(renderCosts, calibration->renderCosts, sizeof(renderCosts));
+    showCost = calibration->showCost;
+}
+
+bool getVisualizationFrame(const uint8_t **color, const uint8_t **brightness, const uint8_t **palette) {
+    if (currentLayer.visualization == NULL || lastFrame.color == NULL) return false;
+
+    *color = lastFrame.color;
+    *brightness = lastFrame.brightness;
+    *palette = (const uint8_t *)currentLayer.palette.entries;
+    return true;
+}
+
+bool isVisualizationTransitionActive() {
+    return transitionFramesLeft > 0;
 }
 
 void showVisualization() {
@@ -0,0 +1,109 @@
+/**
+ * @file bands.cpp
+ * @brief Band count benchmark.
+ *
+ * An alternative to the main loop that compares band counts from `AUDIO_MIN_BANDS` to `AUDIO_MAX_BANDS`
+ * with both engines, on synthetic pink noise delivered without pacing. Counts are switched every
+ * `N_LOOPS` frames and for each of them the following is printed:
+ * - compute time of `processAudioData` and `scaleAudioData` per frame,
+ * - time of `updateVisualization`, which smooths and resamples the bands and updates the effect,
+ * - time of smoothing alone, at the count `updateVisualization` smooths at (the bands, at most one per column).
+ *
+ * Work per band scales with the count, FFTs don't, so the FFT engine gains less than the filterbank.
+ * On the render side only smoothing and resampling scale with the count, effects always draw all columns.
+ */
+
+#include <Arduino.h>
+
+#include "audio.h"
+#include "smoothing.h"
+#include "synthetic.h"
+#include "visualization.h"
+
+// Config
+#define N_LOOPS 256
+
+__attribute__((aligned(16))) float audioBands[AUDIO_MAX_BANDS] = {0.0};
+float smoothedBands[LED_MATRIX_N_BANDS] = {0.0};
+
+// Same shape as the profile of bars
+const SmoothingSegment smoothingSegments[] = {
+    {0.2, 1.0, 1.0 / 3.0, 0.0},
+    {0.0, 1.0, 1.0 / 7.0, 0.0},
+    {-1.0, 1.0, 0.0, 0.02},
+};
+SmoothingProfile smoothing = {smoothingSegments, (int)(sizeof(smoothingSegments) / sizeof(smoothingSegments[0]))};
+
+uint loops = 0;
+int bandCount = AUDIO_MIN_BANDS;
+AudioEngine audioEngine = AUDIO_ENGINE_FFT;
+
+float dt_processAudioData = 0.0;
+float dt_updateVisualization = 0.0;
+float dt_smoothBands = 0.0;
+
+void resetCounters() {
+    loops = 0;
+    dt_processAudioData = 0.0;
+    dt_updateVisualization = 0.0;
+    dt_smoothBands = 0.0;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupAudioProcessing(false);
+    setAudioEngine(audioEngine);
+    setAudioBandCount(bandCount);
+    setSyntheticSignal(SYNTHETIC_SIGNAL_PINK_NOISE);
+    setupAudioSource(AUDIO_SOURCE_SYNTHETIC);
+    setupAudioTables(AUDIO_SOURCE_SYNTHETIC);
+    resetAudioBandScale(AUDIO_SOURCE_SYNTHETIC);
+
+    setupLedStrip();
+    setupVisualization(VISUALIZATION_TYPE_BARS);
+    setVisualizationPalette(0);
+    setupSmoothingProfile(&smoothing);
+
+    resetCounters();
+}
+
+void loop() {
+    readAudioDataToBuffer();
+
+    unsigned long timeStart = micros();
+    processAudioData(audioBands);
+    scaleAudioData(audioBands);
+    unsigned long timeEnd = micros();
+    dt_processAudioData += timeEnd - timeStart;
+
+    timeStart = micros();
+    updateVisualization(audioBands, getAudioBandCount());
+    dt_updateVisualization += micros() - timeStart;
+
+    int nSmoothed = getAudioBandCount() < LED_MATRIX_N_BANDS ? getAudioBandCount() : LED_MATRIX_N_BANDS;
+    timeStart = micros();
+    smoothBands(&smoothing, audioBands, smoothedBands, nSmoothed);
+    dt_smoothBands += micros() - timeStart;
+
+    if (++loops >= N_LOOPS) {
+        Serial.printf("Bands: %d (%s)\n", getAudioBandCount(), audioEngine == AUDIO_ENGINE_FFT ? "fft" : "filterbank");
+        Serial.printf("  compute per frame:    %.2fus\n", dt_processAudioData / N_LOOPS);
+        Serial.printf("  update per frame:     %.2fus\n", dt_updateVisualization / N_LOOPS);
+        Serial.printf("  smoothing per frame:  %.2fus (%d values)\n", dt_smoothBands / N_LOOPS, getAudioBandCount() < LED_MATRIX_N_BANDS ? getAudioBandCount() : LED_MATRIX_N_BANDS);
+
+        // All counts with one engine, then all counts with the other one
+        bandCount *= 2;
+        if (bandCount > AUDIO_MAX_BANDS) {
+            bandCount = AUDIO_MIN_BANDS;
+            audioEngine = audioEngine == AUDIO_ENGINE_FFT ? AUDIO_ENGINE_FILTERBANK : AUDIO_ENGINE_FFT;
+            setAudioEngine(audioEngine);
+        }
+        setAudioBandCount(bandCount);
+        setupAudioTables(AUDIO_SOURCE_SYNTHETIC);
+        resetAudioBandScale(AUDIO_SOURCE_SYNTHETIC);
+
+        resetCounters();
+    }
+}
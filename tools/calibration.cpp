@@ -61,7 +61,7 @@
 #error "At least one mode!"
 #endif
 
-__attribute__((aligned(16))) float audioBands[AUDIO_N_BANDS] = {0.0};
+__attribute__((aligned(16))) float audioBands[AUDIO_MAX_BANDS] = {0.0};
 __attribute__((aligned(16))) float table[AUDIO_N_BANDS] = {0.0};
 int counter = 0;
 
@@ -73,7 +73,7 @@ void setup() {
     delayMicroseconds(500);
 
     setupAudioSource(AUDIO_SOURCE);
-    setupAudioProcessing();
+    setupAudioProcessing(false);
 
 #ifndef NOISE_CALIBRATION_MODE
     setupAudioNoiseTable(AUDIO_SOURCE);
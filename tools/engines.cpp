@@ -0,0 +1,95 @@
+/**
+ * @file engines.cpp
+ * @brief Band analysis engines benchmark.
+ *
+ * An alternative to the main loop that compares the FFT and filterbank engines. Engines are
+ * switched every `N_LOOPS` frames and for each of them the following is printed:
+ * - compute time of `processAudioData` per frame and per second of audio (CPU load),
+ * - number of samples per frame,
+ * - measured interval between frames and its jitter, next to the nominal one derived from samples per frame,
+ * - analysis latency, estimated as the age of the average sample in the frame plus compute time.
+ *
+ * Nothing is rendered, so that the results are not affected by the LED matrix.
+ */
+
+#include <Arduino.h>
+
+#include "audio.h"
+
+// Config
+#define AUDIO_SOURCE AUDIO_SOURCE_LINE_IN
+#define N_LOOPS      512
+
+__attribute__((aligned(16))) float audioBands[AUDIO_MAX_BANDS] = {0.0};
+
+uint loops = 0;
+AudioEngine audioEngine = AUDIO_ENGINE_FFT;
+
+float dt_processAudioData = 0.0;
+float nSamples = 0.0;
+float frameIntervalMin = 0.0;
+float frameIntervalMax = 0.0;
+float frameIntervalSum = 0.0;
+int nFrameIntervals = 0;
+unsigned long lastFrameTime = 0;
+
+void resetCounters() {
+    loops = 0;
+    dt_processAudioData = 0.0;
+    nSamples = 0.0;
+    frameIntervalMin = 1e9;
+    frameIntervalMax = 0.0;
+    frameIntervalSum = 0.0;
+    nFrameIntervals = 0;
+    lastFrameTime = 0;
+}
+
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setAudioEngine(audioEngine);
+    setupAudioSource(AUDIO_SOURCE);
+    setupAudioTables(AUDIO_SOURCE);
+    setupAudioProcessing(false);
+
+    resetCounters();
+}
+
+void loop() {
+    readAudioDataToBuffer();
+
+    unsigned long timeStart = micros();
+    processAudioData(audioBands);
+    unsigned long timeEnd = micros();
+
+    dt_processAudioData += timeEnd - timeStart;
+    nSamples += getAudioBufferLength();
+    if (lastFrameTime != 0) {
+        float frameInterval = timeStart - lastFrameTime;
+        frameIntervalMin = frameInterval < frameIntervalMin ? frameInterval : frameIntervalMin;
+        frameIntervalMax = frameInterval > frameIntervalMax ? frameInterval : frameIntervalMax;
+        frameIntervalSum += frameInterval;
+        nFrameIntervals++;
+    }
+    lastFrameTime = timeStart;
+
+    if (++loops >= N_LOOPS) {
+        float samplesPerFrame = nSamples / N_LOOPS;
+        float computePerFrame = dt_processAudioData / N_LOOPS;
+        float audioPerFrame = samplesPerFrame * 1000000.0 / getAudioSamplingRate();
+
+        Serial.printf("Engine: %s\n", audioEngine == AUDIO_ENGINE_FFT ? "fft" : "filterbank");
+        Serial.printf("  samples per frame:    %.1f\n", samplesPerFrame);
+        Serial.printf("  compute per frame:    %.2fus\n", computePerFrame);
+        Serial.printf("  cpu load:             %.2f%%\n", 100.0 * computePerFrame / audioPerFrame);
+        Serial.printf("  frame interval:       %.2fus (min %.2fus, max %.2fus, nominal %.2fus)\n", nFrameIntervals > 0 ? frameIntervalSum / nFrameIntervals : 0.0, frameIntervalMin, frameIntervalMax, audioPerFrame);
+        Serial.printf("  latency:              %.2fus\n", audioPerFrame / 2.0 + computePerFrame);
+
+        audioEngine = audioEngine == AUDIO_ENGINE_FFT ? AUDIO_ENGINE_FILTERBANK : AUDIO_ENGINE_FFT;
+        setAudioEngine(audioEngine);
+        setupAudioTables(AUDIO_SOURCE);
+
+        resetCounters();
+    }
+}
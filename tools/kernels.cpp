@@ -0,0 +1,331 @@
+/**
+ * @file kernels.cpp
+ * @brief Equivalence check and micro-benchmarks of the vector kernels.
+ *
+ * An alternative to the main loop that first checks every kernel from `kernels.h` against a plain
+ * reference loop on random input (within `TOLERANCE` for floats, exactly for integers), and then
+ * times it against the scalar loop it replaced in audio processing (per-element branches and divides).
+ * Each kernel runs `N_REPEATS` times on `N` elements and the average time per call is printed for both.
+ *
+ * On the device, kernels use esp-dsp where available. The portable loops also run on the host, with
+ * the `kernels_native` environment (`pio run -e kernels_native -t exec`) or directly:
+ *   g++ -std=gnu++11 -O2 -I include src/kernels.cpp tools/kernels.cpp -o kernels && ./kernels
+ * On the host the exit status is nonzero if any kernel doesn't match its reference.
+ */
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#include <cstdio>
+#endif
+#include <cfloat>
+#include <cmath>
+
+#include "kernels.h"
+
+#ifdef ARDUINO
+#define REPORT Serial.printf
+#else
+#define REPORT printf
+
+static unsigned long micros() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+// Config
+#define N         1024
+#define N_REPEATS 256
+#define SHIFT     12   // Conditioning shift of raw I2S samples in capture
+#define TOLERANCE 1e-5 // Relative error allowed for float kernels
+#define N_DFT     64   // Size of the two-signal spectrum checked by `kernelSeparateMagnitudes`, a naive DFT
+
+__attribute__((aligned(16))) int32_t samples[N];
+__attribute__((aligned(16))) int32_t stereo[N * 2];
+__attribute__((aligned(16))) int32_t shifted[N * 2];
+__attribute__((aligned(16))) float a[N * 2];
+__attribute__((aligned(16))) float b[N];
+__attribute__((aligned(16))) float out[N * 2];
+__attribute__((aligned(16))) float expected[N * 2];
+__attribute__((aligned(16))) int32_t splitA[N];
+__attribute__((aligned(16))) int32_t splitB[N];
+volatile float sink = 0.0;
+static uint32_t randomState = 1;
+static int nFailed = 0;
+
+#define BENCHMARK(name, code)                                            \
+    do {                                                                 \
+        unsigned long timeStart = micros();                              \
+        for (int repeat = 0; repeat < N_REPEATS; repeat++) {             \
+            code;                                                        \
+        }                                                                \
+        float dt = float(micros() - timeStart) / N_REPEATS;              \
+        REPORT("  %-24s %8.2fus per call\n", name, dt);                  \
+    } while (0)
+
+/**
+ * @brief Returns a random integer from `low` to `high - 1` (xorshift), the same on the host and the device.
+ */
+int32_t randomInt(int32_t low, int32_t high) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return low + (int32_t)(randomState % (uint32_t)(high - low));
+}
+
+/**
+ * @brief Compares float results with the expected ones and prints the verdict of the kernel.
+ */
+void checkFloats(const char *name, const float *result, const float *reference, int n) {
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+        float error = fabsf(result[i] - reference[i]);
+        mismatches += error > TOLERANCE * (fabsf(reference[i]) + 1.0f) ? 1 : 0;
+    }
+    nFailed += mismatches > 0 ? 1 : 0;
+    REPORT("  %-24s %s (%d/%d mismatches)\n", name, mismatches > 0 ? "FAILED" : "ok", mismatches, n);
+}
+
+/**
+ * @brief Compares integer results with the expected ones exactly and prints the verdict of the kernel.
+ */
+void checkIntegers(const char *name, const int64_t *result, const int64_t *reference, int n) {
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+        mismatches += result[i] != reference[i] ? 1 : 0;
+    }
+    nFailed += mismatches > 0 ? 1 : 0;
+    REPORT("  %-24s %s (%d/%d mismatches)\n", name, mismatches > 0 ? "FAILED" : "ok", mismatches, n);
+}
+
+/**
+ * @brief Checks every kernel against a plain loop of its definition in `kernels.h`.
+ *
+ * @return `true` if all kernels match.
+ */
+bool checkKernels() {
+    static int64_t results[N * 2];
+    static int64_t references[N * 2];
+    nFailed = 0;
+    REPORT("Kernel equivalence (%d elements):\n", N);
+
+    kernelToFloat(samples, out, 2, N);
+    for (int i = 0; i < N; i++) expected[i] = samples[i];
+    for (int i = 0; i < N; i++) out[i] = out[i * 2];
+    checkFloats("toFloat", out, expected, N);
+
+    int64_t sum = kernelDownmix(stereo, splitA, SHIFT, N);
+    int64_t expectedSum = 0;
+    for (int i = 0; i < N; i++) {
+        references[i] = (stereo[2 * i] >> SHIFT) + (stereo[2 * i + 1] >> SHIFT);
+        results[i] = splitA[i];
+        expectedSum += references[i];
+    }
+    results[N] = sum;
+    references[N] = expectedSum;
+    checkIntegers("downmix", results, references, N + 1);
+
+    for (int midSide = 0; midSide <= 1; midSide++) {
+        int64_t sums[2];
+        int64_t expectedSums[2] = {0, 0};
+        kernelSplitStereo(stereo, splitA, splitB, SHIFT, midSide, sums, N);
+        for (int i = 0; i < N; i++) {
+            int64_t l = stereo[2 * i] >> SHIFT;
+            int64_t r = stereo[2 * i + 1] >> SHIFT;
+            references[2 * i] = midSide ? l + r : l;
+            references[2 * i + 1] = midSide ? l - r : r;
+            results[2 * i] = splitA[i];
+            results[2 * i + 1] = splitB[i];
+            expectedSums[0] += references[2 * i];
+            expectedSums[1] += references[2 * i + 1];
+        }
+        checkIntegers(midSide ? "splitStereo midSide" : "splitStereo", results, references, N * 2);
+        checkIntegers(midSide ? "splitStereo midSide sums" : "splitStereo sums", sums, expectedSums, 2);
+    }
+
+    results[0] = kernelSum(samples, N);
+    references[0] = 0;
+    for (int i = 0; i < N; i++) references[0] += samples[i];
+    checkIntegers("sum", results, references, 1);
+
+    // Accumulated in double, so the reference is more precise than the kernel, not the other way around
+    double sumSquares = 0.0;
+    for (int i = 0; i < N; i++) sumSquares += ((double)samples[i] - 12.5) * ((double)samples[i] - 12.5);
+    out[0] = kernelSumSquares(samples, 12.5, N);
+    expected[0] = sumSquares;
+    checkFloats("sumSquares", out, expected, 1);
+
+    kernelWindowToComplex(samples, 12.5, b + N - 1, -1, out, N);
+    for (int i = 0; i < N; i++) {
+        expected[2 * i] = ((float)samples[i] - 12.5f) * b[N - 1 - i];
+        expected[2 * i + 1] = 0.0f;
+    }
+    checkFloats("windowToComplex", out, expected, N * 2);
+
+    kernelWindowPairToComplex(samples, splitA, 12.5, -7.0, b, 1, out, N);
+    for (int i = 0; i < N; i++) {
+        expected[2 * i] = ((float)samples[i] - 12.5f) * b[i];
+        expected[2 * i + 1] = ((float)splitA[i] + 7.0f) * b[i];
+    }
+    checkFloats("windowPairToComplex", out, expected, N * 2);
+
+    kernelMultiply(a, 2, b + N - 1, -1, out, 1, N);
+    for (int i = 0; i < N; i++) expected[i] = a[2 * i] * b[N - 1 - i];
+    checkFloats("multiply", out, expected, N);
+
+    kernelSubtract(a, b, out, N);
+    for (int i = 0; i < N; i++) expected[i] = a[i] - b[i];
+    checkFloats("subtract", out, expected, N);
+
+    kernelScale(a, out, 0.001f, N);
+    for (int i = 0; i < N; i++) expected[i] = a[i] * 0.001f;
+    checkFloats("scale", out, expected, N);
+
+    for (int i = 0; i < N; i++) out[i] = a[i];
+    kernelClamp(out, -50000.0f, 50000.0f, N);
+    for (int i = 0; i < N; i++) expected[i] = a[i] < -50000.0f ? -50000.0f : (a[i] > 50000.0f ? 50000.0f : a[i]);
+    checkFloats("clamp", out, expected, N);
+
+    out[0] = kernelMax(a, -FLT_MAX, N);
+    out[1] = kernelMax(a, FLT_MAX, N);
+    expected[0] = -FLT_MAX;
+    for (int i = 0; i < N; i++) expected[0] = a[i] > expected[0] ? a[i] : expected[0];
+    expected[1] = FLT_MAX;
+    checkFloats("max", out, expected, 2);
+
+    for (int i = 0; i < N * 2; i++) out[i] = a[i];
+    kernelMagnitude(out, out, N);
+    for (int i = 0; i < N; i++) expected[i] = sqrtf(a[2 * i] * a[2 * i] + a[2 * i + 1] * a[2 * i + 1]);
+    checkFloats("magnitude in place", out, expected, N);
+
+    // Spectrum of `re + j * im` by a naive DFT, against magnitudes of separate DFTs of `re` and `im`
+    for (int k = 0; k < N_DFT; k++) {
+        double xRe = 0.0, xIm = 0.0, aRe = 0.0, aIm = 0.0, bRe = 0.0, bIm = 0.0;
+        for (int i = 0; i < N_DFT; i++) {
+            double angle = -2.0 * M_PI * k * i / N_DFT;
+            double re = a[2 * i];
+            double im = a[2 * i + 1];
+            xRe += re * cos(angle) - im * sin(angle);
+            xIm += re * sin(angle) + im * cos(angle);
+            aRe += re * cos(angle);
+            aIm += re * sin(angle);
+            bRe += im * cos(angle);
+            bIm += im * sin(angle);
+        }
+        out[2 * k] = xRe;
+        out[2 * k + 1] = xIm;
+        if (k < N_DFT / 2) {
+            expected[2 * k] = sqrt(aRe * aRe + aIm * aIm);
+            expected[2 * k + 1] = sqrt(bRe * bRe + bIm * bIm);
+        }
+    }
+    kernelSeparateMagnitudes(out, N_DFT);
+    checkFloats("separateMagnitudes", out, expected, N_DFT);
+
+    REPORT("%s\n", nFailed > 0 ? "FAILED" : "PASSED");
+    return nFailed == 0;
+}
+
+/**
+ * @brief Fills inputs with random values.
+ */
+void setupInputs() {
+    for (int i = 0; i < N; i++) {
+        samples[i] = randomInt(-100000, 100000);
+        stereo[i * 2 + 0] = randomInt(-100000, 100000) * 4096;
+        stereo[i * 2 + 1] = randomInt(-100000, 100000) * 4096;
+        a[i * 2 + 0] = randomInt(-100000, 100000);
+        a[i * 2 + 1] = randomInt(-100000, 100000);
+        b[i] = randomInt(1, 100000) / 100000.0;
+    }
+}
+
+/**
+ * @brief Times every kernel against the scalar loop it replaced.
+ */
+void runBenchmarks() {
+    REPORT("Kernels (%d elements):\n", N);
+
+    BENCHMARK("toFloat scalar", for (int i = 0; i < N; i++) out[i * 2] = samples[i]);
+    BENCHMARK("toFloat kernel", kernelToFloat(samples, out, 2, N));
+
+    BENCHMARK("window scalar", for (int i = 0; i < N; i++) out[i * 2] = a[i] * b[i]);
+    BENCHMARK("window kernel", kernelMultiply(a, 1, b, 1, out, 2, N));
+    BENCHMARK("window reversed kernel", kernelMultiply(a, 1, b + N - 1, -1, out, 2, N));
+
+    // Capture conditioning and FFT input: separate passes against fused kernels
+    BENCHMARK("capture passes", {
+        // Shifted into a copy, so that raw samples stay the same for every repeat
+        for (int i = 0; i < N * 2; i++) shifted[i] = stereo[i] >> SHIFT;
+        for (int i = 0; i < N; i++) samples[i] = shifted[i * 2] + shifted[i * 2 + 1];
+        float avg = 0.0;
+        for (int i = 0; i < N; i++) avg += samples[i];
+        avg /= N;
+        for (int i = 0; i < N; i++) samples[i] -= avg;
+        kernelToFloat(samples, out, 2, N);
+        kernelMultiply(out, 2, b, 1, out, 2, N);
+        for (int i = 0; i < N; i++) out[i * 2 + 1] = 0;
+    });
+    BENCHMARK("capture fused kernels", {
+        int64_t sum = kernelDownmix(stereo, samples, SHIFT, N);
+        kernelWindowToComplex(samples, (float)sum / N, b, 1, out, N);
+    });
+
+    BENCHMARK("magnitude scalar", for (int i = 0; i < N; i++) out[i] = sqrtf(a[i * 2] * a[i * 2] + a[i * 2 + 1] * a[i * 2 + 1]));
+    BENCHMARK("magnitude kernel", kernelMagnitude(a, out, N));
+
+    BENCHMARK("subtract scalar", for (int i = 0; i < N; i++) out[i] = a[i] - b[i]);
+    BENCHMARK("subtract kernel", kernelSubtract(a, b, out, N));
+
+    BENCHMARK("clamp scalar", for (int i = 0; i < N; i++) {
+        out[i] = a[i] * b[i];
+        out[i] = out[i] < 0.0 ? 0.0 : out[i];
+    });
+    BENCHMARK("clamp kernel", kernelMultiply(a, 1, b, 1, out, 1, N); kernelClamp(out, 0.0, FLT_MAX, N));
+
+    BENCHMARK("max scalar", {
+        float max = 0.0;
+        for (int i = 0; i < N; i++) {
+            max = max < a[i] ? a[i] : max;
+        }
+        sink = max;
+    });
+    BENCHMARK("max kernel", sink = kernelMax(a, 0.0, N));
+
+    BENCHMARK("scale scalar", {
+        float scale = sink + 2.0;
+        for (int i = 0; i < N; i++) {
+            out[i] = a[i] / (scale * 0.95);
+            out[i] = out[i] > 1.0 ? 1.0 : out[i];
+        }
+    });
+    BENCHMARK("scale kernel", {
+        float scale = sink + 2.0;
+        kernelScale(a, out, 1.0 / (scale * 0.95), N);
+        kernelClamp(out, 0.0, 1.0, N);
+    });
+}
+
+#ifdef ARDUINO
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupInputs();
+}
+
+void loop() {
+    checkKernels();
+    runBenchmarks();
+    delay(5000);
+}
+#else
+int main() {
+    setupInputs();
+    bool passed = checkKernels();
+    runBenchmarks();
+    return passed ? 0 : 1;
+}
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file particles.cpp
+ * @brief Particle pool benchmark.
+ *
+ * An alternative to the main loop that times one frame of the particle pool (step and draw) with
+ * the pool held at a fixed number of live particles, from `N_MIN_PARTICLES` up to the capacity used by
+ * visualizations. Particles killed during a frame are respawned, so spawning is timed as well.
+ * For each number of particles the time per frame, per particle and the share of the 60 FPS frame
+ * period is printed.
+ */
+
+#include <Arduino.h>
+
+#define FASTLED_INTERNAL // Silence FastLED SPI warning
+#include <FastLED.h>
+
+#include "particles.h"
+#include "visualization.h"
+
+// Config
+#define N_MIN_PARTICLES 128
+#define N_FRAMES        256
+#define GRAVITY         6
+#define DECAY           5
+
+ParticlePool pool;
+uint8_t color[LED_MATRIX_N];
+
+void spawnUntil(int count) {
+    while (pool.count < count) {
+        spawnParticle(&pool, random8(LED_MATRIX_N_BANDS), random8(), 64 + random8(192), 160 + random8(96));
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupParticlePool(&pool, VISUALIZATION_MAX_PARTICLES, "benchmark particles");
+}
+
+void loop() {
+    Serial.printf("Particles (%d frames each):\n", N_FRAMES);
+
+    for (int count = N_MIN_PARTICLES; count <= VISUALIZATION_MAX_PARTICLES; count *= 2) {
+        clearParticles(&pool);
+        spawnUntil(count);
+
+        unsigned long timeStart = micros();
+        for (int frame = 0; frame < N_FRAMES; frame++) {
+            stepParticles(&pool, GRAVITY, DECAY, LED_MATRIX_N_PER_BAND);
+            drawParticles(&pool, color, LED_MATRIX_N_PER_BAND);
+            spawnUntil(count);
+        }
+        float dt = float(micros() - timeStart) / N_FRAMES;
+
+        Serial.printf(
+            "  %5d particles: %8.2fus per frame, %6.3fus per particle, %5.2f%% of 60 FPS frame\n",
+            count,
+            dt,
+            dt / count,
+            100.0 * dt * 60.0 / 1000000.0
+        );
+    }
+
+    delay(5000);
+}
@@ -0,0 +1,141 @@
+/**
+ * @file placement.cpp
+ * @brief Cold and warm timing of per-frame stages, to compare code placements.
+ *
+ * An alternative to the main loop that runs the per-frame stages on synthetic pink noise and times each
+ * of them twice: cold, right after `EVICT_SIZE` bytes of constant data in flash were read to evict
+ * the flash cache, and warm, right after the same stage ran. The difference is what cache misses cost
+ * the stage when other code ran in between. For each stage the following is printed:
+ * - average cold and warm time, and their difference,
+ * - worst cold time, which is what frame deadlines have to account for.
+ *
+ * Build the `placement` environment (hot code in internal RAM, see `placement.h`) and the
+ * `placement_flash` environment (everything in flash) and compare their reports. Sending data to the
+ * LEDs is not timed, FastLED stays in flash either way.
+ */
+
+#include <Arduino.h>
+
+#define FASTLED_INTERNAL // Silence FastLED SPI warning
+#include <FastLED.h>
+
+#include "audio.h"
+#include "synthetic.h"
+#include "tempo.h"
+#include "visualization.h"
+
+// Config
+#define N_RUNS     64
+#define EVICT_SIZE (64 * 1024) // Twice the flash cache of a core
+#define CACHE_LINE 32
+
+typedef struct {
+    uint8_t bytes[EVICT_SIZE];
+} EvictData;
+
+// Constant with a non-zero initializer, so that it is placed in `.rodata` (flash) rather than zeroed RAM.
+// Contents don't matter, only that every cache line is read from flash.
+static const EvictData evictData = {{1}};
+volatile uint8_t sink = 0;
+
+__attribute__((aligned(16))) float bands[AUDIO_MAX_BANDS];
+TempoEstimate estimate;
+
+/**
+ * @brief Reads a byte of every cache line of the eviction data, replacing the cached code and constants.
+ */
+void evictCache() {
+    // Volatile reads, the values are known at compile time and the loop would be folded otherwise
+    const volatile uint8_t *bytes = evictData.bytes;
+    uint8_t value = 0;
+    for (int i = 0; i < EVICT_SIZE; i += CACHE_LINE) {
+        value ^= bytes[i];
+    }
+    sink = value;
+}
+
+/**
+ * @brief Times a stage cold and warm over `N_RUNS` runs and prints the result.
+ */
+void timeStage(const char *name, void (*stage)()) {
+    unsigned long coldTime = 0;
+    unsigned long warmTime = 0;
+    unsigned long worstColdTime = 0;
+
+    for (int run = 0; run < N_RUNS; run++) {
+        evictCache();
+        unsigned long timeStart = micros();
+        stage();
+        unsigned long dt = micros() - timeStart;
+        coldTime += dt;
+        worstColdTime = dt > worstColdTime ? dt : worstColdTime;
+
+        timeStart = micros();
+        stage();
+        warmTime += micros() - timeStart;
+    }
+
+    float cold = (float)coldTime / N_RUNS;
+    float warm = (float)warmTime / N_RUNS;
+    Serial.printf("  %-24s cold %8.2fus warm %8.2fus misses %7.2fus (%5.1f%%) worst cold %6luus\n", name, cold, warm, cold - warm, warm > 0.0 ? 100.0 * (cold - warm) / warm : 0.0, worstColdTime);
+}
+
+void readStage() {
+    readAudioDataToBuffer();
+}
+
+void processStage() {
+    processAudioData(bands);
+    scaleAudioData(bands);
+}
+
+void tempoStage() {
+    updateTempo(bands, getAudioBandCount(), (unsigned long)((uint64_t)getAudioBufferLength() * 1000000 / getAudioSamplingRate()), &estimate);
+}
+
+void visualizationStage() {
+    updateVisualization(bands, getAudioBandCount());
+}
+
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupAudioProcessing(false);
+    setSyntheticSignal(SYNTHETIC_SIGNAL_PINK_NOISE);
+    setupAudioSource(AUDIO_SOURCE_SYNTHETIC);
+    setupAudioTables(AUDIO_SOURCE_SYNTHETIC);
+    resetAudioBandScale(AUDIO_SOURCE_SYNTHETIC);
+    setupTempo();
+
+    setupLedStrip();
+
+    // Fill the history and let the band scale settle
+    for (int i = 0; i < 64; i++) {
+        readStage();
+        processStage();
+    }
+}
+
+void loop() {
+#ifdef PLACE_HOT_IN_IRAM
+    Serial.printf("Placement: hot code in IRAM, %d runs:\n", N_RUNS);
+#else
+    Serial.printf("Placement: all code in flash, %d runs:\n", N_RUNS);
+#endif
+
+    timeStage("readAudioDataToBuffer", readStage);
+    timeStage("processAudioData", processStage);
+    timeStage("updateTempo", tempoStage);
+
+    char name[32];
+    for (VisualizationType type = 0; type < getVisualizationCount(); type++) {
+        setupVisualization(type);
+        setVisualizationPalette(0);
+        snprintf(name, sizeof(name), "update %s", getVisualizationName(type));
+        timeStage(name, visualizationStage);
+        teardownVisualization();
+    }
+
+    delay(5000);
+}
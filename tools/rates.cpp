@@ -0,0 +1,95 @@
+/**
+ * @file rates.cpp
+ * @brief Sampling rate benchmark.
+ *
+ * An alternative to the main loop that compares supported sampling rates with the FFT engine.
+ * Rates are switched every `N_LOOPS` frames and for each of them the following is printed:
+ * - compute time of `processAudioData` per frame and per second of audio (CPU load),
+ * - frame rate, bin width of the main and bass FFT,
+ * - DMA traffic,
+ * - analysis latency, measured from the estimated DMA completion of the newest sample to the end of processing.
+ *
+ * Read chunk is kept at the same duration for all rates, so that frame rates are comparable.
+ * Nothing is rendered, so that the results are not affected by the LED matrix.
+ */
+
+#include <Arduino.h>
+
+#include "audio.h"
+
+// Config
+#define AUDIO_SOURCE AUDIO_SOURCE_LINE_IN
+#define N_LOOPS      512
+
+const int samplingRates[] = {22050, 32000, 44100, 48000};
+const int nSamplingRates = sizeof(samplingRates) / sizeof(samplingRates[0]);
+
+__attribute__((aligned(16))) float audioBands[AUDIO_MAX_BANDS] = {0.0};
+
+uint loops = 0;
+int rateIdx = 0;
+
+float dt_processAudioData = 0.0;
+float latency = 0.0;
+float latencyMax = 0.0;
+unsigned long benchmarkStart = 0;
+
+void resetCounters() {
+    loops = 0;
+    dt_processAudioData = 0.0;
+    latency = 0.0;
+    latencyMax = 0.0;
+    benchmarkStart = micros();
+}
+
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupAudioProcessing(false);
+    setAudioEngine(AUDIO_ENGINE_FFT);
+    setAudioSamplingRate(samplingRates[rateIdx]);
+    setupAudioSource(AUDIO_SOURCE);
+    setupAudioTables(AUDIO_SOURCE);
+    resetAudioBandScale(AUDIO_SOURCE);
+
+    resetCounters();
+}
+
+void loop() {
+    readAudioDataToBuffer();
+
+    unsigned long timeStart = micros();
+    processAudioData(audioBands);
+    unsigned long timeEnd = micros();
+
+    dt_processAudioData += timeEnd - timeStart;
+    float frameLatency = timeEnd - getAudioCaptureTimestamp();
+    latency += frameLatency;
+    latencyMax = frameLatency > latencyMax ? frameLatency : latencyMax;
+
+    if (++loops >= N_LOOPS) {
+        int rate = getAudioSamplingRate();
+        int readChunk = getAudioCaptureConfig().readChunk;
+        float elapsed = micros() - benchmarkStart;
+        float computePerFrame = dt_processAudioData / N_LOOPS;
+        float audioPerFrame = readChunk * 1000000.0 / rate;
+
+        Serial.printf("Sampling rate: %d Hz\n", rate);
+        Serial.printf("  compute per frame:    %.2fus\n", computePerFrame);
+        Serial.printf("  cpu load:             %.2f%%\n", 100.0 * computePerFrame / audioPerFrame);
+        Serial.printf("  frame rate:           %.1f fps\n", N_LOOPS * 1000000.0 / elapsed);
+        Serial.printf("  bin width:            %.2f Hz (bass %.2f Hz)\n", (float)rate / getAudioFftSize(), (float)rate / AUDIO_BASS_DECIMATION / getAudioFftSize());
+        Serial.printf("  dma traffic:          %.1f KB/s\n", rate * sizeof(int32_t) * 2 / 1024.0);
+        Serial.printf("  latency:              %.2fus (max %.2fus)\n", latency / N_LOOPS, latencyMax);
+
+        rateIdx = (rateIdx + 1) % nSamplingRates;
+        teardownAudioSource();
+        setAudioSamplingRate(samplingRates[rateIdx]);
+        setupAudioSource(AUDIO_SOURCE);
+        setupAudioTables(AUDIO_SOURCE);
+        resetAudioBandScale(AUDIO_SOURCE);
+
+        resetCounters();
+    }
+}
@@ -0,0 +1,101 @@
+/**
+ * @file synthetic.cpp
+ * @brief Reproducibility check of the synthetic audio source.
+ *
+ * An alternative to the main loop that generates `CHECK_S` seconds of every synthetic signal at every
+ * sampling rate, in chunks of `CHUNK` frames as capture reads them, and prints a checksum (32-bit FNV-1a
+ * over the samples) of each. Checksums are compared with `referenceChecksums`, which were generated by
+ * a host build, so the device run shows whether it produces the same samples bit for bit.
+ *
+ * The generator doesn't depend on the framework, so the check also runs on the host, with the
+ * `synthetic_native` environment (`pio run -e synthetic_native -t exec`) or directly:
+ *   g++ -std=gnu++11 -O2 -I include src/synthetic.cpp tools/synthetic.cpp -o synthetic && ./synthetic
+ * On the host the exit status is nonzero if any checksum differs.
+ */
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <cstdio>
+#endif
+
+#include "synthetic.h"
+
+#ifdef ARDUINO
+#define REPORT Serial.printf
+#else
+#define REPORT printf
+#endif
+
+// Config
+#define CHECK_S 10  // Length of each signal, longer than a full sweep
+#define CHUNK   256 // Frames generated per call
+
+static const int rates[] = {22050, 32000, 44100, 48000};
+static const char *signalNames[] = {"sweep", "pink noise", "impulses", "silence"};
+
+// Indexed by rate and signal, generated by a host build (x86-64, GCC, -O0 and -O2 alike)
+static const uint32_t referenceChecksums[4][SYNTHETIC_SIGNAL_MAX_VALUE + 1] = {
+    {0xa4e09e1d, 0x9b523c69, 0x0db2ae01, 0x2fc55dc5},
+    {0x767f91b9, 0xd13b5d55, 0xf138b135, 0x29dbddc5},
+    {0xa12889b9, 0x63b586b9, 0xa47b5901, 0x81847dc5},
+    {0x35cd00f9, 0x0bfaf975, 0x76661135, 0xbc3b7dc5},
+};
+
+__attribute__((aligned(16))) int32_t samples[CHUNK * 2];
+
+/**
+ * @brief Returns the checksum of `CHECK_S` seconds of a signal.
+ */
+uint32_t checksumSignal(int rate, SyntheticSignal signal) {
+    setupSyntheticSignal(rate);
+    setSyntheticSignal(signal);
+
+    uint32_t hash = 2166136261u;
+    for (int frames = 0; frames < rate * CHECK_S; frames += CHUNK) {
+        generateSyntheticSamples(samples, CHUNK);
+        for (int i = 0; i < CHUNK * 2; i++) {
+            uint32_t value = (uint32_t)samples[i];
+            for (int byte = 0; byte < 4; byte++) {
+                hash = (hash ^ ((value >> (8 * byte)) & 0xFF)) * 16777619u;
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Checks every signal at every rate and prints the checksums.
+ *
+ * @return `true` if all checksums match the reference.
+ */
+bool checkSignals() {
+    int nMismatches = 0;
+    REPORT("Synthetic signals, %ds each:\n", CHECK_S);
+    for (int r = 0; r < 4; r++) {
+        for (int signal = 0; signal <= SYNTHETIC_SIGNAL_MAX_VALUE; signal++) {
+            uint32_t checksum = checksumSignal(rates[r], signal);
+            bool match = checksum == referenceChecksums[r][signal];
+            nMismatches += match ? 0 : 1;
+            REPORT("  %5d Hz %-10s 0x%08x %s\n", rates[r], signalNames[signal], (unsigned)checksum, match ? "ok" : "MISMATCH");
+        }
+    }
+    REPORT("%s\n", nMismatches > 0 ? "FAILED" : "PASSED");
+    return nMismatches == 0;
+}
+
+#ifdef ARDUINO
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+}
+
+void loop() {
+    checkSignals();
+    delay(5000);
+}
+#else
+int main() {
+    return checkSignals() ? 0 : 1;
+}
+#endif
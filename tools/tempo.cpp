@@ -0,0 +1,214 @@
+/**
+ * @file tempo.cpp
+ * @brief Tempo tracker validation on synthetic fixtures.
+ *
+ * An alternative to the main loop that feeds the tempo tracker with synthetic band frames of known
+ * tempo and phase: a kick in the low bands on every beat, optionally a hi-hat in the high bands
+ * off the beat, sustained mids and noise. Each fixture runs for `FIXTURE_S` seconds of audio
+ * at the frame period of every tested read chunk. For each fixture the following is printed:
+ * - estimated tempo and its error, with half and double tempo counted as octave errors,
+ * - time until the estimate stayed within `BPM_TOLERANCE` with sufficient confidence,
+ * - mean beat phase error over the last `PHASE_WINDOW_S` seconds,
+ * - time per frame and, on the device, its share of the FFT engine frame.
+ * A summary of verdicts, lock time and phase error over all fixtures follows each run. The run fails
+ * unless every fixture is accurate, on the host the exit status is nonzero then.
+ *
+ * Nothing is captured or rendered, the audio processing is only set up to measure FFT cost.
+ *
+ * The tracker doesn't depend on the framework, so the same fixtures also run on the host, with the
+ * `tempo_native` environment (`pio run -e tempo_native -t exec`) or directly:
+ *   g++ -std=gnu++11 -O2 -I include src/tempo.cpp tools/tempo.cpp -o tempo && ./tempo
+ * Fixtures use their own random generator, so host and device results only differ in timing.
+ */
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#endif
+
+#include "audio.h"
+#include "tempo.h"
+
+#ifdef ARDUINO
+#define REPORT Serial.printf
+#else
+#define REPORT printf
+
+static unsigned long micros() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+// Config
+#define FIXTURE_S      30.0  // Length of each fixture in seconds
+#define PHASE_WINDOW_S 10.0  // Phase error is averaged at the end of each fixture
+#define BPM_TOLERANCE  0.04  // Relative error of an accurate estimate
+#define BEAT_OFFSET_S  0.137 // Time of the first beat
+
+static const float fixtureBpms[] = {70, 90, 100, 110, 120, 128, 140, 160, 174};
+static const int readChunks[] = {1024, 512, 256};
+
+__attribute__((aligned(16))) float bands[AUDIO_N_BANDS];
+static uint32_t noiseState = 1;
+
+// Totals over a run of all fixtures
+static int nFixtures = 0;
+static int nAccurate = 0;
+static int nOctave = 0;
+static int nLocked = 0;
+static float lockTimeSum = 0.0;
+static float phaseErrorSum = 0.0;
+
+/**
+ * @brief Returns uniform noise from 0.0 to 1.0 (xorshift), the same on the host and the device.
+ */
+float noise() {
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+    return (noiseState % 1000) / 1000.0;
+}
+
+/**
+ * @brief Fills bands of a frame at time `t` of a fixture, `phase` is the position within the beat.
+ */
+void synthesizeBands(float t, float phase, float beatLength, bool offbeats) {
+    float offbeatPhase = phase < 0.5 ? phase + 0.5 : phase - 0.5;
+    for (int i = 0; i < AUDIO_N_BANDS; i++) {
+        float value = 0.05 * noise();
+        if (i < 8) value += 0.8 * expf(-phase * beatLength / 0.08);
+        if (i >= 8 && i <= 20) value += 0.2 + 0.1 * sinf(t * 3.0 + i);
+        if (i >= AUDIO_N_BANDS - 4 && offbeats) value += 0.2 * expf(-offbeatPhase * beatLength / 0.03);
+        bands[i] = value > 1.0 ? 1.0 : value;
+    }
+}
+
+void runFixture(float bpm, unsigned long period, bool offbeats) {
+    TempoEstimate estimate = {};
+    setupTempo();
+    noiseState = 1;
+
+    const float beatLength = 60.0 / bpm;
+    float lockTime = -1.0;
+    float phaseError = 0.0;
+    int nPhaseFrames = 0;
+    unsigned long busyTime = 0;
+    int nFrames = 0;
+
+    for (float t = 0.0; t < FIXTURE_S; t += period / 1000000.0) {
+        float position = (t - BEAT_OFFSET_S) / beatLength;
+        float phase = position < 0.0 ? 0.99 : position - floorf(position);
+        synthesizeBands(t, phase, beatLength, offbeats);
+
+        unsigned long timeStart = micros();
+        updateTempo(bands, AUDIO_N_BANDS, period, &estimate);
+        busyTime += micros() - timeStart;
+        nFrames++;
+
+        bool accurate = fabsf(estimate.bpm - bpm) < BPM_TOLERANCE * bpm && estimate.confidence >= TEMPO_MIN_CONFIDENCE;
+        lockTime = accurate ? (lockTime < 0.0 ? t : lockTime) : -1.0;
+
+        // Estimate describes the end of the frame
+        if (t > FIXTURE_S - PHASE_WINDOW_S) {
+            float truth = phase + period / 1000000.0 / beatLength;
+            float error = estimate.phase - (truth - floorf(truth));
+            phaseError += fabsf(error - roundf(error));
+            nPhaseFrames++;
+        }
+    }
+
+    const char *verdict = "wrong";
+    if (fabsf(estimate.bpm - bpm) < BPM_TOLERANCE * bpm) {
+        verdict = "ok";
+    } else if (fabsf(estimate.bpm - 2.0 * bpm) < BPM_TOLERANCE * 2.0 * bpm || fabsf(estimate.bpm - 0.5 * bpm) < BPM_TOLERANCE * 0.5 * bpm) {
+        verdict = "octave";
+    }
+
+    nFixtures++;
+    nAccurate += verdict[0] == 'o' && verdict[1] == 'k' ? 1 : 0;
+    nOctave += verdict[0] == 'o' && verdict[1] == 'c' ? 1 : 0;
+    if (lockTime >= 0.0) {
+        nLocked++;
+        lockTimeSum += lockTime;
+    }
+    phaseErrorSum += phaseError / nPhaseFrames;
+
+    float dt = (float)busyTime / nFrames;
+#ifdef ARDUINO
+    unsigned long fftCost = getAudioFftCost(AUDIO_N_SAMPLES);
+#else
+    unsigned long fftCost = 0; // FFT is not built on the host
+#endif
+    REPORT(
+        "  %5.1f BPM%s: %6.1f BPM (%+6.1f%%, %-6s) confidence %.2f, locked after ",
+        bpm,
+        offbeats ? " + offbeats" : "           ",
+        estimate.bpm,
+        100.0 * (estimate.bpm - bpm) / bpm,
+        verdict,
+        estimate.confidence
+    );
+    if (lockTime >= 0.0) {
+        REPORT("%5.1fs", lockTime);
+    } else {
+        REPORT(" never");
+    }
+    REPORT(", phase error %.3f beats, %6.2fus per frame", phaseError / nPhaseFrames, dt);
+    if (fftCost > 0) REPORT(" (%.2f%% of FFT)", 100.0 * dt / fftCost);
+    REPORT("\n");
+}
+
+/**
+ * @brief Runs every fixture at every read chunk and prints the summary.
+ *
+ * @return `true` if every fixture was accurate.
+ */
+bool runFixtures() {
+    nFixtures = nAccurate = nOctave = nLocked = 0;
+    lockTimeSum = phaseErrorSum = 0.0;
+
+    for (int chunk : readChunks) {
+        unsigned long period = (unsigned long)((uint64_t)chunk * 1000000 / AUDIO_SAMPLING_RATE);
+        REPORT("Tempo fixtures, read chunk %d (%luus per frame):\n", chunk, period);
+        for (float bpm : fixtureBpms) {
+            runFixture(bpm, period, false);
+            runFixture(bpm, period, true);
+        }
+    }
+
+    REPORT(
+        "Summary: %d/%d accurate, %d octave errors, mean lock time %.1fs (%d locked), mean phase error %.3f beats\n",
+        nAccurate,
+        nFixtures,
+        nOctave,
+        nLocked > 0 ? lockTimeSum / nLocked : 0.0,
+        nLocked,
+        phaseErrorSum / nFixtures
+    );
+
+    bool passed = nAccurate == nFixtures;
+    REPORT("%s\n", passed ? "PASSED" : "FAILED");
+    return passed;
+}
+
+#ifdef ARDUINO
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupAudioProcessing(true);
+}
+
+void loop() {
+    runFixtures();
+    delay(5000);
+}
+#else
+int main() {
+    return runFixtures() ? 0 : 1;
+}
+#endif
@@ -4,10 +4,14 @@
 #include <FastLED.h>
 
 #include "audio.h"
+#include "latency.h"
+#include "synthetic.h"
 #include "visualization.h"
 
 // Config
-#define AUDIO_SOURCE       AUDIO_SOURCE_LINE_IN
+// Synthetic input makes timings reproducible, use AUDIO_SOURCE_LINE_IN or AUDIO_SOURCE_MIC to time real capture
+#define AUDIO_SOURCE       AUDIO_SOURCE_SYNTHETIC
+#define AUDIO_SIGNAL       SYNTHETIC_SIGNAL_PINK_NOISE
 #define VISUALIZATION_TYPE VISUALIZATION_TYPE_FIRE
 
 float timeStart = 0.0;
@@ -41,6 +45,7 @@ void checkTimings() {
         dt_totalAverage += dt_updateVisualization;
         dt_totalAverage += dt_showVisualization;
         Serial.printf("  dt_totalAverage:          %.2fus per iteration\n", dt_totalAverage / N_LOOPS);
+        printLatencyReport();
 
         dt_readAudioDataToBuffer = 0.0;
         dt_processAudioData = 0.0;
@@ -50,7 +55,7 @@ void checkTimings() {
     }
 }
 
-__attribute__((aligned(16))) float audioBands[AUDIO_N_BANDS] = {0.0};
+__attribute__((aligned(16))) float audioBands[AUDIO_MAX_BANDS] = {0.0};
 __attribute__((aligned(16))) float audioBandsOld[AUDIO_N_BANDS] = {0.0};
 float bandScale = 0;
 
@@ -58,9 +63,10 @@ void setup() {
     Serial.begin(115200);
     delayMicroseconds(500);
 
+    setSyntheticSignal(AUDIO_SIGNAL);
     setupAudioSource(AUDIO_SOURCE);
     setupAudioTables(AUDIO_SOURCE);
-    setupAudioProcessing();
+    setupAudioProcessing(false);
 
     setupLedStrip();
     setupVisualization(VISUALIZATION_TYPE);
@@ -71,6 +77,8 @@ void loop() {
     TIME_MEASURE_START;
     readAudioDataToBuffer();
     TIME_MEASURE_END(dt_readAudioDataToBuffer);
+    beginLatencyFrame(getAudioCaptureTimestamp());
+    markLatencyStage(LATENCY_STAGE_CAPTURE);
 
     TIME_MEASURE_START;
     processAudioData(audioBands);
@@ -79,14 +87,18 @@ void loop() {
     TIME_MEASURE_START;
     scaleAudioData(audioBands);
     TIME_MEASURE_END(dt_scaleAudioData);
+    markLatencyStage(LATENCY_STAGE_ANALYSIS);
 
     TIME_MEASURE_START;
-    updateVisualization(audioBands);
+    updateVisualization(audioBands, getAudioBandCount());
     TIME_MEASURE_END(dt_updateVisualization);
+    markLatencyStage(LATENCY_STAGE_RENDER);
 
     TIME_MEASURE_START;
     showVisualization();
     TIME_MEASURE_END(dt_showVisualization);
+    markLatencyStage(LATENCY_STAGE_SHOW);
+    endLatencyFrame();
 
     checkTimings();
 }
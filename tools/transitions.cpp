@@ -0,0 +1,96 @@
+/**
+ * @file transitions.cpp
+ * @brief Visualization transitions benchmark.
+ *
+ * An alternative to the main loop that switches visualization every `N_LOOPS_PER_VISUALIZATION`
+ * frames and compares frames rendered during a crossfade with normal frames. For both kinds of
+ * frames it prints average render time (`updateVisualization`) and average frame time (render
+ * and `showVisualization`), and the ratio between transition and normal frames. Transition frames
+ * are expected to cost no more than 2x normal frames.
+ */
+
+#include <Arduino.h>
+
+#include "audio.h"
+#include "visualization.h"
+
+// Config
+#define AUDIO_SOURCE              AUDIO_SOURCE_LINE_IN
+#define N_LOOPS_PER_VISUALIZATION 64
+#define N_LOOPS                   512
+
+__attribute__((aligned(16))) float audioBands[AUDIO_MAX_BANDS] = {0.0};
+
+uint loops = 0;
+VisualizationType visualizationType = 0;
+
+float dt_normalRender = 0.0;
+float dt_normalFrame = 0.0;
+uint nNormal = 0;
+float dt_transitionRender = 0.0;
+float dt_transitionFrame = 0.0;
+uint nTransition = 0;
+
+void setup() {
+    Serial.begin(115200);
+    delayMicroseconds(500);
+
+    setupAudioSource(AUDIO_SOURCE);
+    setupAudioTables(AUDIO_SOURCE);
+    resetAudioBandScale(AUDIO_SOURCE);
+    setupAudioProcessing(false);
+
+    setupLedStrip();
+    setupVisualization(visualizationType);
+    setVisualizationPalette(0);
+}
+
+void loop() {
+    readAudioDataToBuffer();
+    processAudioData(audioBands);
+    scaleAudioData(audioBands);
+
+    bool isTransition = isVisualizationTransitionActive();
+
+    unsigned long timeStart = micros();
+    updateVisualization(audioBands, getAudioBandCount());
+    unsigned long timeRendered = micros();
+    showVisualization();
+    unsigned long timeEnd = micros();
+
+    if (isTransition) {
+        dt_transitionRender += timeRendered - timeStart;
+        dt_transitionFrame += timeEnd - timeStart;
+        nTransition++;
+    } else {
+        dt_normalRender += timeRendered - timeStart;
+        dt_normalFrame += timeEnd - timeStart;
+        nNormal++;
+    }
+
+    loops++;
+    if (loops % N_LOOPS_PER_VISUALIZATION == 0) {
+        visualizationType = (visualizationType + 1) % getVisualizationCount();
+        transitionVisualization(visualizationType);
+    }
+
+    if (loops >= N_LOOPS && nNormal > 0 && nTransition > 0) {
+        float normalRender = dt_normalRender / nNormal;
+        float normalFrame = dt_normalFrame / nNormal;
+        float transitionRender = dt_transitionRender / nTransition;
+        float transitionFrame = dt_transitionFrame / nTransition;
+
+        Serial.printf("Transitions:\n");
+        Serial.printf("  normal frames:     %u, render %.2fus, frame %.2fus\n", nNormal, normalRender, normalFrame);
+        Serial.printf("  transition frames: %u, render %.2fus, frame %.2fus\n", nTransition, transitionRender, transitionFrame);
+        Serial.printf("  ratio:             render %.2fx, frame %.2fx\n", transitionRender / normalRender, transitionFrame / normalFrame);
+
+        loops = 0;
+        dt_normalRender = 0.0;
+        dt_normalFrame = 0.0;
+        nNormal = 0;
+        dt_transitionRender = 0.0;
+        dt_transitionFrame = 0.0;
+        nTransition = 0;
+    }
+}